@@ -2,6 +2,8 @@
 #include "common/cli_wrapper.h"
 #include "tensors/cpu/expression_graph_packable.h"
 #include "onnx/expression_graph_onnx_exporter.h"
+#include "data/corpus_binary.h"
+#include "data/shortlist.h"
 
 #include <sstream>
 
@@ -18,26 +20,78 @@ int main(int argc, char** argv) {
         "Convert a model in the .npz format and normal memory layout to a mmap-able binary model which could be in normal memory layout or packed memory layout",
         "Allowed options",
         "Examples:\n"
-        "  ./marian-conv -f model.npz -t model.bin --gemm-type packed16");
+        "  ./marian-conv -f model.npz -t model.bin --gemm-type packed16\n"
+        "  ./marian-conv -f model.npz -t model.bin --gemm-type intgemm8 --gemm-variants intgemm8ssse3 intgemm8avx2 intgemm8avx512vnni\n"
+        "  ./marian-conv --shortlist lex.s2t.gz 100 100 0 --vocabs vocab.src.spm vocab.trg.spm -t lex.s2t.bin\n"
+        "  ./marian-conv --corpus corpus.src corpus.trg --vocabs vocab.src.spm vocab.trg.spm -t corpus.bin");
     cli->add<std::string>("--from,-f", "Input model", "model.npz");
     cli->add<std::string>("--to,-t", "Output model", "model.bin");
     cli->add<std::string>("--export-as", "Kind of conversion: marian-bin or onnx-{encode,decoder-step,decoder-init,decoder-stop}", "marian-bin");
     cli->add<std::string>("--gemm-type,-g", "GEMM Type to be used: float32, packed16, packed8avx2, packed8avx512, "
                           "intgemm8, intgemm8ssse3, intgemm8avx2, intgemm8avx512, intgemm16, intgemm16sse2, intgemm16avx2, intgemm16avx512", 
                           "float32");
-    cli->add<std::vector<std::string>>("--vocabs,-V", "Vocabulary file, required for ONNX export");
+    cli->add<std::vector<std::string>>("--gemm-variants", "Additionally store intgemm weights prepared for these hardware-specific types "
+                                       "of the same bit width as --gemm-type, e.g. intgemm8avx2 intgemm8avx512vnni. "
+                                       "The variant for the most recent instruction set the CPU supports is memory-mapped when loading");
+    cli->add<std::string>("--activation-ranges", "Store fixed quantization multipliers for the activations of intgemm8 matrix multiplications, "
+                          "computed from the ranges recorded with marian-decoder --intgemm-calibrate");
+    cli->add<std::vector<std::string>>("--vocabs,-V", "Vocabulary file, required for ONNX export, shortlist and corpus conversion");
+    cli->add<std::vector<std::string>>("--shortlist", "Convert a text lexical shortlist into the mmap-able binary format instead of a model: "
+                                       "path first best threshold, requires source and target --vocabs");
+    cli->add<std::vector<std::string>>("--corpus", "Convert parallel text files into the pre-tokenized binary format of --binary-corpus "
+                                       "instead of a model, requires one of --vocabs for each file");
     cli->parse(argc, argv);
     options->merge(config);
   }
   auto modelFrom = options->get<std::string>("from");
   auto modelTo = options->get<std::string>("to");
 
+  if(options->hasAndNotEmpty("shortlist")) {
+    auto vocabPaths = options->get<std::vector<std::string>>("vocabs");
+    ABORT_IF(vocabPaths.size() != 2, "Shortlist conversion requires a source and a target vocabulary");
+
+    std::vector<Ptr<Vocab>> vocabs;
+    for(size_t i = 0; i < vocabPaths.size(); ++i) {
+      vocabs.push_back(New<Vocab>(options, i));
+      vocabs.back()->load(vocabPaths[i]);
+    }
+
+    LOG(info, "Outputting binary shortlist {}", modelTo);
+    data::BinaryShortlistGenerator shortlist(options, vocabs[0], vocabs[1], 0, 1, vocabPaths[0] == vocabPaths[1]);
+    shortlist.dump(modelTo);
+
+    LOG(info, "Finished");
+    return 0;
+  }
+
+  if(options->hasAndNotEmpty("corpus")) {
+    auto paths = options->get<std::vector<std::string>>("corpus");
+    auto vocabPaths = options->get<std::vector<std::string>>("vocabs");
+    ABORT_IF(vocabPaths.size() != paths.size(), "Corpus conversion requires one vocabulary for each file");
+
+    std::vector<Ptr<Vocab>> vocabs;
+    for(size_t i = 0; i < vocabPaths.size(); ++i) {
+      vocabs.push_back(New<Vocab>(options, i));
+      vocabs.back()->load(vocabPaths[i]);
+    }
+
+    LOG(info, "Outputting binary corpus {}", modelTo);
+    data::CorpusBinary::convert(paths, vocabs, modelTo);
+
+    LOG(info, "Finished");
+    return 0;
+  }
+
   auto exportAs = options->get<std::string>("export-as");
   auto vocabPaths = options->get<std::vector<std::string>>("vocabs");// , std::vector<std::string>());
   
   // We accept any type here and will later croak during packAndSave if the type cannot be used for conversion
   Type saveGemmType = typeFromString(options->get<std::string>("gemm-type", "float32"));
 
+  std::vector<Type> variantTypes;
+  for(auto variant : options->get<std::vector<std::string>>("gemm-variants", {}))
+    variantTypes.push_back(typeFromString(variant));
+
   LOG(info, "Outputting {}, precision: {}", modelTo, saveGemmType);
 
   YAML::Node config;
@@ -54,9 +108,24 @@ int main(int argc, char** argv) {
 
   if (exportAs == "marian-bin") {
     auto graph = New<ExpressionGraphPackable>();
+    std::map<std::string, float> ranges;
+    if(options->hasAndNotEmpty("activation-ranges")) {
+      ABORT_IF(!isIntgemm(saveGemmType) || sizeOf(saveGemmType) != 1, "--activation-ranges requires an intgemm8 --gemm-type");
+      ranges = cpu::integer::ActivationCalibrator::load(options->get<std::string>("activation-ranges"));
+
+      // added before loading the model, which does not allow creating new parameters
+      graph->setDevice(CPU0);
+      for(auto& range : ranges) {
+        float quantMult = range.second > 0.f ? 127.0f / range.second : 1.f;
+        graph->param(range.first + cpu::integer::QUANT_MULT_A_SUFFIX, {1, 1}, inits::fromValue(quantMult));
+      }
+      LOG(info, "Storing fixed activation quantization multipliers for {} matrices", ranges.size());
+    }
     load(graph);
+    for(auto& range : ranges)
+      ABORT_IF(!graph->get(range.first), "Model has no parameter {} for activation range", range.first);
     // added a flag if the weights needs to be packed or not
-    graph->packAndSave(modelTo, configStr.str(), /* --gemm-type */ saveGemmType, Type::float32);
+    graph->packAndSave(modelTo, configStr.str(), /* --gemm-type */ saveGemmType, Type::float32, /* --gemm-variants */ variantTypes);
   }
   else if (exportAs == "onnx-encode") {
 #ifdef USE_ONNX
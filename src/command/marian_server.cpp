@@ -1,5 +1,6 @@
 #include "marian.h"
 #include "translator/beam_search.h"
+#include "translator/model_registry.h"
 #include "translator/translator.h"
 #include "common/timer.h"
 #include "common/utils.h"
@@ -11,44 +12,144 @@ typedef SimpleWeb::SocketServer<SimpleWeb::WS> WSServer;
 int main(int argc, char **argv) {
   using namespace marian;
 
-  // Initialize translation task
+  typedef TranslateService<BeamSearch> Service;
+
+  // Initialize translation task, either a single model or several models loaded on demand
   auto options = parseOptions(argc, argv, cli::mode::server, true);
-  auto task = New<TranslateService<BeamSearch>>(options);
+  Ptr<Service> task;
+  Ptr<ModelRegistry<Service>> registry;
+  if(options->hasAndNotEmpty("model-configs")) {
+    registry = New<ModelRegistry<Service>>(options);
+    LOG(info, "[server] Registered models: {}", utils::join(registry->names(), ", "));
+  } else {
+    task = New<Service>(options);
+  }
   auto quiet = options->get<bool>("quiet-translation");
+  auto stream = options->get<bool>("stream-sentences");
 
   // Initialize web server
   WSServer server;
   server.config.port = (short)options->get<size_t>("port", 8080);
 
-  auto &translate = server.endpoint["^/translate/?$"];
-
-  translate.on_message = [&task, quiet](Ptr<WSServer::Connection> connection,
-                                        Ptr<WSServer::InMessage> message) {
-    // Get input text
-    auto inputText = message->string();
+  // Send a message back, this is safe to be called from any thread
+  auto send = [](Ptr<WSServer::Connection> connection, const std::string &text) {
     auto sendStream = std::make_shared<WSServer::OutMessage>();
-
-    // Translate
-    timer::Timer timer;
-    auto outputText = task->run(inputText);
-    *sendStream << outputText << std::endl;
-    if(!quiet)
-      LOG(info, "Translation took: {:.5f}s", timer.elapsed());
-
-    // Send translation back
+    *sendStream << text << std::endl;
     connection->send(sendStream, [](const SimpleWeb::error_code &ec) {
       if(ec)
         LOG(error, "Error sending message: ({}) {}", ec.value(), ec.message());
     });
   };
 
+  // Translates the message with the given service. The service pointer is only held until run()
+  // returns, so a model that is reloaded or unloaded meanwhile is released once its requests are done.
+  auto translateWith = [send, quiet, stream](Ptr<Service> service,
+                                             Ptr<WSServer::Connection> connection,
+                                             Ptr<WSServer::InMessage> message) {
+    // Get input text
+    auto inputText = message->string();
+    auto timer = New<timer::Timer>();
+
+    // With --stream-sentences each sentence is sent as "line-number<tab>translation" as soon as it
+    // is final, otherwise the reply is sent once all sentences of this message are done. With
+    // --shared-batching or --stream-sentences this returns immediately and the callbacks run on a
+    // worker thread, so the io thread is free to send the sentences while the rest are translated.
+    ServiceRequest::SentenceCallback onSentence;
+    if(stream)
+      onSentence = [send, connection](long lineNum, const std::string &translation) {
+        send(connection, std::to_string(lineNum) + "\t" + translation);
+      };
+
+    // A message that cannot be translated is answered with the error, the server keeps running
+    auto onFailure = [send, connection](std::exception_ptr error) {
+      std::string what = "unknown error";
+      try {
+        std::rethrow_exception(error);
+      } catch(const std::exception &e) {
+        what = e.what();
+      } catch(...) {
+      }
+      send(connection, "Error: " + what);
+    };
+
+    service->run(inputText,
+                 [send, connection, quiet, stream, timer](const std::string &outputText) {
+                   if(!quiet)
+                     LOG(info, "Translation took: {:.5f}s", timer->elapsed());
+                   if(!stream)
+                     send(connection, outputText);
+                 },
+                 onSentence,
+                 onFailure);
+  };
+
   // Error Codes for error code meanings
   // http://www.boost.org/doc/libs/1_55_0/doc/html/boost_asio/reference.html
-  translate.on_error = [](Ptr<WSServer::Connection> /*connection*/,
-                          const SimpleWeb::error_code &ec) {
+  auto onError = [](Ptr<WSServer::Connection> /*connection*/, const SimpleWeb::error_code &ec) {
     LOG(error, "Connection error: ({}) {}", ec.value(), ec.message());
   };
 
+  if(registry) {
+    // /translate/name translates with model 'name', /translate with the first registered model
+    auto &translate = server.endpoint["^/translate/?([^/]*)/?$"];
+    translate.on_message = [registry, translateWith, send](Ptr<WSServer::Connection> connection,
+                                                           Ptr<WSServer::InMessage> message) {
+      std::string name = connection->path_match[1];
+      if(!registry->has(name)) {
+        LOG(warn, "[server] Request for unknown model '{}'", name);
+        send(connection, "Unknown model: " + name);
+        return;
+      }
+      if(auto service = registry->getIfLoaded(name)) {
+        translateWith(service, connection, message);
+        return;
+      }
+      // load in the background, so the io thread keeps serving other connections meanwhile
+      std::thread([registry, translateWith, send, connection, message, name]() {
+        try {
+          translateWith(registry->get(name), connection, message);
+        } catch(const std::exception &e) {
+          LOG(error, "[server] Loading model '{}' failed: {}", name, e.what());
+          send(connection, "Error: " + std::string(e.what()));
+        }
+      }).detach();
+    };
+    translate.on_error = onError;
+
+    // Any message to /reload/name loads model 'name' again from its config file and swaps it in
+    // atomically, requests that are in flight finish on the previous model
+    auto &reload = server.endpoint["^/reload/([^/]+)/?$"];
+    reload.on_message = [registry, send](Ptr<WSServer::Connection> connection,
+                                         Ptr<WSServer::InMessage> /*message*/) {
+      std::string name = connection->path_match[1];
+      if(!registry->has(name)) {
+        send(connection, "Unknown model: " + name);
+        return;
+      }
+      // load in the background, so the server keeps translating with the previous model meanwhile
+      std::thread([registry, send, connection, name]() {
+        timer::Timer timer;
+        try {
+          registry->reload(name);
+        } catch(const std::exception &e) {
+          LOG(error, "[server] Reloading model '{}' failed: {}", name, e.what());
+          send(connection, "Error: " + std::string(e.what()));
+          return;
+        }
+        LOG(info, "[server] Reloaded model {} in {:.2f}s", name, timer.elapsed());
+        send(connection, "Reloaded model: " + name);
+      }).detach();
+    };
+    reload.on_error = onError;
+  } else {
+    auto &translate = server.endpoint["^/translate/?$"];
+    translate.on_message = [task, translateWith](Ptr<WSServer::Connection> connection,
+                                                 Ptr<WSServer::InMessage> message) {
+      translateWith(task, connection, message);
+    };
+    translate.on_error = onError;
+  }
+
   // Start server thread
   std::thread serverThread([&server]() {
     server.start([](unsigned short port) {
@@ -5,6 +5,8 @@
 #include "common/types.h"
 #include "tensors/cpu/integer_common.h"
 
+#include <map>
+#include <sstream>
 #include <string>
 
 namespace marian {
@@ -27,6 +29,56 @@ const T* get(const void*& current, uint64_t num = 1) {
   return ptr;
 }
 
+static const std::string INTGEMM_VARIANT_PREFIX = "special:intgemm:";
+
+std::string intgemmVariantName(const std::string& name, Type type) {
+  std::stringstream variantName;
+  variantName << INTGEMM_VARIANT_PREFIX << type << ":" << name;
+  return variantName.str();
+}
+
+// Determines for each item whether it is loaded: of an intgemm matrix and its hardware-specific
+// variants only the one for the most recent instruction set supported by the CPU is kept, and it
+// gets the name of the matrix.
+static std::vector<bool> selectIntgemmVariants(std::vector<io::Item>& items) {
+  std::vector<bool> keep(items.size(), true);
+
+  auto isVariant = [](const io::Item& item) {
+    return item.name.compare(0, INTGEMM_VARIANT_PREFIX.size(), INTGEMM_VARIANT_PREFIX) == 0;
+  };
+
+  std::map<std::string, size_t> selected; // matrix name -> index of the selected item
+  for(size_t i = 0; i < items.size(); ++i)
+    if(isIntgemm(items[i].type) && !isVariant(items[i]))
+      selected[items[i].name] = i;
+
+  for(size_t i = 0; i < items.size(); ++i) {
+    if(!isVariant(items[i]))
+      continue;
+    keep[i] = false;
+
+    auto pos = items[i].name.find(':', INTGEMM_VARIANT_PREFIX.size());
+    ABORT_IF(pos == std::string::npos, "Invalid name of intgemm variant {}", items[i].name);
+    auto found = selected.find(items[i].name.substr(pos + 1));
+    ABORT_IF(found == selected.end(), "Intgemm variant {} has no matching matrix", items[i].name);
+
+    if(cpu::integer::intgemmTypeRank(items[i].type) > cpu::integer::intgemmTypeRank(items[found->second].type)) {
+      keep[found->second] = false;
+      keep[i] = true;
+      found->second = i;
+    }
+  }
+
+  for(auto& matrix : selected) {
+    auto& item = items[matrix.second];
+    if(item.name != matrix.first) {
+      LOG_ONCE(info, "[memory] Using intgemm matrices prepared for {}", item.type);
+      item.name = matrix.first;
+    }
+  }
+  return keep;
+}
+
 void loadItems(const void* current, std::vector<io::Item>& items, bool mapped) {
   uint64_t binaryFileVersion = *get<uint64_t>(current);
   ABORT_IF(binaryFileVersion != BINARY_FILE_VERSION,
@@ -45,6 +97,8 @@ void loadItems(const void* current, std::vector<io::Item>& items, bool mapped) {
     items[i].mapped = mapped;
   }
 
+  auto keep = selectIntgemmVariants(items);
+
   // read in actual shape and data
   for(int i = 0; i < numHeaders; ++i) {
     uint64_t len = headers[i].shapeLength;
@@ -58,14 +112,22 @@ void loadItems(const void* current, std::vector<io::Item>& items, bool mapped) {
   get<char>(current, offset);
 
   for(int i = 0; i < numHeaders; ++i) {
+    if(!keep[i]) { // variant for another instruction set
+      get<char>(current, headers[i].dataLength);
+      continue;
+    }
     // For intgemm AVX512 and AVX512VNNI have the same arangement, but the VNNI algorithm is faster.
     // Change the type to the fastest one supported.
     if (items[i].type == Type::intgemm8avx512) {
       items[i].type = cpu::integer::getIntgemmType(Type::intgemm8);
     }
+    if(items[i].mapped && (items[i].type == Type::intgemm8 || items[i].type == Type::intgemm16)) {
+      // hardware non-specific intgemm matrices need to be prepared, so they cannot be memory-mapped
+      LOG_ONCE(warn, "[memory] Model contains no intgemm matrices prepared for this CPU, preparing them instead of memory-mapping. "
+               "Store hardware-specific variants with marian-conv --gemm-variants");
+      items[i].mapped = false;
+    }
     if(items[i].mapped) { // memory-mapped, hence only set pointer
-      // @TOOD: verify this actually works for the hardware-specific ones like intgemm8avx2
-      ABORT_IF(items[i].type == Type::intgemm8 || items[i].type == Type::intgemm16, "mmap format not supported for hardware non-specific intgemm matrices");
       items[i].ptr = get<char>(current, headers[i].dataLength);
     } else { // reading into item data
       uint64_t len = headers[i].dataLength;
@@ -85,6 +147,17 @@ void loadItems(const void* current, std::vector<io::Item>& items, bool mapped) {
       }
     }
   }
+
+  // drop the variants that were not selected
+  size_t kept = 0;
+  for(size_t i = 0; i < items.size(); ++i) {
+    if(!keep[i])
+      continue;
+    if(kept != i)
+      items[kept] = std::move(items[i]);
+    kept++;
+  }
+  items.resize(kept);
 }
 
 void loadItems(const std::string& fileName, std::vector<io::Item>& items) {
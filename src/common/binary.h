@@ -22,6 +22,14 @@ io::Item getItem(const std::string& fileName, const std::string& vName);
 
 void saveItems(const std::string& fileName, const std::vector<io::Item>& items);
 
+/**
+ * Returns the name of an item holding a hardware-specific variant of the intgemm matrix name, which can
+ * be stored in addition to the matrix itself. When loading, each matrix is replaced by the variant for
+ * the most recent instruction set the CPU supports, so that it can be memory-mapped without being
+ * prepared again. The name starts with "special:", so older versions ignore these items.
+ */
+std::string intgemmVariantName(const std::string& name, Type type);
+
 }  // namespace binary
 }  // namespace io
 }  // namespace marian
@@ -45,6 +45,7 @@ const std::set<std::string> PATHS = {
   "data-weighting",
   "log",
   "sqlite",           // except: 'temporary', handled in the processPaths function
+  "binary-corpus",
   "shortlist",        // except: only the first element in the sequence is a path, handled in the
                       //  processPaths function
 };
@@ -162,6 +163,26 @@ void ConfigParser::addOptionsServer(cli::CLIWrapper& cli) {
   cli.add<size_t>("--port,-p",
       "Port number for web socket server",
       8080);
+  cli.add<bool>("--shared-batching",
+      "Merge sentences from concurrent requests into shared batches of up to --mini-batch sentences "
+      "translated by persistent workers");
+  cli.add<float>("--max-batch-latency",
+      "Maximum time in milliseconds a sentence waits for a shared batch to fill up",
+      10.f);
+  cli.add<size_t>("--max-batch-tokens",
+      "Maximum number of source tokens in a shared batch, 0 means no limit",
+      0);
+  cli.add<bool>("--stream-sentences",
+      "Send each sentence as a separate message 'line-number<tab>translation' as soon as its translation "
+      "is final instead of a single message per request");
+  cli.add<std::vector<std::string>>("--model-configs",
+      "Serve several models, each given as name=config.yml with a decoder config that overrides the "
+      "server options. Model 'name' is translated at /translate/name and reloaded at /reload/name, "
+      "the first model also at /translate. Models are loaded on their first request");
+  cli.add<size_t>("--models-memory-budget",
+      "Unload least recently used models if the estimated memory (model files and workspace) of all "
+      "loaded models exceeds arg MB, 0 means no limit",
+      0);
   cli.switchGroup(previous_group);
   // clang-format on
 }
@@ -349,6 +370,9 @@ void ConfigParser::addOptionsTraining(cli::CLIWrapper& cli) {
   cli.add<bool>("--overwrite",
       "Do not create model checkpoints, only overwrite main model file with last checkpoint. "
       "Reduces disk usage");
+  cli.add<bool>("--async-checkpoint",
+      "Write model files and training checkpoints on a background thread, training continues as soon as "
+      "the parameters and optimizer states have been copied to host memory");
   cli.add<bool>("--no-reload",
       "Do not load existing model specified in --model arg");
   cli.add<std::vector<std::string>>("--train-sets,-t",
@@ -418,6 +442,9 @@ void ConfigParser::addOptionsTraining(cli::CLIWrapper& cli) {
     ->implicit_val("temporary");
   cli.add<bool>("--sqlite-drop",
       "Drop existing tables in sqlite3 database");
+  cli.add<std::string>("--binary-corpus",
+      "Read training data from a memory-mapped binary file of word indices, which is created from"
+      " --train-sets with the given vocabularies if it does not exist");
 
   addSuboptionsDevices(cli);
   addSuboptionsBatching(cli);
@@ -436,6 +463,10 @@ void ConfigParser::addOptionsTraining(cli::CLIWrapper& cli) {
 
   cli.add<bool>("--sync-sgd",
      "Use synchronous SGD instead of asynchronous for multi-gpu training");
+  cli.add<size_t>("--sync-bucket-size",
+     "Reduce gradients of synchronous SGD across local devices in buckets of arg MB while the backward pass "
+     "is still running. 0 reduces all gradients after the backward pass",
+     0);
 
   // learning rate options
   cli.add<float>("--learn-rate,-l",
@@ -653,6 +684,10 @@ void ConfigParser::addOptionsTranslation(cli::CLIWrapper& cli) {
       3);
   cli.add<float>("--word-penalty",
       "Subtract (arg * translation length) from translation score");
+  cli.add<float>("--beam-compaction-threshold",
+      "Keep finished sentences in the decoder state tensors until the fraction of unfinished sentences "
+      "in a batch drops below arg, then remove them at once. 1 removes them immediately, 0 never",
+      1.f);
   cli.add<bool>("--allow-unk",
       "Allow unknown words to appear in output");
   cli.add<bool>("--allow-special",
@@ -667,6 +702,9 @@ void ConfigParser::addOptionsTranslation(cli::CLIWrapper& cli) {
   cli.add<std::string/*SchedulerPeriod*/>("--stat-freq",
     "Display speed information every arg mini-batches. Disabled by default with 0, set to value larger than 0 to activate",
     "0");
+  cli.add<bool>("--latency-stats",
+    "Collect latencies of batching, shortlist, encoder, decoder steps, top-k, hypothesis creation and output "
+    "and log their percentiles as JSON every --stat-freq mini-batches (server: requests) and at the end");
 #ifdef USE_SENTENCEPIECE
   cli.add<bool>("--no-spm-decode",
       "Keep the output segmented into SentencePiece subwords");
@@ -682,11 +720,22 @@ void ConfigParser::addOptionsTranslation(cli::CLIWrapper& cli) {
   cli.add<std::vector<std::string>>("--precision",
       "Mixed precision for inference, set parameter type in expression graph",
       {"float32"});
+  cli.add<bool>("--model-mmap",
+      "Memory-map binary models (*.bin) instead of loading them, CPU only. Processes share model pages");
   cli.add<bool>("--skip-cost",
     "Ignore model cost during translation, not recommended for beam-size > 1");
+  cli.add<bool>("--fused-top-k",
+    "Compute log-softmax, path scores and n-best lists in a single pass over the output logits. "
+    "CPU only, single model without factors");
+  cli.add<bool>("--plan-memory",
+    "Place the intermediate tensors of each forward pass at offsets planned ahead by their lifetimes "
+    "in a single block of the workspace instead of allocating them one by one");
 
   cli.add<std::vector<std::string>>("--shortlist",
      "Use softmax shortlist: path first best prune");
+  cli.add<size_t>("--shortlist-cache-size",
+     "Cache shortlists of up to  arg  distinct sets of source words, 0 disables caching",
+     0);
   cli.add<std::vector<float>>("--weights",
       "Scorer weights");
   cli.add<bool>("--output-sampling",
@@ -700,10 +749,14 @@ void ConfigParser::addOptionsTranslation(cli::CLIWrapper& cli) {
   cli.add<bool>("--optimize",
       "Optimize the graph on-the-fly", false);
   cli.add<std::string>("--gemm-type,-g",
-     "GEMM Type to be used for on-line quantization/packing: float32, packed16, packed8", "float32");
+     "GEMM Type to be used for on-line quantization/packing: float32, packed16, packed8. "
+     "intgemm8 or intgemm16 also compute the attention products of activations in intgemm", "float32");
   cli.add<float>("--quantize-range",
      "Range for the on-line quantiziation of weight matrix in multiple of this range and standard deviation, 0.0 means min/max quantization",
      0.f);
+  cli.add<std::string>("--intgemm-calibrate",
+     "Record the largest absolute activation value of each intgemm8 matrix multiplication while translating "
+     "and save them to file  arg , see marian-conv --activation-ranges");
 
 #if 0 // @TODO: Ask Hany if there are any decoding-time options
   // add ULR settings
@@ -760,7 +813,8 @@ void ConfigParser::addOptionsScoring(cli::CLIWrapper& cli) {
   cli.add<bool>("--optimize",
       "Optimize the graph on-the-fly", false);
   cli.add<std::string>("--gemm-type,-g",
-     "GEMM Type to be used for on-line quantization/packing: float32, packed16, packed8", "float32");
+     "GEMM Type to be used for on-line quantization/packing: float32, packed16, packed8. "
+     "intgemm8 or intgemm16 also compute the attention products of activations in intgemm", "float32");
   cli.add<float>("--quantize-range",
      "Range for the on-line quantiziation of weight matrix in multiple of this range and standard deviation, 0.0 means min/max quantization",
      0.f);
@@ -836,6 +890,10 @@ void ConfigParser::addSuboptionsDevices(cli::CLIWrapper& cli) {
       "Use CPU-based computation with this many independent threads, 0 means GPU-based computation",
       1);
 #endif
+  cli.add<size_t>("--cpu-intra-threads",
+      "Split large CPU operations (element-wise, softmax, layer normalization, GEMM) of one graph "
+      "across this many threads, shared by all --cpu-threads",
+      1);
   // clang-format on
 }
 
@@ -865,6 +923,15 @@ void ConfigParser::addSuboptionsBatching(cli::CLIWrapper& cli) {
     cli.add<bool>("--gradient-checkpointing",
       "Enable gradient-checkpointing to minimize memory usage");
   }
+  if(mode_ == cli::mode::translation) {
+    cli.add<bool>("--mini-batch-fit",
+      "Determine mini-batch size automatically based on source length to fit reserved memory when "
+      "decoding up to the maximum output length. The batch sizes are cached in model.batch-fit.yml "
+      "next to the first model; fitting up to a lower --max-length is faster");
+    cli.add<size_t>("--mini-batch-fit-step",
+      "Step size for mini-batch-fit statistics",
+      10);
+  }
 
   cli.add<int>("--maxi-batch",
       "Number of batches to preload for length-based sorting",
@@ -872,6 +939,19 @@ void ConfigParser::addSuboptionsBatching(cli::CLIWrapper& cli) {
   cli.add<std::string>("--maxi-batch-sort",
       "Sorting strategy for maxi-batch: none, src, trg (not available for decoder)",
       defaultMaxiBatchSort);
+  cli.add<size_t>("--data-threads",
+      "Number of threads for pre-processing and encoding the input and building batches. "
+      "Input from a pipe is always read with a single thread",
+      1);
+
+  if(mode_ == cli::mode::translation) {
+    cli.add<size_t>("--length-buckets",
+      "Group sentences of a maxi-batch into source length buckets of this width and never mix buckets "
+      "within a mini-batch. Disabled with 0");
+    cli.add<size_t>("--mini-batch-tokens",
+      "With --length-buckets, limit mini-batches to this many sentences times beam size times "
+      "maximum output length (longest source length times --max-length-factor). Unlimited with 0");
+  }
 
   if(mode_ == cli::mode::training) {
     cli.add<bool>("--shuffle-in-ram",
@@ -48,6 +48,18 @@ void ConfigValidator::validateOptions(cli::mode mode) const {
 }
 
 void ConfigValidator::validateOptionsTranslation() const {
+  auto compactionThreshold = get<float>("beam-compaction-threshold");
+  ABORT_IF(compactionThreshold < 0.f || compactionThreshold > 1.f,
+           "--beam-compaction-threshold must be between 0 and 1");
+  ABORT_IF(get<bool>("fused-top-k") && get<bool>("n-best"),
+           "--fused-top-k does not provide the score breakdown of --n-best");
+  ABORT_IF(get<bool>("fused-top-k") && get<bool>("output-sampling"),
+           "--fused-top-k cannot be combined with --output-sampling");
+
+  // a multi-model server gets models and vocabularies from the per-model config files
+  if(has("model-configs") && !get<std::vector<std::string>>("model-configs").empty())
+    return;
+
   auto models = get<std::vector<std::string>>("models");
   auto configs = get<std::vector<std::string>>("config");
 
@@ -109,6 +109,16 @@ namespace filesystem {
     return p.getImpl().is_directory();
   }
 
+  // Replaces the file 'to' by 'from', atomically on POSIX systems if both are on the same file system
+  static inline void rename(const Path& from, const Path& to) {
+    Pathie::Path target = to.getImpl();
+#ifdef _WIN32
+    if(target.exists()) // renaming does not overwrite on Windows
+      target.remove();
+#endif
+    from.getImpl().rename(target);
+  }
+
   static inline Path operator/ (const Path& lhs, const Path& rhs) {
     return Path(lhs.getImpl() / rhs.getImpl());
   }
@@ -158,8 +158,20 @@ void saveItemsNpz(const std::string& fileName, const std::vector<Item>& items) {
   cnpy::npz_save(fileName, npzItems);
 }
 
+static thread_local SaveItemsRedirect::SaveFunc* saveRedirect = nullptr;
+
+SaveItemsRedirect::SaveItemsRedirect(const SaveFunc& saveFn) : saveFn_(saveFn), previous_(saveRedirect) {
+  saveRedirect = &saveFn_;
+}
+
+SaveItemsRedirect::~SaveItemsRedirect() {
+  saveRedirect = previous_;
+}
+
 void saveItems(const std::string& fileName, const std::vector<Item>& items) {
-  if(isNpz(fileName)) {
+  if(saveRedirect) {
+    (*saveRedirect)(fileName, items);
+  } else if(isNpz(fileName)) {
     saveItemsNpz(fileName, items);
   } else if(isBin(fileName)) {
     binary::saveItems(fileName, items);
@@ -3,6 +3,7 @@
 #include "3rd_party/yaml-cpp/yaml.h"
 #include "common/io_item.h"
 
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -33,6 +34,23 @@ std::vector<Item> mmapItems(const void* ptr);
 
 void saveItems(const std::string& fileName, const std::vector<Item>& items);
 
+/**
+ * While an instance exists, saveItems() on the thread that created it passes file name and items
+ * to the given function instead of writing them. This lets a caller take over writing the files of
+ * code that saves models, e.g. to write checkpoints on a background thread.
+ */
+class SaveItemsRedirect {
+public:
+  typedef std::function<void(const std::string& fileName, const std::vector<Item>& items)> SaveFunc;
+
+  SaveItemsRedirect(const SaveFunc& saveFn);
+  ~SaveItemsRedirect();
+
+private:
+  SaveFunc saveFn_;
+  SaveFunc* previous_;
+};
+
 /**
  * Creates a flat io::Item from a given std::vector so that it can be saved in a npz file 
  * or Marian's native binary format with the given name.
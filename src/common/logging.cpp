@@ -16,8 +16,14 @@
 
 namespace marian {
   static bool throwExceptionOnAbort = false;
-  bool getThrowExceptionOnAbort() { return throwExceptionOnAbort; }
+  static thread_local bool throwExceptionOnAbortInThread = false; // see ScopedThrowExceptionOnAbort
+  bool getThrowExceptionOnAbort() { return throwExceptionOnAbort || throwExceptionOnAbortInThread; }
   void setThrowExceptionOnAbort(bool doThrowExceptionOnAbort) { throwExceptionOnAbort = doThrowExceptionOnAbort; };
+
+  ScopedThrowExceptionOnAbort::ScopedThrowExceptionOnAbort() : previous_(throwExceptionOnAbortInThread) {
+    throwExceptionOnAbortInThread = true;
+  }
+  ScopedThrowExceptionOnAbort::~ScopedThrowExceptionOnAbort() { throwExceptionOnAbortInThread = previous_; }
 }
 
 std::shared_ptr<spdlog::logger> createStderrLogger(const std::string& name,
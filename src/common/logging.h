@@ -35,6 +35,17 @@ namespace marian {
 
   // Set the state of throwExceptionOnAbort (see logging.cpp)
   void setThrowExceptionOnAbort(bool);
+
+  // Makes ABORT throw a MarianRuntimeException on the current thread while in scope, e.g. to
+  // recover from errors while loading a model in a long-running process. Other threads still abort.
+  class ScopedThrowExceptionOnAbort {
+  private:
+    bool previous_;
+
+  public:
+    ScopedThrowExceptionOnAbort();
+    ~ScopedThrowExceptionOnAbort();
+  };
 }
 
 /**
@@ -8,6 +8,8 @@
 #include "data/iterator_facade.h"
 #include "3rd_party/threadpool.h"
 
+#include <algorithm>
+#include <cmath>
 #include <condition_variable>
 #include <deque>
 #include <functional>
@@ -89,6 +91,91 @@ private:
   // variables for multi-threaded pre-fetching
   mutable UPtr<ThreadPool> threadPool_; // (we only use one thread, but keep it around)
   std::future<std::deque<BatchPtr>> futureBufferedBatches_; // next swath of batches is returned via this
+  UPtr<ThreadPool> batchThreadPool_; // builds batches in parallel with --data-threads
+
+  // source tokens with and without padding of all created batches, for reporting the padding ratio
+  size_t paddedSourceTokens_{0};
+  size_t sourceTokens_{0};
+
+  void countPadding(const Samples& batchVector) {
+    size_t maxLength = 0;
+    for(const auto& sample : batchVector) {
+      sourceTokens_ += sample[0].size();
+      maxLength = std::max(maxLength, sample[0].size());
+    }
+    paddedSourceTokens_ += maxLength * batchVector.size();
+  }
+
+  static double paddingRatio(size_t paddedTokens, size_t tokens) {
+    return paddedTokens > 0 ? 1.0 - (double)tokens / (double)paddedTokens : 0.0;
+  }
+
+  // Builds the batches from their samples, in parallel with --data-threads. The order is kept.
+  std::deque<BatchPtr> toBatches(const std::vector<Samples>& batchVectors) {
+    std::deque<BatchPtr> batches;
+    if(!batchThreadPool_ || batchVectors.size() < 2) {
+      for(const auto& batchVector : batchVectors)
+        batches.push_back(data_->toBatch(batchVector));
+      return batches;
+    }
+
+    std::vector<std::future<BatchPtr>> futures;
+    futures.reserve(batchVectors.size());
+    for(const auto& batchVector : batchVectors)
+      futures.push_back(batchThreadPool_->enqueue([this, &batchVector]() {
+        return data_->toBatch(batchVector);
+      }));
+    for(auto& future : futures)
+      batches.push_back(future.get());
+    return batches;
+  }
+
+  // Length-bucketed batching for decoding with --length-buckets: groups the samples of a maxi-batch
+  // into buckets of source lengths [0, width), [width, 2*width), ... and cuts each bucket into batches
+  // of at most --mini-batch sentences. With --mini-batch-tokens, a batch is also cut before its
+  // estimated decoding cost, i.e. sentences times beam size times the maximum output length (longest
+  // source length times --max-length-factor), exceeds the budget. Batches never span buckets, which
+  // bounds the padding to width-1 tokens per sentence.
+  std::vector<Samples> makeBucketedBatches(Samples& samples, size_t bucketWidth) {
+    auto bucket = [bucketWidth](const Sample& sample) { return sample[0].size() / bucketWidth; };
+    std::stable_sort(samples.begin(), samples.end(), [&](const Sample& a, const Sample& b) {
+      return bucket(a) < bucket(b);
+    });
+
+    const size_t maxBatchSize = options_->get<int>("mini-batch");
+    const size_t maxTokens    = options_->get<size_t>("mini-batch-tokens", 0);
+    const size_t beamSize     = options_->get<size_t>("beam-size", 1);
+    const float lengthFactor  = options_->get<float>("max-length-factor", 1.f);
+    auto outputLength = [lengthFactor](size_t srcLength) { return (size_t)std::ceil(srcLength * lengthFactor); };
+
+    std::vector<Samples> batchVectors;
+    Samples batchVector;
+    size_t maxLength = 0; // longest source sentence in current batch
+    for(auto& sample : samples) {
+      if (saveAndExitRequested()) // stop generating batches
+        return std::vector<Samples>();
+
+      size_t length = std::max(maxLength, sample[0].size());
+      bool makeBatch = !batchVector.empty()
+                       && (bucket(sample) != bucket(batchVector.back())
+                           || batchVector.size() >= maxBatchSize
+                           || (maxTokens > 0 && (batchVector.size() + 1) * beamSize * outputLength(length) > maxTokens));
+      if(makeBatch) {
+        countPadding(batchVector);
+        batchVectors.push_back(std::move(batchVector));
+        batchVector.clear();
+        length = sample[0].size();
+      }
+      batchVector.push_back(sample);
+      maxLength = length;
+    }
+
+    if(!batchVector.empty()) {
+      countPadding(batchVector);
+      batchVectors.push_back(std::move(batchVector));
+    }
+    return batchVectors;
+  }
 
   // this runs on a bg thread; sequencing is handled by caller, but locking is done in here
   std::deque<BatchPtr> fetchBatches() {
@@ -148,13 +235,27 @@ private:
         ++current_; // this actually reads the next line and pre-processes it
     }
     size_t numSentencesRead = maxiBatch->size();
+    size_t prevPaddedSourceTokens = paddedSourceTokens_;
+    size_t prevSourceTokens = sourceTokens_;
 
     // construct the actual batches and place them in the queue
     Samples batchVector;
     size_t currentWords = 0;
     std::vector<size_t> lengths(sets, 0); // records maximum length observed within current batch
 
-    std::deque<BatchPtr> tempBatches;
+    std::vector<Samples> batchVectors; // samples of the batches to be built
+
+    // length-bucketed batching consumes the whole maxi-batch, the loop below has nothing left to do
+    const size_t bucketWidth = options_->get<size_t>("length-buckets", 0);
+    if(bucketWidth > 0) {
+      Samples samples;
+      samples.reserve(maxiBatch->size());
+      while(!maxiBatch->empty()) {
+        samples.push_back(maxiBatch->top());
+        maxiBatch->pop();
+      }
+      batchVectors = makeBucketedBatches(samples, bucketWidth);
+    }
 
     // process all loaded sentences in order of increasing length
     // @TODO: we could just use a vector and do a sort() here; would make the cost more explicit
@@ -200,7 +301,8 @@ private:
 
       // if we reached the desired batch size then create a real batch
       if(makeBatch) {
-        tempBatches.push_back(data_->toBatch(batchVector));
+        countPadding(batchVector);
+        batchVectors.push_back(std::move(batchVector));
 
         // prepare for next batch
         batchVector.clear();
@@ -215,8 +317,12 @@ private:
     // @BUGBUG: This can create a very small batch, which with ce-mean-words can artificially
     // inflate the contribution of the sames in the batch, causing instability.
     // I think a good alternative would be to carry over the left-over sentences into the next round.
-    if(!batchVector.empty())
-      tempBatches.push_back(data_->toBatch(batchVector));
+    if(!batchVector.empty()) {
+      countPadding(batchVector);
+      batchVectors.push_back(std::move(batchVector));
+    }
+
+    auto tempBatches = toBatches(batchVectors);
 
     // Shuffle the batches
     if(shuffleBatches_) {
@@ -228,9 +334,10 @@ private:
       totalLabels += (double)b->words(-1);
     }
     auto totalDenom = tempBatches.empty() ? 1 : tempBatches.size(); // (make 0/0 = 0)
-    LOG(debug, "[data] fetched {} batches with {} sentences. Per batch: {} sentences, {} labels.",
+    LOG(debug, "[data] fetched {} batches with {} sentences. Per batch: {} sentences, {} labels. Source padding: {:.1f}%",
         tempBatches.size(), numSentencesRead,
-        (double)totalSent / (double)totalDenom, (double)totalLabels / (double)totalDenom);
+        (double)totalSent / (double)totalDenom, (double)totalLabels / (double)totalDenom,
+        100 * paddingRatio(paddedSourceTokens_ - prevPaddedSourceTokens, sourceTokens_ - prevSourceTokens));
     return tempBatches;
   }
 
@@ -284,11 +391,18 @@ public:
     auto shuffle = options_->get<std::string>("shuffle", "none");
     shuffleData_ = shuffle == "data";
     shuffleBatches_ = shuffleData_ || shuffle == "batches";
+
+    size_t dataThreads = options_->get<size_t>("data-threads", 1);
+    if(dataThreads > 1)
+      batchThreadPool_.reset(new ThreadPool(dataThreads));
   }
 
   ~BatchGenerator() {
     if (futureBufferedBatches_.valid()) // bg thread holds a reference to 'this',
       futureBufferedBatches_.get();     // so must wait for it to complete
+    if(options_->get<size_t>("length-buckets", 0) > 0 && paddedSourceTokens_ > 0)
+      LOG(info, "[data] Length-bucketed batching: {} source tokens, {:.1f}% padding",
+          sourceTokens_, 100 * paddingRatio(paddedSourceTokens_, sourceTokens_));
   }
 
   iterator begin() {
@@ -15,7 +15,9 @@ Corpus::Corpus(Ptr<Options> options, bool translate /*= false*/, size_t seed /*=
     : CorpusBase(options, translate, seed),
         shuffleInRAM_(options_->get<bool>("shuffle-in-ram", false)),
         allCapsEvery_(options_->get<size_t>("all-caps-every", 0)),
-        titleCaseEvery_(options_->get<size_t>("english-title-case-every", 0)) {}
+        titleCaseEvery_(options_->get<size_t>("english-title-case-every", 0)) {
+  init();
+}
 
 Corpus::Corpus(std::vector<std::string> paths,
                std::vector<Ptr<Vocab>> vocabs,
@@ -24,17 +26,35 @@ Corpus::Corpus(std::vector<std::string> paths,
     : CorpusBase(paths, vocabs, options, seed),
         shuffleInRAM_(options_->get<bool>("shuffle-in-ram", false)),
         allCapsEvery_(options_->get<size_t>("all-caps-every", 0)),
-        titleCaseEvery_(options_->get<size_t>("english-title-case-every", 0)) {}
+        titleCaseEvery_(options_->get<size_t>("english-title-case-every", 0)) {
+  init();
+}
 
-void Corpus::preprocessLine(std::string& line, size_t streamId) {
-  if (allCapsEvery_ != 0 && pos_ % allCapsEvery_ == 0 && !inference_) {
+void Corpus::init() {
+  dataThreads_ = options_->get<size_t>("data-threads", 1);
+  if(dataThreads_ > 1) {
+    // reading ahead would block line-by-line translation from a pipe
+    if(std::any_of(paths_.begin(), paths_.end(), [](const std::string& path) {
+         return path == "stdin" || path == "-" || filesystem::is_fifo(path);
+       })) {
+      LOG(info, "[data] Reading from a pipe, ignoring --data-threads {}", dataThreads_);
+      dataThreads_ = 1;
+    } else {
+      LOG(info, "[data] Pre-processing and encoding input with {} threads", dataThreads_);
+      dataThreadPool_.reset(new ThreadPool(dataThreads_));
+    }
+  }
+}
+
+void Corpus::preprocessLine(std::string& line, size_t streamId, size_t pos) const {
+  if (allCapsEvery_ != 0 && pos % allCapsEvery_ == 0 && !inference_) {
     line = vocabs_[streamId]->toUpper(line);
     if (streamId == 0)
       LOG_ONCE(info, "[data] Source all-caps'ed line to: {}", line);
     else
       LOG_ONCE(info, "[data] Target all-caps'ed line to: {}", line);
   }
-  else if (titleCaseEvery_ != 0 && pos_ % titleCaseEvery_ == 1 && !inference_ && streamId == 0) {
+  else if (titleCaseEvery_ != 0 && pos % titleCaseEvery_ == 1 && !inference_ && streamId == 0) {
     // Only applied to stream 0 (source) since this feature is aimed at robustness against
     // title case in the source (and not at translating into title case).
     // Note: It is user's responsibility to not enable this if the source language is not English.
@@ -46,7 +66,40 @@ void Corpus::preprocessLine(std::string& line, size_t streamId) {
   }
 }
 
-SentenceTuple Corpus::next() {
+bool Corpus::readLines(RawSentenceTuple& raw) {
+  // get index of the current sentence
+  raw.id = pos_; // note: at end, pos_  == total size
+  // if corpus has been shuffled, ids_ contains sentence indexes
+  if(pos_ < ids_.size())
+    raw.id = ids_[pos_];
+  pos_++;
+  raw.pos = pos_;
+
+  // fetch lines from all input files, from cached copy in RAM or actual file
+  size_t eofsHit = 0;
+  size_t numStreams = corpusInRAM_.empty() ? files_.size() : corpusInRAM_.size();
+  raw.lines.resize(numStreams);
+  for(size_t i = 0; i < numStreams; ++i) {
+    if (!corpusInRAM_.empty()) {
+      if (raw.id < corpusInRAM_[i].size())
+        raw.lines[i] = corpusInRAM_[i][raw.id];
+      else
+        eofsHit++;
+    }
+    else {
+      bool gotLine = io::getline(*files_[i], raw.lines[i]).good();
+      if(!gotLine)
+        eofsHit++;
+    }
+  }
+
+  if (eofsHit == numStreams)
+    return false;
+  ABORT_IF(eofsHit != 0, "not all input files have the same number of lines");
+  return true;
+}
+
+SentenceTuple Corpus::encodeLines(RawSentenceTuple& raw) const {
   // Used for handling TSV inputs
   // Determine the total number of fields including alignments or weights
   auto tsvNumAllFields = tsvNumInputFields_;
@@ -56,91 +109,127 @@ SentenceTuple Corpus::next() {
     ++tsvNumAllFields;
   std::vector<std::string> fields(tsvNumAllFields);
 
-  for(;;) { // (this is a retry loop for skipping invalid sentences)
-    // get index of the current sentence
-    size_t curId = pos_; // note: at end, pos_  == total size
-    // if corpus has been shuffled, ids_ contains sentence indexes
-    if(pos_ < ids_.size())
-      curId = ids_[pos_];
-    pos_++;
-
-    // fill up the sentence tuple with sentences from all input files
-    SentenceTuple tup(curId);
-    size_t eofsHit = 0;
-    size_t numStreams = corpusInRAM_.empty() ? files_.size() : corpusInRAM_.size();
-    for(size_t i = 0; i < numStreams; ++i) {
-      std::string line;
-
-      // fetch line, from cached copy in RAM or actual file
-      if (!corpusInRAM_.empty()) {
-        if (curId < corpusInRAM_[i].size())
-          line = corpusInRAM_[i][curId];
-        else {
-          eofsHit++;
-          continue;
-        }
-      }
-      else {
-        bool gotLine = io::getline(*files_[i], line).good();
-        if(!gotLine) {
-          eofsHit++;
-          continue;
-        }
-      }
-
-      if(i > 0 && i == alignFileIdx_) {
-        addAlignmentToSentenceTuple(line, tup);
-      } else if(i > 0 && i == weightFileIdx_) {
-        addWeightsToSentenceTuple(line, tup);
-      } else {
-        if(tsv_) {  // split TSV input and add each field into the sentence tuple
-          utils::splitTsv(line, fields, tsvNumAllFields);
-          size_t shift = 0;
-          for(size_t j = 0; j < tsvNumAllFields; ++j) {
-            // index j needs to be shifted to get the proper vocab index if guided-alignment or
-            // data-weighting are preceding source or target sequences in TSV input
-            if(j == alignFileIdx_ || j == weightFileIdx_) {
-              ++shift;
-            } else {
-              size_t vocabId = j - shift;
-              preprocessLine(fields[j], vocabId);
-              addWordsToSentenceTuple(fields[j], vocabId, tup);
-            }
+  // fill up the sentence tuple with sentences from all input files
+  SentenceTuple tup(raw.id);
+  for(size_t i = 0; i < raw.lines.size(); ++i) {
+    std::string& line = raw.lines[i];
+    if(i > 0 && i == alignFileIdx_) {
+      addAlignmentToSentenceTuple(line, tup);
+    } else if(i > 0 && i == weightFileIdx_) {
+      addWeightsToSentenceTuple(line, tup);
+    } else {
+      if(tsv_) {  // split TSV input and add each field into the sentence tuple
+        utils::splitTsv(line, fields, tsvNumAllFields);
+        size_t shift = 0;
+        for(size_t j = 0; j < tsvNumAllFields; ++j) {
+          // index j needs to be shifted to get the proper vocab index if guided-alignment or
+          // data-weighting are preceding source or target sequences in TSV input
+          if(j == alignFileIdx_ || j == weightFileIdx_) {
+            ++shift;
+          } else {
+            size_t vocabId = j - shift;
+            preprocessLine(fields[j], vocabId, raw.pos);
+            addWordsToSentenceTuple(fields[j], vocabId, tup);
           }
+        }
 
-          // weights are added last to the sentence tuple, because this runs a validation that needs
-          // length of the target sequence
-          if(alignFileIdx_ > -1)
-            addAlignmentToSentenceTuple(fields[alignFileIdx_], tup);
-          if(weightFileIdx_ > -1)
-            addWeightsToSentenceTuple(fields[weightFileIdx_], tup);
+        // weights are added last to the sentence tuple, because this runs a validation that needs
+        // length of the target sequence
+        if(alignFileIdx_ > -1)
+          addAlignmentToSentenceTuple(fields[alignFileIdx_], tup);
+        if(weightFileIdx_ > -1)
+          addWeightsToSentenceTuple(fields[weightFileIdx_], tup);
 
-        } else {
-          preprocessLine(line, i);
-          addWordsToSentenceTuple(line, i, tup);
-        }
+      } else {
+        preprocessLine(line, i, raw.pos);
+        addWordsToSentenceTuple(line, i, tup);
       }
     }
+  }
+  return tup;
+}
+
+bool Corpus::isValid(const SentenceTuple& tup) const {
+  // all streams must be non-empty and no longer than maximum allowed length
+  return std::all_of(tup.begin(), tup.end(), [=](const Words& words) {
+    return words.size() > 0 && words.size() <= maxLength_;
+  });
+}
+
+SentenceTuple Corpus::next() {
+  if(dataThreadPool_)
+    return nextParallel();
 
-    if (eofsHit == numStreams)
+  RawSentenceTuple raw;
+  for(;;) { // (this is a retry loop for skipping invalid sentences)
+    if(!readLines(raw))
       return SentenceTuple(0);
-    ABORT_IF(eofsHit != 0, "not all input files have the same number of lines");
 
-    // check if all streams are valid, that is, non-empty and no longer than maximum allowed length
-    if(std::all_of(tup.begin(), tup.end(), [=](const Words& words) {
-         return words.size() > 0 && words.size() <= maxLength_;
-       }))
+    auto tup = encodeLines(raw);
+    if(isValid(tup))
       return tup;
 
     // otherwise skip this sentence and try the next one
-    // @TODO: tail recursion?
   }
 }
 
+// Reads chunks of lines on the calling thread and encodes them on the pool. Up to two chunks per
+// thread are in flight, they are consumed in reading order, so the order of sentences is the same
+// as with a single thread.
+SentenceTuple Corpus::nextParallel() {
+  const size_t chunkSize = 64;
+  for(;;) {
+    while(readyPos_ < readyChunk_.size()) {
+      auto& tup = readyChunk_[readyPos_++];
+      if(isValid(tup))
+        return std::move(tup);
+    }
+
+    while(!endOfInput_ && pendingChunks_.size() < 2 * dataThreads_) {
+      auto chunk = New<std::vector<RawSentenceTuple>>();
+      chunk->reserve(chunkSize);
+      RawSentenceTuple raw;
+      while(chunk->size() < chunkSize) {
+        if(!readLines(raw)) {
+          endOfInput_ = true;
+          break;
+        }
+        chunk->push_back(std::move(raw));
+      }
+      if(chunk->empty())
+        break;
+      pendingChunks_.push_back(dataThreadPool_->enqueue([this, chunk]() {
+        std::vector<SentenceTuple> tuples;
+        tuples.reserve(chunk->size());
+        for(auto& raw : *chunk)
+          tuples.push_back(encodeLines(raw));
+        return tuples;
+      }));
+    }
+
+    if(pendingChunks_.empty())
+      return SentenceTuple(0);
+
+    readyChunk_ = pendingChunks_.front().get();
+    pendingChunks_.pop_front();
+    readyPos_ = 0;
+  }
+}
+
+void Corpus::discardPending() {
+  for(auto& chunk : pendingChunks_)
+    chunk.wait();
+  pendingChunks_.clear();
+  readyChunk_.clear();
+  readyPos_ = 0;
+  endOfInput_ = false;
+}
+
 // reset and initialize shuffled reading
 // Call either reset() or shuffle().
 // @TODO: merge with reset() below to clarify mutual exclusiveness with reset()
 void Corpus::shuffle() {
+  discardPending();
   shuffleData(paths_);
 }
 
@@ -149,6 +238,7 @@ void Corpus::shuffle() {
 // @TODO: make shuffle() private, instad pass a shuffle() flag to reset(), to clarify mutual
 // exclusiveness with shuffle()
 void Corpus::reset() {
+  discardPending();
   corpusInRAM_.clear();
   ids_.clear();
   if (pos_ == 0) // no data read yet
@@ -1,9 +1,12 @@
 #pragma once
 
+#include <deque>
 #include <fstream>
+#include <future>
 #include <iostream>
 #include <random>
 
+#include "3rd_party/threadpool.h"
 #include "common/definitions.h"
 #include "common/file_stream.h"
 #include "common/options.h"
@@ -30,7 +33,31 @@ private:
   // for pre-processing
   size_t allCapsEvery_{0};   // if set, convert every N-th input sentence (after randomization) to all-caps (source and target)
   size_t titleCaseEvery_{0}; // ditto for title case (source only)
-  void preprocessLine(std::string& line, size_t streamId);
+  void preprocessLine(std::string& line, size_t streamId, size_t pos) const;
+
+  // lines of all streams of one sentence tuple as read from the input
+  struct RawSentenceTuple {
+    size_t id;
+    size_t pos; // reading position, for pre-processing
+    std::vector<std::string> lines;
+  };
+
+  bool readLines(RawSentenceTuple& raw); // false at the end of the input
+  SentenceTuple encodeLines(RawSentenceTuple& raw) const;
+  bool isValid(const SentenceTuple& tup) const;
+
+  // for parallel pre-processing and encoding with --data-threads
+  size_t dataThreads_{1};
+  std::deque<std::future<std::vector<SentenceTuple>>> pendingChunks_; // in reading order
+  std::vector<SentenceTuple> readyChunk_;
+  size_t readyPos_{0};
+  bool endOfInput_{false};
+
+  void init();
+  SentenceTuple nextParallel();
+  void discardPending();
+
+  UPtr<ThreadPool> dataThreadPool_; // declared last, so it waits for pending chunks before anything else is destroyed
 
 public:
   // @TODO: check if translate can be replaced by an option in options
@@ -0,0 +1,245 @@
+#include "data/corpus_binary.h"
+
+#include "common/file_stream.h"
+#include "common/filesystem.h"
+
+#include <algorithm>
+#include <fstream>
+#include <numeric>
+
+namespace marian {
+namespace data {
+
+// cast current void pointer to T pointer and move forward by num elements
+template <typename T>
+static const T* get(const void*& current, size_t num = 1) {
+  const T* ptr = (const T*)current;
+  current = (const T*)current + num;
+  return ptr;
+}
+
+CorpusBinary::CorpusBinary(Ptr<Options> options, size_t seed /*= Config:seed*/)
+    : CorpusBase(options, /*translate=*/false, seed) {
+  ABORT_IF(tsv_, "Binary corpora cannot be created from TSV input");
+  ABORT_IF(alignFileIdx_ >= 0 || weightFileIdx_ >= 0,
+           "Guided alignment and data weighting are not supported with a binary corpus");
+  if(options_->hasAndNotEmpty("sentencepiece-alphas"))
+    LOG(warn, "[data] Binary corpus is encoded once, SentencePiece sampling is not applied");
+
+  auto path = options_->get<std::string>("binary-corpus");
+  if(filesystem::exists(path)) {
+    LOG(info, "[data] Reusing binary corpus {}", path);
+  } else {
+    LOG(info, "[data] Creating binary corpus {}", path);
+    convert(paths_, vocabs_, path);
+  }
+  map(path);
+
+  files_.clear(); // the text files are not read anymore
+}
+
+void CorpusBinary::map(const std::string& fname) {
+  ABORT_IF(!isBinaryCorpus(fname),
+           "File {} is not a binary corpus or its creation did not finish", fname);
+
+  mmap_ = mio::mmap_source(fname); // memory-map the binary file once
+  const void* current = mmap_.data(); // pointer iterator over binary file
+
+  const Header* header = get<Header>(current);
+  ABORT_IF(header->version != BINARY_CORPUS_VERSION,
+           "Binary corpus {} has version {}, expected version {}",
+           fname, header->version, BINARY_CORPUS_VERSION);
+  ABORT_IF(header->numStreams != vocabs_.size(),
+           "Binary corpus {} has {} streams, but {} vocabularies are given",
+           fname, header->numStreams, vocabs_.size());
+
+  numStreams_   = header->numStreams;
+  numSentences_ = header->numSentences;
+  uint64_t numWords = header->numWords;
+
+  size_t expectedSize = sizeof(Header)
+                        + numStreams_ * sizeof(uint64_t)
+                        + (numWords + numWords % 2) * sizeof(WordIndex)
+                        + (numSentences_ * numStreams_ + 1) * sizeof(uint64_t);
+  ABORT_IF(mmap_.size() != expectedSize,
+           "Binary corpus {} has {} bytes, but its header requires {} bytes",
+           fname, mmap_.size(), expectedSize);
+
+  const uint64_t* vocabSizes = get<uint64_t>(current, numStreams_);
+  for(size_t j = 0; j < numStreams_; ++j)
+    ABORT_IF(vocabSizes[j] != vocabs_[j]->size(),
+             "Binary corpus {} has been encoded with a vocabulary of size {} for stream {}, "
+             "but the given vocabulary has size {}",
+             fname, vocabSizes[j], j, vocabs_[j]->size());
+
+  words_   = get<WordIndex>(current, numWords + numWords % 2);
+  offsets_ = get<uint64_t>(current, numSentences_ * numStreams_ + 1);
+
+  LOG(info, "[data] Mapped binary corpus with {} sentences and {} words", numSentences_, numWords);
+}
+
+SentenceTuple CorpusBinary::next() {
+  for(;;) { // (this is a retry loop for skipping invalid sentences)
+    if(pos_ >= numSentences_)
+      return SentenceTuple(0);
+
+    size_t id = order_.empty() ? pos_ : order_[pos_];
+    pos_++;
+
+    SentenceTuple tup(id);
+    for(size_t j = 0; j < numStreams_; ++j) {
+      const uint64_t* range = offsets_ + id * numStreams_ + j;
+      Words words;
+      words.reserve(range[1] - range[0] + 1);
+      for(uint64_t i = range[0]; i < range[1]; ++i)
+        words.push_back(Word::fromWordIndex(words_[i]));
+      if(addEOS_[j])
+        words.push_back(vocabs_[j]->getEosId());
+
+      if(maxLengthCrop_ && words.size() > maxLength_) {
+        words.resize(maxLength_);
+        if(addEOS_[j])
+          words.back() = vocabs_[j]->getEosId();
+      }
+
+      // all streams must be non-empty and no longer than maximum allowed length
+      if(words.empty() || words.size() > maxLength_)
+        break;
+
+      if(rightLeft_)
+        std::reverse(words.begin(), words.end() - 1);
+
+      tup.push_back(words);
+    }
+
+    if(tup.size() == numStreams_)
+      return tup;
+  }
+}
+
+void CorpusBinary::shuffle() {
+  LOG(info, "[data] Shuffling binary corpus index");
+  order_.resize(numSentences_);
+  std::iota(order_.begin(), order_.end(), 0);
+  std::shuffle(order_.begin(), order_.end(), eng_);
+  pos_ = 0;
+}
+
+void CorpusBinary::reset() {
+  order_.clear();
+  pos_ = 0;
+}
+
+void CorpusBinary::restore(Ptr<TrainingState> ts) {
+  setRNGState(ts->seedCorpus);
+}
+
+CorpusBinary::batch_ptr CorpusBinary::toBatch(const std::vector<Sample>& batchVector) {
+  size_t batchSize = batchVector.size();
+
+  std::vector<size_t> sentenceIds;
+
+  std::vector<int> maxDims;
+  for(auto& ex : batchVector) {
+    if(maxDims.size() < ex.size())
+      maxDims.resize(ex.size(), 0);
+    for(size_t i = 0; i < ex.size(); ++i) {
+      if(ex[i].size() > (size_t)maxDims[i])
+        maxDims[i] = (int)ex[i].size();
+    }
+    sentenceIds.push_back(ex.getId());
+  }
+
+  std::vector<Ptr<SubBatch>> subBatches;
+  for(size_t j = 0; j < maxDims.size(); ++j)
+    subBatches.emplace_back(New<SubBatch>(batchSize, maxDims[j], vocabs_[j]));
+
+  std::vector<size_t> words(maxDims.size(), 0);
+  for(size_t i = 0; i < batchSize; ++i) {
+    for(size_t j = 0; j < maxDims.size(); ++j) {
+      for(size_t k = 0; k < batchVector[i][j].size(); ++k) {
+        subBatches[j]->data()[k * batchSize + i] = batchVector[i][j][k];
+        subBatches[j]->mask()[k * batchSize + i] = 1.f;
+        words[j]++;
+      }
+    }
+  }
+
+  for(size_t j = 0; j < maxDims.size(); ++j)
+    subBatches[j]->setWords(words[j]);
+
+  auto batch = batch_ptr(new batch_type(subBatches));
+  batch->setSentenceIds(sentenceIds);
+  return batch;
+}
+
+void CorpusBinary::convert(const std::vector<std::string>& paths,
+                           const std::vector<Ptr<Vocab>>& vocabs,
+                           const std::string& fname) {
+  ABORT_IF(paths.size() != vocabs.size(), "Number of corpus files and vocab files does not agree");
+  size_t numStreams = paths.size();
+
+  std::vector<UPtr<io::InputFileStream>> files;
+  for(auto& path : paths)
+    files.emplace_back(new io::InputFileStream(path));
+
+  std::ofstream out(fname, std::ios::binary);
+  ABORT_IF(!out, "Error opening file '{}'", fname);
+
+  // the magic number is written last, so an interrupted conversion is not taken for a binary corpus
+  Header header{0, BINARY_CORPUS_VERSION, numStreams, 0, 0};
+  out.write((const char*)&header, sizeof(header));
+  for(auto vocab : vocabs) {
+    uint64_t vocabSize = vocab->size();
+    out.write((const char*)&vocabSize, sizeof(vocabSize));
+  }
+
+  std::vector<uint64_t> offsets = {0};
+  std::vector<WordIndex> ids;
+  std::vector<std::string> lines(numStreams);
+  for(;;) {
+    size_t ended = 0;
+    for(size_t j = 0; j < numStreams; ++j)
+      if(!io::getline(*files[j], lines[j]))
+        ended++;
+    if(ended == numStreams)
+      break;
+    ABORT_IF(ended > 0, "Files {} do not have the same number of lines", utils::join(paths, ", "));
+
+    for(size_t j = 0; j < numStreams; ++j) {
+      ids = toWordIndexVector(vocabs[j]->encode(lines[j], /*addEOS=*/false, /*inference=*/true));
+      out.write((const char*)ids.data(), ids.size() * sizeof(WordIndex));
+      header.numWords += ids.size();
+      offsets.push_back(header.numWords);
+    }
+    header.numSentences++;
+
+    if(header.numSentences % 1000000 == 0)
+      LOG(info, "[data] Encoded {} sentences", header.numSentences);
+  }
+
+  if(header.numWords % 2 == 1) { // align offsets to 8 bytes
+    WordIndex padding = 0;
+    out.write((const char*)&padding, sizeof(padding));
+  }
+  out.write((const char*)offsets.data(), offsets.size() * sizeof(uint64_t));
+
+  header.magic = BINARY_CORPUS_MAGIC;
+  out.seekp(0);
+  out.write((const char*)&header, sizeof(header));
+  out.close();
+  ABORT_IF(!out, "Error writing to file '{}'", fname);
+
+  LOG(info, "[data] Wrote binary corpus {} with {} sentences and {} words",
+      fname, header.numSentences, header.numWords);
+}
+
+bool CorpusBinary::isBinaryCorpus(const std::string& fname) {
+  std::ifstream in(fname, std::ios::binary);
+  uint64_t magic = 0;
+  in.read((char*)&magic, sizeof(magic));
+  return in && magic == BINARY_CORPUS_MAGIC;
+}
+
+}  // namespace data
+}  // namespace marian
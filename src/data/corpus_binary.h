@@ -0,0 +1,99 @@
+#pragma once
+
+#include <random>
+
+#include "common/definitions.h"
+#include "common/options.h"
+#include "data/batch.h"
+#include "data/corpus_base.h"
+#include "data/dataset.h"
+#include "data/vocab.h"
+
+#include "mio/mio.hpp"
+
+namespace marian {
+namespace data {
+
+/*
+Training corpus that is read from a pre-tokenized binary file instead of text. The file holds the
+word indices of all sentences of all streams, encoded once with the training vocabularies, and an
+index of offsets into them:
+
+  Header                                        magic number, format version and sizes
+  uint64_t vocabSizes[numStreams]               sizes of the vocabularies used for encoding
+  WordIndex words[numWords]                     word indices of all sentences, without EOS
+  (padding to a multiple of 8 bytes)
+  uint64_t offsets[numSentences * numStreams + 1]
+                                                words of stream j of sentence i are in
+                                                [offsets[i * numStreams + j], offsets[i * numStreams + j + 1])
+
+The file is memory-mapped, so reading does not tokenize or parse and access to any sentence is
+random. Shuffling permutes the sentence order only and does not copy or rewrite any data.
+
+With --binary-corpus the file is created from --train-sets on first use and reused afterwards,
+similar to --sqlite. It can also be created in advance with marian-conv --corpus.
+*/
+class CorpusBinary : public CorpusBase {
+public:
+  struct Header {
+    uint64_t magic;         // BINARY_CORPUS_MAGIC
+    uint64_t version;       // BINARY_CORPUS_VERSION
+    uint64_t numStreams;    // number of streams, e.g. 2 for source and target
+    uint64_t numSentences;  // number of sentence tuples
+    uint64_t numWords;      // total number of entries in words
+  };
+
+  static constexpr uint64_t BINARY_CORPUS_MAGIC = 0x43424e414952414dULL; // "MARIANBC" in little-endian byte order
+  static constexpr uint64_t BINARY_CORPUS_VERSION = 1;
+
+private:
+  mio::mmap_source mmap_;
+
+  uint64_t numStreams_{0};
+  uint64_t numSentences_{0};
+  const WordIndex* words_{nullptr};
+  const uint64_t* offsets_{nullptr};
+
+  std::vector<size_t> order_; // shuffled sentence order, reading in file order if empty
+
+  // Maps the binary file and checks its header and size against the vocabularies
+  void map(const std::string& fname);
+
+public:
+  // Opens --binary-corpus for training, creates it from --train-sets first if it does not exist
+  CorpusBinary(Ptr<Options> options, size_t seed = Config::seed);
+
+  /**
+   * @brief Iterates sentence tuples in the corpus.
+   *
+   * As in Corpus, a sentence tuple is skipped if any of its sentences is empty or longer than
+   * the maximum allowed sentence length, unless the option "max-length-crop" is provided.
+   */
+  Sample next() override;
+
+  void shuffle() override;
+
+  void reset() override;
+
+  void restore(Ptr<TrainingState>) override;
+
+  iterator begin() override { return iterator(this); }
+
+  iterator end() override { return iterator(); }
+
+  std::vector<Ptr<Vocab>>& getVocabs() override { return vocabs_; }
+
+  batch_ptr toBatch(const std::vector<Sample>& batchVector) override;
+
+  // Encodes the given parallel text files line by line with the given vocabularies and writes the
+  // result in binary format to fname
+  static void convert(const std::vector<std::string>& paths,
+                      const std::vector<Ptr<Vocab>>& vocabs,
+                      const std::string& fname);
+
+  // Checks if the given file starts with the magic number of a binary corpus
+  static bool isBinaryCorpus(const std::string& fname);
+};
+
+}  // namespace data
+}  // namespace marian
@@ -1,9 +1,59 @@
 #include "data/shortlist.h"
 #include "microsoft/shortlist/utils/ParameterTree.h"
 
+#include <fstream>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 namespace marian {
 namespace data {
 
+// index of the lowest set bit, bits must not be zero
+static inline unsigned countTrailingZeros(uint64_t bits) {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward64(&index, bits);
+  return (unsigned)index;
+#else
+  return (unsigned)__builtin_ctzll(bits);
+#endif
+}
+
+void ShortlistMerger::reset(size_t trgVocabSize) {
+  if(bits_.size() * 64 < trgVocabSize)
+    bits_.resize((trgVocabSize + 63) / 64, 0);
+  count_ = 0;
+  if(++epoch_ == 0) { // stamps wrapped around, start from scratch
+    std::fill(srcEpoch_.begin(), srcEpoch_.end(), 0);
+    epoch_ = 1;
+  }
+}
+
+std::vector<WordIndex> ShortlistMerger::sortedIndices(WordIndex padStart) {
+  for(WordIndex i = padStart; count_ % 8 != 0; ++i)
+    insert(i);
+
+  std::vector<WordIndex> indices;
+  indices.reserve(count_);
+  for(size_t word = 0; word < bits_.size(); ++word) {
+    uint64_t bits = bits_[word];
+    bits_[word] = 0;
+    while(bits) { // emit set bits from lowest to highest
+      indices.push_back(static_cast<WordIndex>(word * 64 + countTrailingZeros(bits)));
+      bits &= bits - 1; // clear lowest set bit
+    }
+  }
+  count_ = 0;
+  return indices;
+}
+
+ShortlistMerger& ShortlistMerger::perThread() {
+  static thread_local ShortlistMerger merger;
+  return merger;
+}
+
 // cast current void pointer to T pointer and move forward by num elements 
 template <typename T>
 const T* get(const void*& current, size_t num = 1) {
@@ -133,6 +183,197 @@ Ptr<Shortlist> QuicksandShortlistGenerator::generate(Ptr<data::CorpusBatch> batc
   return New<Shortlist>(indices);
 }
 
+constexpr uint64_t BinaryShortlistGenerator::BINARY_SHORTLIST_MAGIC;
+constexpr uint64_t BinaryShortlistGenerator::BINARY_SHORTLIST_VERSION;
+
+BinaryShortlistGenerator::BinaryShortlistGenerator(Ptr<Options> options,
+                                                   Ptr<const Vocab> srcVocab,
+                                                   Ptr<const Vocab> trgVocab,
+                                                   size_t srcIdx,
+                                                   size_t trgIdx,
+                                                   bool shared)
+    : options_(options),
+      srcVocab_(srcVocab),
+      trgVocab_(trgVocab),
+      srcIdx_(srcIdx),
+      shared_(shared) {
+  std::vector<std::string> vals = options_->get<std::vector<std::string>>("shortlist");
+
+  ABORT_IF(vals.empty(), "No path to filter path given");
+  std::string fname = vals[0];
+
+  if(isBinaryShortlist(fname)) {
+    map(fname);
+    // pruning happened during conversion, only the number of most frequent words can be changed
+    if(vals.size() > 1)
+      firstNum_ = std::stoi(vals[1]);
+    if(vals.size() > 2 && std::stoul(vals[2]) != bestNum_)
+      LOG(warn, "Binary shortlist has been pruned to {} best candidates, ignoring value {}", bestNum_, vals[2]);
+    if(vals.size() > 3)
+      LOG(warn, "Binary shortlist has been pruned during conversion, ignoring threshold {}", vals[3]);
+  } else {
+    LexicalShortlistGenerator lexical(options, srcVocab, trgVocab, srcIdx, trgIdx, shared);
+    import(lexical);
+  }
+}
+
+void BinaryShortlistGenerator::map(const std::string& fname) {
+  mmap_ = mio::mmap_source(fname); // memory-map the binary file once
+  ABORT_IF(mmap_.size() < sizeof(Header), "Binary shortlist {} is truncated", fname);
+  const void* current = mmap_.data(); // pointer iterator over binary file
+
+  const Header* header = get<Header>(current);
+  ABORT_IF(header->magic != BINARY_SHORTLIST_MAGIC,
+           "Trying to mmap binary shortlist {} but encountered wrong magic number", fname);
+  ABORT_IF(header->version != BINARY_SHORTLIST_VERSION,
+           "Binary shortlist {} has version {}, expected version {}",
+           fname, header->version, BINARY_SHORTLIST_VERSION);
+
+  firstNum_     = header->firstNum;
+  bestNum_      = header->bestNum;
+  numSourceIds_ = header->numSourceIds;
+  numTargetIds_ = header->numTargetIds;
+
+  size_t expectedSize = sizeof(Header)
+                        + (numSourceIds_ + 1) * sizeof(uint64_t)
+                        + numTargetIds_ * sizeof(WordIndex);
+  ABORT_IF(mmap_.size() != expectedSize,
+           "Binary shortlist {} has {} bytes, but its header requires {} bytes",
+           fname, mmap_.size(), expectedSize);
+
+  offsets_ = get<uint64_t>(current, numSourceIds_ + 1);
+  targets_ = get<WordIndex>(current, numTargetIds_);
+  ABORT_IF(offsets_[numSourceIds_] != numTargetIds_, "Binary shortlist {} has inconsistent offsets", fname);
+
+  LOG(info,
+      "[data] Mapped binary shortlist from {} with {} source ids and {} target ids, pruned to {} best, {} first",
+      fname, numSourceIds_, numTargetIds_, bestNum_, firstNum_);
+}
+
+void BinaryShortlistGenerator::import(const LexicalShortlistGenerator& lexical) {
+  firstNum_ = lexical.getFirstNum();
+  bestNum_  = lexical.getBestNum();
+
+  const auto& probs = lexical.getProbs();
+  ownedOffsets_.reserve(probs.size() + 1);
+  ownedOffsets_.push_back(0);
+  for(const auto& candidates : probs) {
+    size_t start = ownedTargets_.size();
+    for(const auto& it : candidates)
+      ownedTargets_.push_back(it.first);
+    std::sort(ownedTargets_.begin() + start, ownedTargets_.end());
+    ownedOffsets_.push_back(ownedTargets_.size());
+  }
+
+  numSourceIds_ = probs.size();
+  numTargetIds_ = ownedTargets_.size();
+  offsets_ = ownedOffsets_.data();
+  targets_ = ownedTargets_.data();
+}
+
+void BinaryShortlistGenerator::dump(const std::string& fname) const {
+  LOG(info, "[data] Saving binary shortlist to {}", fname);
+  // a plain stream, since the file is memory-mapped and must not be compressed even if its name ends in .gz
+  std::ofstream out(fname, std::ios::binary);
+  ABORT_IF(!out, "Could not open binary shortlist {} for writing", fname);
+
+  Header header{BINARY_SHORTLIST_MAGIC,
+                BINARY_SHORTLIST_VERSION,
+                firstNum_,
+                bestNum_,
+                numSourceIds_,
+                numTargetIds_};
+  out.write((const char*)&header, sizeof(header));
+  out.write((const char*)offsets_, (numSourceIds_ + 1) * sizeof(*offsets_));
+  out.write((const char*)targets_, numTargetIds_ * sizeof(*targets_));
+  ABORT_IF(!out, "Could not write binary shortlist {}", fname);
+}
+
+Ptr<Shortlist> BinaryShortlistGenerator::generate(Ptr<data::CorpusBatch> batch) const {
+  auto srcBatch = (*batch)[srcIdx_];
+  auto& merger = ShortlistMerger::perThread();
+  merger.reset(trgVocab_->size());
+
+  // add firstNum most frequent words
+  for(WordIndex i = 0; i < firstNum_ && i < trgVocab_->size(); ++i)
+    merger.insert(i);
+
+  // add aligned target words for every unique source word
+  for(auto w : srcBatch->data()) {
+    auto i = w.toWordIndex();
+    if(!merger.firstOccurrence(i))
+      continue;
+    if(shared_)
+      merger.insert(i);
+    if(i < numSourceIds_)
+      merger.insert(targets_ + offsets_[i], targets_ + offsets_[i + 1]);
+  }
+
+  return New<Shortlist>(merger.sortedIndices(static_cast<WordIndex>(firstNum_)));
+}
+
+bool BinaryShortlistGenerator::isBinaryShortlist(const std::string& fname) {
+  std::ifstream in(fname, std::ios::binary);
+  uint64_t magic = 0;
+  in.read((char*)&magic, sizeof(magic));
+  return in && magic == BINARY_SHORTLIST_MAGIC;
+}
+
+CachedShortlistGenerator::CachedShortlistGenerator(Ptr<const ShortlistGenerator> generator,
+                                                   size_t srcIdx,
+                                                   size_t capacity)
+    : generator_(generator), srcIdx_(srcIdx), capacity_(capacity) {
+  ABORT_IF(capacity_ == 0, "Shortlist cache needs to hold at least one entry");
+  LOG(info, "[data] Caching up to {} shortlists", capacity_);
+}
+
+CachedShortlistGenerator::~CachedShortlistGenerator() {
+  LOG(info, "[data] Shortlist cache: {} hits, {} misses", hits_, misses_);
+}
+
+Ptr<Shortlist> CachedShortlistGenerator::generate(Ptr<data::CorpusBatch> batch) const {
+  Key key;
+  for(auto w : (*batch)[srcIdx_]->data())
+    key.push_back(w.toWordIndex());
+  std::sort(key.begin(), key.end());
+  key.erase(std::unique(key.begin(), key.end()), key.end());
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(key);
+    if(it != index_.end()) {
+      entries_.splice(entries_.begin(), entries_, it->second); // mark as most recently used
+      hits_++;
+      return it->second->second;
+    }
+    misses_++;
+  }
+
+  // generate outside of the lock, so that other threads are not blocked by a miss
+  auto shortlist = generator_->generate(batch);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if(index_.find(key) == index_.end()) { // another thread may have added the same key meanwhile
+    entries_.emplace_front(key, shortlist);
+    index_.emplace(std::move(key), entries_.begin());
+    if(entries_.size() > capacity_) { // evict least recently used entry
+      index_.erase(entries_.back().first);
+      entries_.pop_back();
+    }
+  }
+  return shortlist;
+}
+
+size_t CachedShortlistGenerator::hits() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return hits_;
+}
+
+size_t CachedShortlistGenerator::misses() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return misses_;
+}
+
 Ptr<ShortlistGenerator> createShortlistGenerator(Ptr<Options> options,
                                                  Ptr<const Vocab> srcVocab,
                                                  Ptr<const Vocab> trgVocab,
@@ -142,11 +383,20 @@ Ptr<ShortlistGenerator> createShortlistGenerator(Ptr<Options> options,
   std::vector<std::string> vals = options->get<std::vector<std::string>>("shortlist");
   ABORT_IF(vals.empty(), "No path to shortlist given");
   std::string fname = vals[0];
-  if(filesystem::Path(fname).extension().string() == ".bin") {
-    return New<QuicksandShortlistGenerator>(options, srcVocab, trgVocab, srcIdx, trgIdx, shared);
+
+  Ptr<ShortlistGenerator> generator;
+  if(BinaryShortlistGenerator::isBinaryShortlist(fname)) {
+    generator = New<BinaryShortlistGenerator>(options, srcVocab, trgVocab, srcIdx, trgIdx, shared);
+  } else if(filesystem::Path(fname).extension().string() == ".bin") {
+    generator = New<QuicksandShortlistGenerator>(options, srcVocab, trgVocab, srcIdx, trgIdx, shared);
   } else {
-    return New<LexicalShortlistGenerator>(options, srcVocab, trgVocab, srcIdx, trgIdx, shared);
+    generator = New<LexicalShortlistGenerator>(options, srcVocab, trgVocab, srcIdx, trgIdx, shared);
   }
+
+  size_t cacheSize = options->get<size_t>("shortlist-cache-size", 0);
+  if(cacheSize > 0)
+    generator = New<CachedShortlistGenerator>(generator, srcIdx, cacheSize);
+  return generator;
 }
 
 }  // namespace data
@@ -3,6 +3,7 @@
 #include "common/config.h"
 #include "common/definitions.h"
 #include "common/file_stream.h"
+#include "common/hash.h"
 #include "data/corpus_base.h"
 #include "data/types.h"
 #include "mio/mio.hpp"
@@ -14,6 +15,8 @@
 #include <iostream>
 #include <algorithm>
 #include <limits>
+#include <list>
+#include <mutex>
 
 namespace marian {
 namespace data {
@@ -41,6 +44,58 @@ public:
 
 };
 
+// Reusable workspace for merging the shortlist candidates of all source words in a batch. Target ids
+// are collected in a dense bitset over the target vocabulary, so the union needs no hashing and the
+// sorted result is emitted in a single linear pass, which also clears the bitset for the next batch.
+// Unique source words are detected with an epoch-stamped array that never needs to be cleared.
+// Generators are shared between threads, hence every thread uses its own instance via perThread().
+class ShortlistMerger {
+private:
+  std::vector<uint64_t> bits_;     // [target word index / 64] -> bitset of selected target words
+  std::vector<uint32_t> srcEpoch_; // [source word index] -> epoch in which the source word was last seen
+  uint32_t epoch_{0};              // current epoch, incremented for every batch
+  size_t count_{0};                // number of selected target words
+
+public:
+  // Starts a new batch; the bitset is sized for trgVocabSize target words
+  void reset(size_t trgVocabSize);
+
+  // Returns true if the source word has not been seen since the last reset()
+  bool firstOccurrence(WordIndex srcId) {
+    if(srcId >= srcEpoch_.size())
+      srcEpoch_.resize(srcId + 1, 0);
+    if(srcEpoch_[srcId] == epoch_)
+      return false;
+    srcEpoch_[srcId] = epoch_;
+    return true;
+  }
+
+  void insert(WordIndex trgId) {
+    size_t word = trgId / 64;
+    if(word >= bits_.size())
+      bits_.resize(word + 1, 0);
+    uint64_t mask = uint64_t(1) << (trgId % 64);
+    count_ += (bits_[word] & mask) == 0;
+    bits_[word] |= mask;
+  }
+
+  template <class Iterator>
+  void insert(Iterator begin, Iterator end) {
+    for(auto it = begin; it != end; ++it)
+      insert(*it);
+  }
+
+  size_t size() const { return count_; }
+
+  // Pads the selection to a multiple of eight with the ids following padStart, which is necessary
+  // until intgemm supports non-multiple-of-eight matrices, then returns the sorted selection.
+  // Leaves the bitset cleared.
+  std::vector<WordIndex> sortedIndices(WordIndex padStart);
+
+  // Returns the workspace of the calling thread
+  static ShortlistMerger& perThread();
+};
+
 class ShortlistGenerator {
 public:
   virtual ~ShortlistGenerator() {}
@@ -240,44 +295,33 @@ public:
     }
   }
 
+  // Pruned translation candidates, [WordIndex src] -> [WordIndex tgt] -> P_trans(tgt|src)
+  const std::vector<std::unordered_map<WordIndex, float>>& getProbs() const { return data_; }
+  size_t getFirstNum() const { return firstNum_; }
+  size_t getBestNum() const { return bestNum_; }
+
   virtual Ptr<Shortlist> generate(Ptr<data::CorpusBatch> batch) const override {
     auto srcBatch = (*batch)[srcIdx_];
+    auto& merger = ShortlistMerger::perThread();
+    merger.reset(trgVocab_->size());
 
     // add firstNum most frequent words
-    std::unordered_set<WordIndex> indexSet;
     for(WordIndex i = 0; i < firstNum_ && i < trgVocab_->size(); ++i)
-      indexSet.insert(i);
-
-    // add all words from ground truth
-    // for(auto i : trgBatch->data())
-    //  indexSet.insert(i.toWordIndex());
+      merger.insert(i);
 
-    // collect unique words form source
-    std::unordered_set<WordIndex> srcSet;
-    for(auto i : srcBatch->data())
-      srcSet.insert(i.toWordIndex());
-
-    // add aligned target words
-    for(auto i : srcSet) {
+    // add aligned target words for every unique source word
+    for(auto w : srcBatch->data()) {
+      auto i = w.toWordIndex();
+      if(!merger.firstOccurrence(i))
+        continue;
       if(shared_)
-        indexSet.insert(i);
-      for(auto& it : data_[i])
-        indexSet.insert(it.first);
-    }
-    // Ensure that the generated vocabulary items from a shortlist are a multiple-of-eight
-    // This is necessary until intgemm supports non-multiple-of-eight matrices.
-    // TODO better solution here? This could potentially be slow.
-    WordIndex i = static_cast<WordIndex>(firstNum_);
-    while (indexSet.size() % 8 != 0) {
-      indexSet.insert(i);
-      i++;
+        merger.insert(i);
+      if(i < data_.size())
+        for(auto& it : data_[i])
+          merger.insert(it.first);
     }
 
-    // turn into vector and sort (selected indices)
-    std::vector<WordIndex> indices(indexSet.begin(), indexSet.end());
-    std::sort(indices.begin(), indices.end());
-
-    return New<Shortlist>(indices);
+    return New<Shortlist>(merger.sortedIndices(static_cast<WordIndex>(firstNum_)));
   }
 };
 
@@ -332,8 +376,121 @@ public:
 };
 
 /*
-Shortlist factory to create correct type of shortlist. Currently assumes everything is a text shortlist 
-unless the extension is *.bin for which the Microsoft legacy binary shortlist is used.
+Binary lexical shortlist that is memory-mapped at load time. The file is produced by marian-conv from a
+text lexical shortlist and contains the already pruned and sorted target candidates for every source
+word in CSR layout:
+
+  Header                                        magic number, format version and sizes
+  uint64_t offsets[numSourceIds + 1]            offsets into targets for every source word index
+  WordIndex targets[numTargetIds]               sorted target word indices, [offsets[i], offsets[i+1])
+                                                are the candidates for source word index i
+
+Loading only maps the file, so startup does not depend on the size of the lexical table and several
+processes share one copy in the page cache.
+*/
+class BinaryShortlistGenerator : public ShortlistGenerator {
+public:
+  struct Header {
+    uint64_t magic;         // BINARY_SHORTLIST_MAGIC
+    uint64_t version;       // BINARY_SHORTLIST_VERSION
+    uint64_t firstNum;      // number of most frequent target words that are always included
+    uint64_t bestNum;       // maximum number of candidates per source word used when pruning
+    uint64_t numSourceIds;  // number of source word indices covered by offsets
+    uint64_t numTargetIds;  // total number of entries in targets
+  };
+
+  static constexpr uint64_t BINARY_SHORTLIST_MAGIC = 0x4c534e414952414dULL; // "MARIANSL" in little-endian byte order
+  static constexpr uint64_t BINARY_SHORTLIST_VERSION = 1;
+
+private:
+  Ptr<Options> options_;
+  Ptr<const Vocab> srcVocab_;
+  Ptr<const Vocab> trgVocab_;
+
+  size_t srcIdx_;
+  bool shared_{false};
+
+  size_t firstNum_{100};
+  size_t bestNum_{100};
+
+  mio::mmap_source mmap_;
+
+  // either point into mmap_ or into the vectors below when converted from a text shortlist
+  uint64_t numSourceIds_{0};
+  uint64_t numTargetIds_{0};
+  const uint64_t* offsets_{nullptr};
+  const WordIndex* targets_{nullptr};
+
+  std::vector<uint64_t> ownedOffsets_;
+  std::vector<WordIndex> ownedTargets_;
+
+  // Converts the pruned candidates of a text lexical shortlist into CSR layout
+  void import(const LexicalShortlistGenerator& lexical);
+
+  // Maps a binary shortlist file and checks its header and size
+  void map(const std::string& fname);
+
+public:
+  // Loads a shortlist according to --shortlist. The file is either a binary shortlist, which is
+  // memory-mapped, or a text lexical shortlist that is converted in memory.
+  BinaryShortlistGenerator(Ptr<Options> options,
+                           Ptr<const Vocab> srcVocab,
+                           Ptr<const Vocab> trgVocab,
+                           size_t srcIdx = 0,
+                           size_t trgIdx = 1,
+                           bool shared = false);
+
+  // Writes the shortlist in binary format to the given file, uncompressed regardless of its extension
+  virtual void dump(const std::string& fname) const override;
+
+  virtual Ptr<Shortlist> generate(Ptr<data::CorpusBatch> batch) const override;
+
+  // Checks if the given file starts with the magic number of a binary shortlist
+  static bool isBinaryShortlist(const std::string& fname);
+};
+
+/*
+Caches the shortlists produced by another generator in an LRU cache keyed by the set of unique source
+word indices of a batch. Repeated or templated traffic then reuses the same Shortlist object instead of
+merging the candidate lists again. The cache is shared by all threads using the generator.
+*/
+class CachedShortlistGenerator : public ShortlistGenerator {
+private:
+  typedef std::vector<WordIndex> Key; // sorted unique source word indices
+
+  struct KeyHash {
+    size_t operator()(const Key& key) const { return util::hashMem(key.data(), key.size()); }
+  };
+
+  typedef std::list<std::pair<Key, Ptr<Shortlist>>> Entries; // most recently used first
+
+  Ptr<const ShortlistGenerator> generator_;
+  size_t srcIdx_;
+  size_t capacity_;
+
+  mutable Entries entries_;
+  mutable std::unordered_map<Key, Entries::iterator, KeyHash> index_;
+  mutable size_t hits_{0};
+  mutable size_t misses_{0};
+  mutable std::mutex mutex_;
+
+public:
+  CachedShortlistGenerator(Ptr<const ShortlistGenerator> generator, size_t srcIdx, size_t capacity);
+  virtual ~CachedShortlistGenerator();
+
+  virtual Ptr<Shortlist> generate(Ptr<data::CorpusBatch> batch) const override;
+
+  virtual void dump(const std::string& prefix) const override { generator_->dump(prefix); }
+
+  size_t hits() const;
+  size_t misses() const;
+};
+
+/*
+Shortlist factory to create correct type of shortlist. Files starting with the binary shortlist magic
+number are memory-mapped as BinaryShortlistGenerator. Otherwise, assumes everything is a text shortlist
+unless the extension is *.bin for which the Microsoft legacy binary shortlist is used. With
+--shortlist-cache-size > 0 the generator is wrapped into a CachedShortlistGenerator.
 */
 Ptr<ShortlistGenerator> createShortlistGenerator(Ptr<Options> options,
                                                  Ptr<const Vocab> srcVocab,
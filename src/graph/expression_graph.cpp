@@ -1,6 +1,7 @@
 #include "graph/expression_graph.h"
 #include "tensors/tensor_operators.h"
 
+#include <numeric>
 #include <sstream>
 
 namespace marian {
@@ -23,6 +24,13 @@ void ExpressionGraph::setDevice(DeviceId deviceId, Ptr<Device> device) {
   }
 }
 
+// These nodes share the memory of their first child
+static bool isView(Chainable<Tensor>* node) {
+  static const std::unordered_set<std::string> viewTypes
+      = {"reshape", "sliceView", "clipGradient", "tupleView"};
+  return viewTypes.count(node->type()) > 0;
+}
+
 Expr ExpressionGraph::add(Expr node) {
   auto found = tensors_->findOrRemember(node);
   if(found) {
@@ -101,7 +109,65 @@ void ExpressionGraph::forwardNext() {
   forward(nodesForward_, /*finalPass=*/!checkpointing_); // if checkPointing, this is not final
 }
 
+void ExpressionGraph::planForward(std::list<Expr>& forwardTape) {
+  auto allocator = tensors_->getAllocator();
+  if(allocator->planned() > 0)
+    return; // tensors of the previous plan are still in use, allocate as usual
+
+  // Positions on the tape, last reads and the references that the tape and the children of the
+  // nodes on the tape hold. Raw pointers, so this does not add references itself.
+  std::unordered_map<Chainable<Tensor>*, size_t> positions;
+  std::vector<Chainable<Tensor>*> nodes;
+  for(auto& v : forwardTape) {
+    positions[v.get()] = nodes.size();
+    nodes.push_back(v.get());
+  }
+  std::vector<size_t> tapeReferences(nodes.size(), 1);
+  std::vector<size_t> lastUse(nodes.size());
+  std::iota(lastUse.begin(), lastUse.end(), 0);
+  for(size_t i = 0; i < nodes.size(); ++i) {
+    for(auto& child : nodes[i]->children()) {
+      auto it = positions.find(child.get());
+      if(it != positions.end()) {
+        tapeReferences[it->second]++;
+        lastUse[it->second] = i;
+      }
+    }
+  }
+
+  // Only nodes that nothing else refers to are freed after their last read in this pass. This
+  // excludes values kept by the caller, views and recorded nodes.
+  std::vector<MemoryPlanner::Buffer> buffers;
+  std::vector<Chainable<Tensor>*> planned;
+  for(size_t i = 0; i < nodes.size(); ++i) {
+    auto v = nodes[i];
+    if(v->val() || v->memoize() || isView(v) || v->type() == "param" || references(v) != tapeReferences[i])
+      continue;
+    size_t bytes = allocator->alignedSize(requiredBytes(v->shape(), v->value_type()));
+    buffers.push_back({bytes, i, lastUse[i]});
+    planned.push_back(v);
+  }
+  if(buffers.empty())
+    return;
+
+  size_t bytes = memoryPlanner_.plan(buffers);
+  if(!planBlock_ || planBlock_->size() < bytes) {
+    if(planBlock_)
+      allocator->free(planBlock_);
+    planBlock_ = allocator->alloc(bytes);
+  }
+
+  for(size_t i = 0; i < planned.size(); ++i) {
+    auto v = planned[i];
+    auto mem = allocator->allocIn(planBlock_, buffers[i].offset, buffers[i].bytes);
+    v->val() = TensorBase::New(mem, v->shape(), v->value_type(), backend_);
+  }
+}
+
 void ExpressionGraph::forward(std::list<Expr>& forwardTape, bool finalPass) {
+  if(planMemory_ && inferenceOnly_ && !checkpointing_)
+    planForward(forwardTape);
+
   while(!forwardTape.empty()) {
     auto v = forwardTape.front();
 
@@ -140,6 +206,13 @@ void ExpressionGraph::forward(std::list<Expr>& forwardTape, bool finalPass) {
       }
     }
 
+    if(forwardMark_ && forwardMark_ == v) {
+      auto fn = forwardMarkFn_;
+      forwardMark_ = nullptr;
+      forwardMarkFn_ = nullptr;
+      fn();
+    }
+
     if(inferenceOnly_)
       v->children().clear();
 
@@ -244,6 +317,10 @@ void ExpressionGraph::backward(bool reset, float clipValue) {
       }
     }
 
+    // parameters are added to the tape before their first consumer, so their gradients are final now
+    if(paramGradientHook_ && v->type() == "param")
+      paramGradientHook_(v);
+
     v->children().clear();
   }
 }
@@ -4,6 +4,7 @@
 #include "common/definitions.h"
 
 #include "tensors/backend.h"
+#include "tensors/memory_planner.h"
 #include "tensors/tensor_allocator.h"
 
 #include "graph/chainable.h"
@@ -12,6 +13,7 @@
 #include "graph/parameters.h"
 
 #include <map>
+#include <set>
 #include <unordered_set>
 
 namespace marian {
@@ -155,6 +157,17 @@ private:
 
   bool throwNaN_{false};                    // a flag holds whether the graph throws a NaN exception
 
+  std::function<void(Expr)> paramGradientHook_; // called in backward() for each parameter whose gradient is complete
+
+  Expr forwardMark_;                    // node after which the forward pass calls forwardMarkFn_, see setForwardMark()
+  std::function<void()> forwardMarkFn_;
+
+  bool planMemory_{false};         // see setMemoryPlanning()
+  MemoryPlanner memoryPlanner_;
+  MemoryPiece::PtrType planBlock_; // memory of the planned tensors
+
+  void planForward(std::list<Expr>& forwardTape);
+
 protected:
   // Delete, copy and move constructors
   ExpressionGraph(const ExpressionGraph&) = delete;
@@ -222,6 +235,13 @@ public:
   /** Check whether the graph uses gradient checkpointing or not */
   bool isCheckpointing() { return checkpointing_; }
 
+  /**
+   * Set whether forward passes in inference place the intermediate tensors that are only used within
+   * the pass at offsets planned ahead by their lifetime in a single block of memory, which is kept
+   * for the next pass, instead of allocating each of them separately.
+   */
+  void setMemoryPlanning(bool planMemory) { planMemory_ = planMemory; }
+
   /**
    * Set namespace (std::string) for the graph.
    * Each graph has its own unique namespace, which is used to form the name of a parameter object.
@@ -284,6 +304,12 @@ public:
     return true;
   }
 
+  /**
+   * Make the workspace throw an AllocationException instead of growing, e.g. to test whether
+   * several forward passes fit into the given workspace memory, see fits().
+   */
+  void throwAtReallocation(bool throwAtRealloc) { tensors_->throwAtReallocation(throwAtRealloc); }
+
   /**
    * Check whether the memory allocated for a tensor object contains a NaN or infinite value.
    * @param t a Tensor object
@@ -712,9 +738,12 @@ public:
     count_ = 0;
     nodesForward_.clear();
     nodesBackward_.clear();
+    forwardMark_ = nullptr;
+    forwardMarkFn_ = nullptr;
 
     topNodes_.clear();
 
+    planBlock_ = nullptr;
     tensors_->clear();
   }
 
@@ -727,6 +756,23 @@ public:
   /** Get the flag value whether the graph throws a NaN exception (true) or not */
   bool getThrowNaN() { return throwNaN_; }
 
+  /**
+   * Set a function that backward() calls for each parameter node as soon as its gradient is complete,
+   * i.e. after all nodes consuming the parameter have been processed. This allows to start reducing
+   * gradients across devices before the backward pass has finished. Pass nullptr to remove it.
+   */
+  void setParamGradientHook(std::function<void(Expr)> hook) { paramGradientHook_ = hook; }
+
+  /**
+   * Set a function that the next forward pass calls as soon as it has computed the node that is
+   * currently the last one on the forward tape, e.g. to time the encoder separately from the first
+   * decoder step that is computed in the same pass. Does nothing if the forward tape is empty.
+   */
+  void setForwardMark(std::function<void()> fn) {
+    forwardMark_ = nodesForward_.empty() ? nullptr : nodesForward_.back();
+    forwardMarkFn_ = forwardMark_ ? fn : nullptr;
+  }
+
 public:
   /** Load model (mainly parameter objects) from array of io::Items */
   void load(std::vector<io::Item>& ioItems, bool markReloaded = true) {
@@ -771,12 +817,27 @@ public:
 
     LOG(info, "Memory mapping model at {}", ptr);
     auto items = io::mmapItems(ptr);
-    
+
+    // Items that cannot be memory-mapped, e.g. hardware non-specific intgemm matrices that were prepared
+    // for this CPU while loading, are kept in allocated parameters. All parameters of such a type are
+    // then copied into memory, since a parameter object is either mapped or allocated.
+    std::set<Type> allocatedTypes;
+    for(auto& item : items)
+      if(!item.mapped)
+        allocatedTypes.insert(item.type);
+    for(auto& item : items) {
+      if(item.mapped && allocatedTypes.count(item.type)) {
+        item.bytes.assign(item.ptr, item.ptr + item.size());
+        item.ptr = nullptr;
+        item.mapped = false;
+      }
+    }
+
     // Deal with default parameter set object that might not be a mapped object.
     // This gets assigned during ExpressionGraph::setDevice(...) and by default 
     // would contain allocated tensors. Here we replace it with a mmapped version.
     auto it = paramsByElementType_.find(defaultElementType_);
-    if(it != paramsByElementType_.end()) {
+    if(it != paramsByElementType_.end() && !allocatedTypes.count(defaultElementType_)) {
       // there is parameter object for that type
       auto defaultParams = std::dynamic_pointer_cast<MappedParameters>(it->second);
       if(!defaultParams) {
@@ -791,7 +852,7 @@ public:
     for(auto& item : items) {
       auto it1 = paramsByElementType_.find(item.type);
       if(it1 == paramsByElementType_.end()) {
-        auto params = New<MappedParameters>(item.type);
+        Ptr<Parameters> params = allocatedTypes.count(item.type) ? New<Parameters>(item.type) : New<MappedParameters>(item.type);
         params->init(backend_);
         paramsByElementType_.insert({item.type, params});
       }
@@ -361,6 +361,18 @@ Expr gather(Expr a, int axis, Expr indices) {
 // This function has the same semantics as PyTorch operation of the same name.
 Expr index_select(Expr a, int axis, Expr indices) {
   ABORT_IF(indices->shape().size() != 1, "Indices must be a 1D tensor");
+  // Prepared intgemm and packed fbgemm matrices, e.g. of the output layer with a shortlist, are selected
+  // from in their own format, so that they do not need to be unpacked. These formats only allow to select
+  // columns, i.e. outputs of the affine transformation. intgemm pads the selection to a multiple of 8 columns.
+  Type elementType = a->value_type();
+  if(isIntgemm(elementType) || isPacked(elementType)) {
+    ABORT_IF(a->shape().size() != 2 || a->shape().axis(axis) != 1,
+             "Only columns can be selected from {} matrices, not axis {} of {}", elementType, axis, a->shape());
+    if(isIntgemm(elementType))
+      return cpu::integer::selectColumnsB(a, indices);
+    else
+      return cpu::variant::selectColumns(a, indices);
+  }
   // We have specialized kernels for non-batched indexing of first or last axis of a 2D tensor.
   auto rank = a->shape().size();
   if (rank == 2) {
@@ -555,6 +567,16 @@ Expr dot(Expr a, Expr b, bool transA, bool transB, float scale) {
 }
 
 Expr bdot(Expr a, Expr b, bool transA, bool transB, float scale) {
+  auto graph = a->graph();
+  if(graph->getDeviceId().type == DeviceType::cpu && graph->isInference()) {
+    // products of activations, e.g. in attention, in intgemm if selected with --gemm-type intgemm8 or intgemm16
+    auto gemmType = graph->getBackend()->getGemmType();
+    if(gemmType == GemmType::IntgemmInt8 || gemmType == GemmType::IntgemmInt16) {
+      auto vtype = gemmType == GemmType::IntgemmInt8 ? Type::intgemm8 : Type::intgemm16;
+      if(auto result = cpu::integer::bdot(a, b, transA, transB, scale, vtype))
+        return result;
+    }
+  }
   return Expression<DotBatchedNodeOp>(a, b, transA, transB, scale);
 }
 
@@ -567,12 +589,35 @@ Expr affineDefault(Expr a, Expr b, Expr bias, bool transA, bool transB, float sc
   return Expression<AffineNodeOp>(nodes, transA, transB, scale);
 }
 
-// This operation used to implement auto-tuning. We have removed it for now due to complexity, but plan to revisit it in the future. 
-// The last branch with auto-tuner is: 
-// youki/packed-model-pr-backup1031
-// https://machinetranslation.visualstudio.com/Marian/_git/marian-dev?version=GByouki%2Fpacked-model-pr-backup1031
-// SHA: 3456a7ed1d1608cfad74cd2c414e7e8fe141aa52
-Expr affine(Expr a, Expr b, Expr bias, bool transA, bool transB, float scale) {
+// Applies the activation as a separate operation where it cannot be fused into the matrix product
+static Expr activate(Expr x, cpu::Activation activation) {
+  switch(activation) {
+    case cpu::Activation::none:  return x;
+    case cpu::Activation::relu:  return relu(x);
+    case cpu::Activation::swish: return swish(x);
+    case cpu::Activation::gelu:  return gelu(x);
+    default: ABORT("Unknown activation");
+  }
+}
+
+// Bias, activation and skip connection are fused into the matrix product and the layer normalization
+// for inference on CPU with --optimize only, other graphs, e.g. for the ONNX exporter, keep separate operations
+static bool fuseEpilogues(Ptr<ExpressionGraph> graph) {
+  return graph->isInference() && graph->getDeviceId().type == DeviceType::cpu && graph->getBackend()->isOptimized();
+}
+
+// Float32 product on CPU that adds the bias and applies the activation in one pass over the result,
+// instead of separate nodes for the product, the bias and the activation
+static Expr affineDefaultWithEpilogue(Expr a, Expr b, Expr bias, bool transA, bool transB, float scale,
+                                      cpu::Activation activation) {
+  if(activation == cpu::Activation::none)
+    return affineDefault(a, b, bias, transA, transB, scale);
+  return Expression<AffineWithActivationNodeOp>(a, b, bias, transA, transB, scale, activation);
+}
+
+// Dispatches to the GEMM of the selected backend, which applies the activation to its output on CPU
+static Expr affineWithEpilogue(Expr a, Expr b, Expr bias, bool transA, bool transB, float scale,
+                               cpu::Activation activation) {
   auto device = a->graph()->getDeviceId().type;
 
   Type aElementType = a->value_type();
@@ -588,7 +633,7 @@ Expr affine(Expr a, Expr b, Expr bias, bool transA, bool transB, float scale) {
             auto packedB = cpu::variant::pack(
                 marian::Type::packed16, b, cpu::variant::PackMatrix::B, transB);
             return cpu::variant::affine(marian::Type::packed16,
-                a, packedB, b->shape(), bias, transA, transB, scale);
+                a, packedB, b->shape(), bias, transA, transB, scale, activation);
           } else {
             float quantizeRange = b->graph()->getBackend()->getQuantizeRange();
             if(fbgemm::fbgemmHasAvx512Support()) {
@@ -598,7 +643,7 @@ Expr affine(Expr a, Expr b, Expr bias, bool transA, bool transB, float scale) {
                                                 transB,
                                                 quantizeRange);
               return cpu::variant::affine(marian::Type::packed8avx512,
-                  a, packedB, b->shape(), bias, transA, transB, scale);
+                  a, packedB, b->shape(), bias, transA, transB, scale, activation);
             } else if(fbgemm::fbgemmHasAvx2Support()) {
               auto packedB = cpu::variant::pack(marian::Type::packed8avx2,
                                                 b,
@@ -606,7 +651,7 @@ Expr affine(Expr a, Expr b, Expr bias, bool transA, bool transB, float scale) {
                                                 transB,
                                                 quantizeRange);
               return cpu::variant::affine(marian::Type::packed8avx2,
-                  a, packedB, b->shape(), bias, transA, transB, scale);
+                  a, packedB, b->shape(), bias, transA, transB, scale, activation);
             } else {
               ABORT(
                   "AVX2 is not available. At least, AVX2 is needed to use fbgemm-based packed "
@@ -617,13 +662,13 @@ Expr affine(Expr a, Expr b, Expr bias, bool transA, bool transB, float scale) {
           ABORT("Packed GEMM is not available in this build");
 #endif  // USE_FBGEMM
         } else {
-          return affineDefault(a, b, bias, transA, transB, scale);
+          return affineDefaultWithEpilogue(a, b, bias, transA, transB, scale, activation);
         }
       } else {
-        return affineDefault(a, b, bias, transA, transB, scale);
+        return affineDefaultWithEpilogue(a, b, bias, transA, transB, scale, activation);
       }
     } else if(isFloat(aElementType) && isIntgemm(bElementType)) {
-      return cpu::integer::affineOrDot(a, b, bias, transA, transB, scale);
+      return cpu::integer::affineOrDot(a, b, bias, transA, transB, scale, activation);
     } else if(isFloat(aElementType) && isPacked(bElementType)) {
 #if USE_FBGEMM
       // 07/10/2019 - Use packed GEMM only if the cpu architecture supports AVX2
@@ -640,7 +685,8 @@ Expr affine(Expr a, Expr b, Expr bias, bool transA, bool transB, float scale) {
                                     bias,
                                     transA,
                                     transB,
-                                    scale);
+                                    scale,
+                                    activation);
       } else {
         ABORT("AVX2 is not available. At least, AVX2 is needed to use fbgemm-based packed GEMM");
       }
@@ -655,15 +701,45 @@ Expr affine(Expr a, Expr b, Expr bias, bool transA, bool transB, float scale) {
     ABORT_IF(!isFloat(aElementType) || !isFloat(bElementType), 
              "GPU-based GEMM only supports float types, you have A: {} and B: {}", 
              aElementType, bElementType);
-    return affineDefault(a, b, bias, transA, transB, scale);
+    return activate(affineDefault(a, b, bias, transA, transB, scale), activation);
   }
 }
 
+// This operation used to implement auto-tuning. We have removed it for now due to complexity, but plan to revisit it in the future. 
+// The last branch with auto-tuner is: 
+// youki/packed-model-pr-backup1031
+// https://machinetranslation.visualstudio.com/Marian/_git/marian-dev?version=GByouki%2Fpacked-model-pr-backup1031
+// SHA: 3456a7ed1d1608cfad74cd2c414e7e8fe141aa52
+Expr affine(Expr a, Expr b, Expr bias, bool transA, bool transB, float scale) {
+  return affineWithEpilogue(a, b, bias, transA, transB, scale, cpu::Activation::none);
+}
+
+Expr affineWithActivation(Expr a, Expr b, Expr bias, const std::string& actName, bool transA, bool transB, float scale) {
+  cpu::Activation activation;
+  if(actName == "relu")
+    activation = cpu::Activation::relu;
+  else if(actName == "swish")
+    activation = cpu::Activation::swish;
+  else if(actName == "gelu")
+    activation = cpu::Activation::gelu;
+  else
+    ABORT("Activation '{}' cannot be fused with an affine transformation", actName);
+
+  if(activation == cpu::Activation::relu)
+    return affineWithRelu(a, b, bias, transA, transB, scale);
+  else if(fuseEpilogues(a->graph()))
+    return affineWithEpilogue(a, b, bias, transA, transB, scale, activation);
+  else
+    return activate(affine(a, b, bias, transA, transB, scale), activation);
+}
+
 Expr affineWithRelu(Expr a, Expr b, Expr bias, bool transA, bool transB, float scale) {
   auto graph = a->graph();
   
   if(graph->isInference() && graph->getDeviceId().type == DeviceType::gpu)
     return Expression<AffineWithReluNodeOp>(a, b, bias, transA, transB, scale);
+  else if(fuseEpilogues(graph)) // bias and relu in the epilogue of the product on CPU
+    return affineWithEpilogue(a, b, bias, transA, transB, scale, cpu::Activation::relu);
   else
     return relu(affine(a, b, bias, transA, transB, scale));
 }
@@ -830,6 +906,21 @@ Expr layerNorm(Expr x,
   return Expression<LayerNormalizationOp>(nodes, eps);
 }
 
+Expr residualLayerNorm(Expr x,
+                       Expr residual,
+                       Expr gamma,
+                       Expr beta /*= nullptr*/,
+                       float eps /*= 1e-9*/) {
+  if(fuseEpilogues(x->graph()) && x->shape() == residual->shape()
+     && x->value_type() == Type::float32 && residual->value_type() == Type::float32) {
+    std::vector<Expr> nodes = {x, residual, gamma};
+    if(beta)
+      nodes.push_back(beta);
+    return Expression<ResidualLayerNormalizationOp>(nodes, eps);
+  }
+  return layerNorm(x + residual, gamma, beta, eps);
+}
+
 Expr rmsNorm(Expr x,
              Expr gamma,
              Expr beta /*= nullptr*/,
@@ -503,6 +503,19 @@ Expr affineWithRelu(Expr a,
                     bool transB = false,
                     float scalar = 1.f);
 
+/**
+ * As above, but applies the activation @p actName, which is one of relu, swish and gelu, to the output.
+ * For inference on CPU with --optimize, the bias and the activation are applied in the epilogue of the
+ * product of the selected GEMM backend (float32, fbgemm or intgemm), instead of in separate operations.
+ */
+Expr affineWithActivation(Expr a,
+                          Expr b,
+                          Expr bias,
+                          const std::string& actName,
+                          bool transA = false,
+                          bool transB = false,
+                          float scalar = 1.f);
+
 /**
  * Computes the dot product of CSR-tensor @p A with @p B.
  */
@@ -915,6 +928,12 @@ Expr weighted_average(Expr in, Expr weights, int ax = 0);
  */
 Expr layerNorm(Expr x, Expr gamma, Expr beta = nullptr, float eps = 1e-9);
 
+/**
+ * Applies layer normalization to @p x + @p residual, e.g. after a skip connection.
+ * For inference on CPU with --optimize, the sum is computed in the same pass as the normalization.
+ */
+Expr residualLayerNorm(Expr x, Expr residual, Expr gamma, Expr beta = nullptr, float eps = 1e-9);
+
 /**
  * Applies RMS normalization over the last dimension. 
  * 
@@ -502,6 +502,94 @@ public:
   }
 };
 
+// Affine transformation for inference on CPU that adds the bias and applies the activation in a single
+// pass over the output of the product, see cpu::AddBiasAndActivate()
+class AffineWithActivationNodeOp : public NaryNodeOp {
+private:
+  friend class SerializationHelpers;
+  bool transA_;
+  bool transB_;
+  float scalar_;
+  cpu::Activation activation_;
+
+public:
+  AffineWithActivationNodeOp(Expr a,
+                             Expr b,
+                             Expr bias,
+                             bool transA,
+                             bool transB,
+                             float scalar,
+                             cpu::Activation activation)
+      : NaryNodeOp({a, b, bias}, newShape(a, b, transA, transB)),
+        transA_(transA),
+        transB_(transB),
+        scalar_(scalar),
+        activation_(activation) {
+    ABORT_IF(!graph()->isInference() || graph()->getDeviceId().type != DeviceType::cpu,
+             "AffineWithActivationNodeOp currently only supported for inference on CPU");
+  }
+
+  Shape newShape(Expr a, Expr b, bool transA, bool transB) {
+    auto shapeA = a->shape();
+    if(transA) {
+      shapeA.set(shapeA.size() - 2, a->shape()[shapeA.size() - 1]);
+      shapeA.set(shapeA.size() - 1, a->shape()[shapeA.size() - 2]);
+    }
+
+    auto shapeB = b->shape();
+    if(transB) {
+      shapeB.set(shapeB.size() - 2, b->shape()[shapeB.size() - 1]);
+      shapeB.set(shapeB.size() - 1, b->shape()[shapeB.size() - 2]);
+    }
+
+    Shape outShape = shapeA;
+    outShape.set(outShape.size() - 1, shapeB[shapeB.size() - 1]);
+    ABORT_IF(shapeA[shapeA.size() - 1] != shapeB[shapeB.size() - 2],
+             "Matrix product requires inner dimensions to match in {}{} * {}{}", std::string(shapeA), transA, std::string(shapeB), transB);
+    return outShape;
+  }
+
+  NodeOps forwardOps() override {
+    return {
+      NodeOp(Prod(val_, child(0)->val(), child(1)->val(), transA_, transB_, 0.f, scalar_);
+             cpu::AddBiasAndActivate(val_, child(2)->val(), activation_))
+    };
+  }
+
+  NodeOps backwardOps() override {
+    ABORT("AffineWithActivationNodeOp cannot be used for training??");
+    return {};
+  }
+
+  const std::string type() override { return "affineWithActivation"; }
+
+  virtual size_t hash() override {
+    size_t seed = NaryNodeOp::hash();
+    util::hash_combine(seed, transA_);
+    util::hash_combine(seed, transB_);
+    util::hash_combine(seed, scalar_);
+    util::hash_combine(seed, (int)activation_);
+    return seed;
+  }
+
+  virtual bool equal(Expr node) override {
+    if(!NaryNodeOp::equal(node))
+      return false;
+    auto cnode = std::dynamic_pointer_cast<AffineWithActivationNodeOp>(node);
+    if(!cnode)
+      return false;
+    if(transA_ != cnode->transA_)
+      return false;
+    if(transB_ != cnode->transB_)
+      return false;
+    if(scalar_ != cnode->scalar_)
+      return false;
+    if(activation_ != cnode->activation_)
+      return false;
+    return true;
+  }
+};
+
 class DotBatchedNodeOp : public NaryNodeOp {
 private:
   friend class SerializationHelpers;
@@ -1369,6 +1457,57 @@ private:
   float eps_;
 };
 
+// Layer normalization of x + residual for inference on CPU, computes the sum in the same pass
+// over each row as the normalization, see cpu::AddLayerNormalization()
+struct ResidualLayerNormalizationOp : public NaryNodeOp {
+public:
+  ResidualLayerNormalizationOp(const std::vector<Expr>& nodes, float eps = 1e-9)
+      : NaryNodeOp(nodes), eps_(eps) {
+    ABORT_IF(!graph()->isInference() || graph()->getDeviceId().type != DeviceType::cpu,
+             "ResidualLayerNormalizationOp currently only supported for inference on CPU");
+    ABORT_IF(child(0)->shape() != child(1)->shape(),
+             "Input of shape {} and residual of shape {} do not match", child(0)->shape(), child(1)->shape());
+  }
+
+  NodeOps forwardOps() override {
+    return {NodeOp(
+        cpu::AddLayerNormalization(val_,
+                                   child(0)->val(),
+                                   child(1)->val(),
+                                   child(2)->val(),
+                                   (children_.size() == 4) ? child(3)->val() : nullptr,
+                                   eps_))};
+  }
+
+  NodeOps backwardOps() override {
+    ABORT("ResidualLayerNormalizationOp cannot be used for training??");
+    return {};
+  }
+
+  const std::string type() override { return "residual_layer_normalization"; }
+
+  virtual size_t hash() override {
+    size_t seed = NaryNodeOp::hash();
+    util::hash_combine(seed, eps_);
+    return seed;
+  }
+
+  virtual bool equal(Expr node) override {
+    if(!NaryNodeOp::equal(node))
+      return false;
+    auto cnode = std::dynamic_pointer_cast<ResidualLayerNormalizationOp>(node);
+    if(!cnode)
+      return false;
+    if(eps_ != cnode->eps_)
+      return false;
+    return true;
+  }
+
+private:
+  friend class SerializationHelpers;
+  float eps_;
+};
+
 // RMS norm along last axis
 struct RMSNormalizationOp : public NaryNodeOp {
 public:
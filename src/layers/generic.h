@@ -197,8 +197,8 @@ static inline Expr denseInline(Expr x,
   auto W = graph->param(prefix + "_W" + suffix, {x->shape()[-1], outDim}, initFn);
   auto b = graph->param(prefix + "_b" + suffix, {1, outDim}, inits::zeros());
 
-  if(actName == "relu") {
-    x = affineWithRelu(x, W, b); // speed optimization for inference, @TODO: handle better in future layer framework
+  if(actName == "relu" || actName == "swish" || actName == "gelu") {
+    x = affineWithActivation(x, W, b, actName); // speed optimization for inference, @TODO: handle better in future layer framework
   } else {
     x = affine(x, W, b);
     x = activationByName(actName)(x);
@@ -214,6 +214,14 @@ static inline Expr layerNorm(Expr x, std::string prefix, std::string suffix = st
   return marian::layerNorm(x, scale, bias, 1e-6f);
 }
 
+// like layerNorm() but normalizes x + residual, with the sum fused into the normalization for optimized CPU inference
+static inline Expr residualLayerNorm(Expr x, Expr residual, std::string prefix, std::string suffix = std::string()) {
+  int dimModel = x->shape()[-1];
+  auto scale = x->graph()->param(prefix + "_ln_scale" + suffix, {1, dimModel}, inits::ones());
+  auto bias = x->graph()->param(prefix + "_ln_bias" + suffix, {1, dimModel}, inits::zeros());
+  return marian::residualLayerNorm(x, residual, scale, bias, 1e-6f);
+}
+
 static inline Expr rmsNorm(Expr x, std::string prefix, std::string suffix = std::string()) {
   int dimModel = x->shape()[-1];
   auto scale = x->graph()->param(prefix + "_rms_scale" + suffix, {1, dimModel}, inits::ones());
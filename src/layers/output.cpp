@@ -83,10 +83,24 @@ Logits Output::applyAsLogits(Expr input) /*override final*/ {
   if(shortlist_ && !cachedShortWt_) {  // shortlisted versions of parameters are cached within one
                                        // batch, then clear()ed
     cachedShortWt_ = index_select(Wt_, isLegacyUntransposedW ? -1 : 0, shortlist_->indices());
-    if(hasBias_)
-      cachedShortb_ = index_select(b_, -1, shortlist_->indices());
+    if(hasBias_) {
+      // intgemm pads the selected columns by repeating the last index, the bias has to match
+      std::vector<WordIndex> indices = shortlist_->indices();
+      size_t numSelected = cachedShortWt_->shape()[isLegacyUntransposedW ? -1 : 0];
+      if(numSelected > indices.size())
+        indices.resize(numSelected, indices.empty() ? 0 : indices.back());
+      cachedShortb_ = index_select(b_, -1, indices);
+    }
   }
 
+  // drops the padding columns of a shortlisted intgemm matrix from the logits, LSH selects its own columns
+  auto unpadShortlist = [&](Expr logits) {
+    int numShortlisted = (int)shortlist_->indices().size();
+    if(lsh_ || logits->shape()[-1] == numShortlisted)
+      return logits;
+    return slice(logits, -1, Slice(0, numShortlisted));
+  };
+
   if(factoredVocab_) {
     auto graph = input->graph();
 
@@ -180,20 +194,23 @@ Logits Output::applyAsLogits(Expr input) /*override final*/ {
       // @TODO: b_ should be a vector, not a matrix; but shotlists use cols() in, which requires a
       // matrix
       Expr factorLogits;
-      if(g == 0)
+      if(g == 0) {
         factorLogits = affineOrLSH(
             input1,
             factorWt,
             factorB,
             false,
             /*transB=*/isLegacyUntransposedW ? false : true);  // [B... x U] factor logits
-      else
+        if(shortlist_)
+          factorLogits = unpadShortlist(factorLogits);
+      } else {
         factorLogits = affineOrDot(
             input1,
             factorWt,
             factorB,
             false,
             /*transB=*/isLegacyUntransposedW ? false : true);  // [B... x U] factor logits
+      }
 
       // optionally add lemma-dependent bias
       if(Plemma) {  // [B... x U0]
@@ -278,11 +295,11 @@ Logits Output::applyAsLogits(Expr input) /*override final*/ {
     }
     return Logits(std::move(allLogits), factoredVocab_);
   } else if(shortlist_) {
-    return Logits(affineOrLSH(input,
-                              cachedShortWt_,
-                              cachedShortb_,
-                              false,
-                              /*transB=*/isLegacyUntransposedW ? false : true));
+    return Logits(unpadShortlist(affineOrLSH(input,
+                                             cachedShortWt_,
+                                             cachedShortb_,
+                                             false,
+                                             /*transB=*/isLegacyUntransposedW ? false : true)));
   } else {
     return Logits(
         affineOrLSH(input, Wt_, b_, false, /*transB=*/isLegacyUntransposedW ? false : true));
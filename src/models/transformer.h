@@ -186,10 +186,16 @@ public:
 
   Expr postProcess(std::string prefix, std::string ops, Expr input, Expr prevInput, float dropProb = 0.0f) const {
     auto output = input;
-    for(auto op : ops) {
+    for(size_t i = 0; i < ops.size(); ++i) {
+      char op = ops[i];
       // dropout
       if(op == 'd')
         output = dropout(output, dropProb);
+      // skip connection followed by layer normalization, fused for inference on CPU with --optimize
+      else if(op == 'a' && i + 1 < ops.size() && ops[i + 1] == 'n') {
+        output = residualLayerNorm(output, prevInput, prefix);
+        ++i;
+      }
       // skip connection
       else if(op == 'a')
         output = output + prevInput;
@@ -269,6 +275,44 @@ public:
     return output;
   }
 
+  // linear transformation of queries, keys or values (which = "q", "k" or "v") and split into heads
+  Expr ProjectHeads(std::string prefix,
+                    std::string which,
+                    Expr input, // [-4: beam depth, -3: batch size, -2: max length, -1: vector dim]
+                    int dimModel,
+                    int dimHeads) {
+    auto W = graph_->param(prefix + "_W" + which, {dimModel, dimModel}, inits::glorotUniform(true, true, depthScaling_ ? 1.f / sqrtf((float)depth_) : 1.f));
+    auto b = graph_->param(prefix + "_b" + which, {       1, dimModel}, inits::zeros());
+    return SplitHeads(affine(input, W, b), dimHeads); // [-4: beam depth * batch size, -3: num heads, -2: max length, -1: split vector dim]
+  }
+
+  // attention over heads that have already been projected, followed by joining and projecting the heads
+  Expr AttendHeads(std::string prefix,
+                   int dimOut,
+                   Expr qh,          // [-4: beam depth * batch size, -3: num heads, -2: max q length, -1: split vector dim]
+                   Expr kh,          // [-4: batch size, -3: num heads, -2: max kv length, -1: split vector dim]
+                   Expr vh,          // [-4: batch size, -3: num heads, -2: max kv length, -1: split vector dim]
+                   const Expr& mask, // [-4: batch size, -3: num heads broadcast=1, -2: max length broadcast=1, -1: max length]
+                   bool saveAttentionWeights,
+                   int dimBeam) {
+    // apply multi-head attention to downscaled inputs
+    auto output
+        = Attention(prefix, qh, kh, vh, mask, saveAttentionWeights, dimBeam); // [-4: beam depth * batch size, -3: num heads, -2: max length, -1: split vector dim]
+
+    output = JoinHeads(output, dimBeam); // [-4: beam depth, -3: batch size, -2: max length, -1: vector dim]
+
+    int dimAtt = output->shape()[-1];
+
+    bool project = !opt<bool>("transformer-no-projection");
+    if(project || dimAtt != dimOut) {
+      auto Wo = graph_->param(prefix + "_Wo", {dimAtt, dimOut}, inits::glorotUniform(true, true, depthScaling_ ? 1.f / sqrtf((float)depth_) : 1.f));
+      auto bo = graph_->param(prefix + "_bo", {1, dimOut}, inits::zeros());
+      output = affine(output, Wo, bo);
+    }
+
+    return output;
+  }
+
   Expr MultiHead(std::string prefix,
                  int dimOut,
                  int dimHeads,
@@ -280,10 +324,7 @@ public:
                  bool saveAttentionWeights = false) {
     int dimModel = q->shape()[-1];
     // @TODO: good opportunity to implement auto-batching here or do something manually?
-    auto Wq = graph_->param(prefix + "_Wq", {dimModel, dimModel}, inits::glorotUniform(true, true, depthScaling_ ? 1.f / sqrtf((float)depth_) : 1.f));
-    auto bq = graph_->param(prefix + "_bq", {       1, dimModel}, inits::zeros());
-    auto qh = affine(q, Wq, bq);
-    qh = SplitHeads(qh, dimHeads); // [-4: beam depth * batch size, -3: num heads, -2: max length, -1: split vector dim]
+    auto qh = ProjectHeads(prefix, "q", q, dimModel, dimHeads); // [-4: beam depth * batch size, -3: num heads, -2: max length, -1: split vector dim]
 
     Expr kh;
     // Caching transformation of the encoder that should not be created again.
@@ -295,11 +336,7 @@ public:
       kh = cache_[prefix + "_keys"];                                                   // then return cached tensor
     }
     else {
-      auto Wk = graph_->param(prefix + "_Wk", {dimModel, dimModel}, inits::glorotUniform(true, true, depthScaling_ ? 1.f / sqrtf((float)depth_) : 1.f));
-      auto bk = graph_->param(prefix + "_bk", {1,        dimModel}, inits::zeros());
-
-      kh = affine(keys, Wk, bk);     // [-4: beam depth, -3: batch size, -2: max length, -1: vector dim]
-      kh = SplitHeads(kh, dimHeads); // [-4: batch size, -3: num heads, -2: max length, -1: split vector dim]
+      kh = ProjectHeads(prefix, "k", keys, dimModel, dimHeads); // [-4: batch size, -3: num heads, -2: max length, -1: split vector dim]
       cache_[prefix + "_keys"] = kh;
     }
 
@@ -309,32 +346,12 @@ public:
         && cache_[prefix + "_values"]->shape().elements() == values->shape().elements()) {
       vh = cache_[prefix + "_values"];
     } else {
-      auto Wv = graph_->param(prefix + "_Wv", {dimModel, dimModel}, inits::glorotUniform(true, true, depthScaling_ ? 1.f / sqrtf((float)depth_) : 1.f));
-      auto bv = graph_->param(prefix + "_bv", {1,        dimModel}, inits::zeros());
-
-      vh = affine(values, Wv, bv); // [-4: batch size, -3: num heads, -2: max length, -1: split vector dim]
-      vh = SplitHeads(vh, dimHeads);
+      vh = ProjectHeads(prefix, "v", values, dimModel, dimHeads); // [-4: batch size, -3: num heads, -2: max length, -1: split vector dim]
       cache_[prefix + "_values"] = vh;
     }
 
     int dimBeam = q->shape()[-4];
-
-    // apply multi-head attention to downscaled inputs
-    auto output
-        = Attention(prefix, qh, kh, vh, mask, saveAttentionWeights, dimBeam); // [-4: beam depth * batch size, -3: num heads, -2: max length, -1: split vector dim]
-
-    output = JoinHeads(output, dimBeam); // [-4: beam depth, -3: batch size, -2: max length, -1: vector dim]
-
-    int dimAtt = output->shape()[-1];
-
-    bool project = !opt<bool>("transformer-no-projection");
-    if(project || dimAtt != dimOut) {
-      auto Wo = graph_->param(prefix + "_Wo", {dimAtt, dimOut}, inits::glorotUniform(true, true, depthScaling_ ? 1.f / sqrtf((float)depth_) : 1.f));
-      auto bo = graph_->param(prefix + "_bo", {1, dimOut}, inits::zeros());
-      output = affine(output, Wo, bo);
-    }
-
-    return output;
+    return AttendHeads(prefix, dimOut, qh, kh, vh, mask, saveAttentionWeights, dimBeam);
   }
 
   // Reduce the encoder to a single sentence vector, here we just take the contextual embedding of the first word per sentence
@@ -387,9 +404,13 @@ public:
                                  std::string prefix,
                                  Expr input,
                                  Expr selfMask,
-                                 int startPos) {
+                                 int startPos,
+                                 int dimCache = 0) {
     selfMask = transposedLogMask(selfMask);
 
+    if(inference_ && opt<bool>("transformer-decoder-kv-cache", true))
+      return DecoderLayerSelfAttentionCached(decoderLayerState, prevdecoderLayerState, prefix, input, selfMask, startPos, dimCache);
+
     auto values = input;
     if(startPos > 0) {
       values = concatenate({prevdecoderLayerState.output, input}, /*axis=*/-2);
@@ -400,6 +421,94 @@ public:
                           opt<int>("transformer-heads"), /*cache=*/false);
   }
 
+  // Decoder self-attention for inference with a key/value cache. Instead of the layer inputs of all
+  // previous positions, the decoder state keeps their projected and head-split keys (output) and
+  // values (cell), so every step only projects the current position. The cache is preallocated
+  // with dimCache positions, e.g. the maximum output length, and every step writes its position
+  // into it and masks the positions after it. This way the steps build graphs of the same shape
+  // instead of concatenating a growing cache, which copies all previous positions every step. If a
+  // step goes beyond the preallocated positions, the cache is extended to twice its size.
+  // The cache is stored as [-4: beam depth, -3: batch size, -2: num heads * positions, -1: split
+  // vector dim] so that rnn::State::select() reorders it along with the beams. Equivalent to
+  // LayerAttention() over the concatenated inputs, which projects keys and values from the inputs
+  // without pre-processing as well. Disabled with the option transformer-decoder-kv-cache=false, e.g.
+  // by the ONNX exporter, whose decoder-step function passes the layer inputs as decoder state.
+  Expr DecoderLayerSelfAttentionCached(rnn::State& decoderLayerState,
+                                       const rnn::State& prevdecoderLayerState,
+                                       std::string prefix,
+                                       Expr input,          // [-4: beam depth, -3: batch size, -2: current positions, -1: vector dim]
+                                       Expr selfMask,       // [-4: batch size, -3: num heads broadcast=1, -2: current positions, -1: current positions]
+                                       int startPos,
+                                       int dimCache) {
+    int dimModel = input->shape()[-1];
+    int dimSteps = input->shape()[-2];
+    int dimBatch = input->shape()[-3];
+    int dimBeam  = input->shape()[-4];
+    int dimHeads = opt<int>("transformer-heads");
+    int dimDepth = dimModel / dimHeads;
+
+    auto opsPre = opt<std::string>("transformer-preprocess");
+    auto output = preProcess(prefix + "_Wo", opsPre, input);
+
+    auto qh = ProjectHeads(prefix, "q", output, dimModel, dimHeads); // [-4: beam depth * batch size, -3: num heads, -2: current positions, -1: split vector dim]
+    auto kh = ProjectHeads(prefix, "k", input,  dimModel, dimHeads);
+    auto vh = ProjectHeads(prefix, "v", input,  dimModel, dimHeads);
+
+    auto valueType = kh->value_type();
+    float maskFactor = std::max(NumericLimits<float>(valueType).lowest / 2.f, -99999999.f); // as in transposedLogMask()
+
+    // appends unused positions to a cache [-4: beam depth * batch size, -3: num heads, -2: positions, -1: split vector dim]
+    auto extend = [&](Expr cache, int dimPositions) {
+      int dimUnused = dimPositions - cache->shape()[-2];
+      if(dimUnused <= 0)
+        return cache;
+      auto unused = graph_->constant({dimBeam * dimBatch, dimHeads, dimUnused, dimDepth}, inits::zeros(), valueType);
+      return concatenate({cache, unused}, /*axis=*/-2);
+    };
+
+    if(startPos == 0) {
+      // first step: the cache holds the current positions followed by unused ones
+      dimCache = std::max(dimCache, dimSteps);
+      kh = extend(kh, dimCache); // [-4: beam depth * batch size, -3: num heads, -2: cache positions, -1: split vector dim]
+      vh = extend(vh, dimCache);
+      if(dimCache > dimSteps) {
+        auto unusedMask = graph_->constant({selfMask->shape()[-4], 1, dimSteps, dimCache - dimSteps}, inits::fromValue(maskFactor), selfMask->value_type());
+        selfMask = concatenate({selfMask, unusedMask}, /*axis=*/-1);
+      }
+    } else {
+      ABORT_IF(dimSteps != 1, "Cached decoder self-attention expects one position per step after the first, not {}", dimSteps);
+      int dimPrevCache = prevdecoderLayerState.output->shape()[-2] / dimHeads;
+      auto prevKh = reshape(prevdecoderLayerState.output, {dimBeam * dimBatch, dimHeads, dimPrevCache, dimDepth});
+      auto prevVh = reshape(prevdecoderLayerState.cell,   {dimBeam * dimBatch, dimHeads, dimPrevCache, dimDepth});
+      dimCache = dimPrevCache;
+      if(startPos >= dimCache) { // more steps than estimated
+        dimCache = std::max(2 * dimCache, startPos + 1);
+        prevKh = extend(prevKh, dimCache);
+        prevVh = extend(prevVh, dimCache);
+      }
+
+      // Positions from startPos on are still zero, so adding the current position masked by a one-hot
+      // vector writes it into the cache. Positions after it are masked in the attention.
+      std::vector<float> vPosition(dimCache, 0.f), vMask(dimCache, maskFactor);
+      vPosition[startPos] = 1.f;
+      std::fill(vMask.begin(), vMask.begin() + startPos + 1, 0.f);
+      auto position = graph_->constant({1, 1, dimCache, 1}, inits::fromVector(vPosition), valueType);
+      kh = prevKh + kh * position; // [-4: beam depth * batch size, -3: num heads, -2: cache positions, -1: split vector dim]
+      vh = prevVh + vh * position;
+      selfMask = selfMask + graph_->constant({1, 1, 1, dimCache}, inits::fromVector(vMask), selfMask->value_type());
+    }
+
+    decoderLayerState.output = reshape(kh, {dimBeam, dimBatch, dimHeads * dimCache, dimDepth});
+    decoderLayerState.cell   = reshape(vh, {dimBeam, dimBatch, dimHeads * dimCache, dimDepth});
+
+    output = AttendHeads(prefix, dimModel, qh, kh, vh, selfMask, /*saveAttentionWeights=*/false, dimBeam);
+
+    auto opsPost = opt<std::string>("transformer-postprocess");
+    output = postProcess(prefix + "_Wo", opsPost, output, input);
+
+    return output;
+  }
+
   Expr LayerFFN(std::string prefix, Expr input) const {
     int dimModel = input->shape()[-1];
 
@@ -706,6 +815,15 @@ public:
     return step(state);
   }
 
+  // Maximum output length of beam search, which ends with the step whose position reaches the source
+  // length times --max-length-factor
+  int maxOutputLength(Ptr<DecoderState> state) const {
+    if(!state->getBatch())
+      return 0;
+    float maxLengthFactor = opt<float>("max-length-factor", 3.f);
+    return (int)std::ceil(maxLengthFactor * state->getBatch()->front()->batchWidth()) + 1;
+  }
+
   Ptr<DecoderState> step(Ptr<DecoderState> state) {
     auto embeddings  = state->getTargetHistoryEmbeddings(); // [-4: beam depth=1, -3: max length, -2: batch size, -1: vector dim]
     auto decoderMask = state->getTargetMask();              // [max length, batch size, 1]  --this is a hypothesis
@@ -776,6 +894,10 @@ public:
       checkpoint(encoderMask);
     }
 
+    // positions preallocated by the key/value cache of the self-attention in the first step of
+    // step-wise decoding, scoring and other passes over all positions at once do not preallocate
+    int dimCache = startPos == 0 && dimTrgWords == 1 ? maxOutputLength(state) : 0;
+
     rnn::States prevDecoderStates = state->getStates();
     rnn::States decoderStates;
     // apply decoder layers
@@ -802,7 +924,7 @@ public:
       std::string layerType = opt<std::string>("transformer-decoder-autoreg", "self-attention");
       rnn::State decoderState;
       if(layerType == "self-attention")
-        query = DecoderLayerSelfAttention(decoderState, prevDecoderState, prefix_ + "_l" + layerNo + "_self", query, selfMask, startPos);
+        query = DecoderLayerSelfAttention(decoderState, prevDecoderState, prefix_ + "_l" + layerNo + "_self", query, selfMask, startPos, dimCache);
       else if(layerType == "average-attention")
         query = DecoderLayerAAN(decoderState, prevDecoderState, prefix_ + "_l" + layerNo + "_aan", query, selfMask, startPos);
       else if(layerType == "rnn")
@@ -37,6 +37,9 @@ namespace marian {
   {
     auto graph = shared_from_this();
 
+    // the exported decoder state holds the self-attention inputs, not the key/value cache of the decoder
+    modelOptions = modelOptions->with("transformer-decoder-kv-cache", false);
+
     // get the model and the vocabularies
     auto model = std::dynamic_pointer_cast<IEncoderDecoder>(models::createModelFromOptions(modelOptions, models::usage::translation));
     std::vector<Ptr<Vocab>> vocabs;
@@ -2,6 +2,7 @@
 
 #include <cstdint>
 #include <deque>
+#include <map>
 #include <memory>
 #include <set>
 #include <unordered_map>
@@ -33,52 +34,55 @@ public:
   virtual const char* what() const noexcept override { return message_; }
 };
 
+// A free range of the allocator's memory given by its offset from the start of the device memory,
+// so gaps stay valid when the device memory is moved by grow()
 class Gap {
 private:
-  uint8_t* data_;
+  size_t offset_;
   size_t size_;
 
 public:
-  Gap(uint8_t* data, size_t size) : data_(data), size_(size) {}
+  Gap(size_t offset, size_t size) : offset_(offset), size_(size) {}
 
-  uint8_t* data() const { return data_; }
-  uint8_t* data() { return data_; }
+  size_t offset() const { return offset_; }
 
   size_t size() const { return size_; }
 
+  // ordered by size first for best-fit search
   bool operator<(const Gap& mp) const {
-    return (size_ < mp.size()) || (size_ == mp.size() && data_ < mp.data());
+    return (size_ < mp.size()) || (size_ == mp.size() && offset_ < mp.offset());
   }
 
   bool operator==(const Gap& mp) const {
-    return data_ == mp.data() && size_ == mp.size();
-  }
-
-  bool adjacent(const Gap& mp) const {
-    return data_ + size_ == mp.data() || mp.data() + mp.size() == data_;
-  }
-
-  friend Gap operator+(const Gap& mp1, const Gap& mp2) {
-    return Gap(mp1.data(), mp1.size() + mp2.size());
+    return offset_ == mp.offset() && size_ == mp.size();
   }
 
   friend std::ostream& operator<<(std::ostream& out, const Gap& gap) {
-    out << "gap - ptr: " << std::hex << (size_t)gap.data() << std::dec
-        << " size: " << gap.size();
+    out << "gap - offset: " << gap.offset() << " size: " << gap.size();
     return out;
   }
 
-  Gap combine(const Gap& mp) const {
-    if(mp.data() < this->data())
-      return mp + *this;
-    else
-      return *this + mp;
-  }
-
-  Gap rest(size_t offset) const { return Gap(data_ + offset, size_ - offset); }
+  Gap rest(size_t offset) const { return Gap(offset_ + offset, size_ - offset); }
 };
 
 class Allocator {
+public:
+  struct Stats {
+    size_t reserved{0};     // bytes of device memory
+    size_t used{0};         // bytes currently allocated
+    size_t peak{0};         // maximum of used since the last clear()
+    size_t gaps{0};         // number of free ranges
+    size_t largestGap{0};   // bytes of the largest free range
+    size_t allocations{0};  // number of alloc() calls since the last clear()
+    size_t grows{0};        // number of times the device memory was extended
+
+    // share of free memory that is not part of the largest free range
+    float fragmentation() const {
+      size_t available = reserved - used;
+      return available > 0 ? 1.f - (float)largestGap / available : 0.f;
+    }
+  };
+
 private:
   Ptr<Device> device_;
   size_t available_{0};
@@ -87,8 +91,14 @@ private:
 
   bool throw_{false};
 
-  std::set<Gap> gaps_;
-  std::unordered_map<uint8_t*, MemoryPiece::PtrType> allocated_;
+  std::set<Gap> gaps_;                                              // by size, for best-fit search
+  std::map<size_t, size_t> gapsByOffset_;                           // offset -> size, for merging neighbours
+  std::unordered_map<size_t, MemoryPiece::PtrType> allocated_;      // by offset
+  std::unordered_map<MemoryPiece*, MemoryPiece::PtrType> planned_;  // see allocIn()
+
+  size_t peak_{0};
+  size_t allocations_{0};
+  size_t grows_{0};
 
   void grow(size_t add) {
     add = alignedSize(add);
@@ -96,27 +106,21 @@ private:
     size_t oldSize = device_->size();
 
     device_->reserve(oldSize + add);
-
-    std::set<Gap> oldGaps;
-    gaps_.swap(oldGaps);
-
-    for(auto gap : oldGaps)
-      gaps_.insert(Gap(device_->data() + std::distance(oldData, gap.data()),
-                       gap.size()));
-    insertGap(Gap(device_->data() + oldSize, add));
-
-    std::unordered_map<uint8_t*, MemoryPiece::PtrType> oldAllocated;
-    allocated_.swap(oldAllocated);
-    for(auto it : oldAllocated) {
-      uint8_t* newPtr = device_->data() + std::distance(oldData, it.first);
-      allocated_[newPtr] = oldAllocated[it.first];
-      allocated_[newPtr]->setPtr(newPtr);
+    grows_++;
+
+    // gaps and allocations are kept by offset, only the pointers of handed out memory move
+    if(device_->data() != oldData) {
+      for(auto& it : allocated_)
+        it.second->setPtr(device_->data() + it.first);
+      for(auto& it : planned_)
+        it.second->setPtr(device_->data() + std::distance(oldData, it.second->data()));
     }
+    insertGap(Gap(oldSize, add));
   }
 
   Gap getGap(size_t size) {
     size = alignedSize(size);
-    auto it = std::lower_bound(gaps_.begin(), gaps_.end(), Gap(nullptr, size));
+    auto it = gaps_.lower_bound(Gap(0, size));
 
     if(throw_ && it == gaps_.end()) {
       //ABORT("Trying to allocate {}, but only {} available.", available_, size);
@@ -126,32 +130,41 @@ private:
     // @TODO: compact memory before re-allocation attempt, maybe by left shifting memory over currently largest gap
     while(it == gaps_.end()) {
       grow(step_);
-      it = std::lower_bound(gaps_.begin(), gaps_.end(), Gap(nullptr, size));
+      it = gaps_.lower_bound(Gap(0, size));
     }
 
     Gap gap = *it;
     gaps_.erase(it);
+    gapsByOffset_.erase(gap.offset());
 
     available_ -= gap.size();
     return gap;
   }
 
+  void removeGap(std::map<size_t, size_t>::iterator it) {
+    gaps_.erase(Gap(it->first, it->second));
+    gapsByOffset_.erase(it);
+  }
+
   void insertGap(Gap gap, bool consolidate = true) {
     available_ += gap.size();
     if(consolidate) {
-      auto it = gaps_.begin();
-      std::vector<decltype(it)> adjacent;
-      while(it != gaps_.end()) {
-        if(gap.adjacent(*it)) {
-          gap = gap.combine(*it);
-          adjacent.push_back(it);
+      // merge with the gaps directly before and after, if any
+      auto next = gapsByOffset_.lower_bound(gap.offset());
+      if(next != gapsByOffset_.begin()) {
+        auto prev = std::prev(next);
+        if(prev->first + prev->second == gap.offset()) {
+          gap = Gap(prev->first, prev->second + gap.size());
+          removeGap(prev);
         }
-        it++;
       }
-      for(auto&& a : adjacent)
-        gaps_.erase(a);
+      if(next != gapsByOffset_.end() && gap.offset() + gap.size() == next->first) {
+        gap = Gap(gap.offset(), gap.size() + next->second);
+        removeGap(next);
+      }
     }
     gaps_.insert(gap);
+    gapsByOffset_[gap.offset()] = gap.size();
   }
 
 public:
@@ -207,12 +220,31 @@ public:
       insertGap(gap.rest(bytes), false);
     }
 
-    auto ptr = gap.data();
-    auto mp = MemoryPiece::New(ptr, bytes);
-    allocated_[ptr] = mp;
+    auto mp = MemoryPiece::New(device_->data() + gap.offset(), bytes);
+    allocated_[gap.offset()] = mp;
+
+    allocations_++;
+    peak_ = std::max(peak_, device_->size() - available_);
     return mp;
   }
 
+  /**
+   * Hands out memory at a fixed offset within a block returned by alloc(), e.g. as computed by a
+   * MemoryPlanner. These pieces may overlap, so the caller is responsible for not using overlapping
+   * pieces at the same time. They are moved along with the block if the allocator grows and free()
+   * only unregisters them; the block has to outlive them.
+   */
+  MemoryPiece::PtrType allocIn(MemoryPiece::PtrType block, size_t offset, size_t bytes) {
+    ABORT_IF(offset + bytes > block->size(),
+             "Piece of {} bytes at offset {} exceeds block of {} bytes", bytes, offset, block->size());
+    auto mp = MemoryPiece::New(block->data() + offset, bytes);
+    planned_[mp.get()] = mp;
+    return mp;
+  }
+
+  // Number of pieces handed out by allocIn() that have not been freed yet
+  size_t planned() const { return planned_.size(); }
+
   bool free(uint8_t* ptr, size_t bytes) {
     bytes = alignedSize(bytes);
 
@@ -221,17 +253,18 @@ public:
     if(!ptr)
       return false;
 
-    auto it = allocated_.find(ptr);
+    size_t offset = std::distance(device_->data(), ptr);
+    auto it = allocated_.find(offset);
     if(it != allocated_.end()) {
-      allocated_.erase(ptr);
-      insertGap(Gap(ptr, bytes), true);
+      allocated_.erase(it);
+      insertGap(Gap(offset, bytes), true);
       return true;
     }
     return false;
   }
 
   bool free(MemoryPiece::PtrType mp) {
-    if(free(mp->data(), mp->size())) {
+    if(planned_.erase(mp.get()) || free(mp->data(), mp->size())) {
       mp->set(nullptr, 0);
       return true;
     }
@@ -241,8 +274,12 @@ public:
   void clear() {
     available_ = 0;
     gaps_.clear();
+    gapsByOffset_.clear();
     allocated_.clear();
-    insertGap({device_->data(), device_->size()}, false);
+    planned_.clear();
+    peak_ = 0;
+    allocations_ = 0;
+    insertGap({0, device_->size()}, false);
   }
 
   MemoryPiece::PtrType memory() {
@@ -254,5 +291,17 @@ public:
   size_t available() { return available_; }
 
   DeviceId getDeviceId() { return device_->getDeviceId(); }
+
+  Stats stats() const {
+    Stats stats;
+    stats.reserved = device_->size();
+    stats.used = stats.reserved - available_;
+    stats.peak = peak_;
+    stats.gaps = gaps_.size();
+    stats.largestGap = gaps_.empty() ? 0 : gaps_.rbegin()->size();
+    stats.allocations = allocations_;
+    stats.grows = grows_;
+    return stats;
+  }
 };
 }  // namespace marian
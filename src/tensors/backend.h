@@ -10,7 +10,9 @@ typedef enum {
   Auto = 0,            // auto tuning between available GEMMs
   Float32 = 1,         // MKL based GEMM, fp32
   FbFp16Packed = 10,   // FBGEMM based fp16 GEMM with packing
-  FbInt8Packed = 11    // FBGEMM based int8 GEMM with packing
+  FbInt8Packed = 11,   // FBGEMM based int8 GEMM with packing
+  IntgemmInt8 = 20,    // intgemm based int8 GEMM for products of activations, parameters select intgemm by their type
+  IntgemmInt16 = 21    // intgemm based int16 GEMM for products of activations, parameters select intgemm by their type
 } GemmType;
 
 class Backend {
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "tensors/cpu/parallel.h"
 #include "tensors/tensor.h"
 
 namespace marian {
@@ -73,7 +74,32 @@ void element(const Functor& functor, marian::Tensor out, Tensors... tensors) {
   // call elementwise operation going from outer-most dimension
   // to inner-most element.
   F::Array<F::Tensor<ElementType>, argNum> gTensors = {out, tensors...};
-  E<0>::element(functor, gTensors, indices);
+
+  constexpr size_t N = F::Shape::size();
+  const auto& shape = gTensors[0].shape();
+  size_t cols = shape[N - 1];
+  size_t rows = cols > 0 ? shape.elements() / cols : 0;
+  if(rows * cols < MIN_ELEMENTS_PER_CHUNK || IntraOpThreadPool::global().size() == 1) {
+    E<0>::element(functor, gTensors, indices);
+    return;
+  }
+
+  // with intra-op threads, split the outer dimensions into ranges of rows and
+  // run the loop over the inner-most dimension for each row
+  parallelForRows(rows, cols, [&](size_t begin, size_t end) {
+    for(size_t row = begin; row < end; ++row) {
+      F::Array<int, argNum> rowIndices;
+      rowIndices.fill(0);
+      size_t rest = row;
+      for(int i = (int)N - 2; i >= 0; --i) {
+        int index = (int)(rest % shape[i]);
+        rest /= shape[i];
+        for(size_t k = 0; k < argNum; ++k)
+          rowIndices[k] += index * gTensors[k].shape().bstride(i);
+      }
+      E<N - 1>::element(functor, gTensors, rowIndices);
+    }
+  });
 }
 
 // Dispatch elementwise functions with float element type based on number of 
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "common/binary.h"
 #include "graph/expression_graph.h"
 #include "fbgemm/packed_gemm.h"
 #include "tensors/cpu/integer_common.h"
@@ -26,9 +27,119 @@ public:
 
   virtual ~ExpressionGraphPackable() {}
 
+private:
+#if COMPILE_CPU
+  // Quantizes and prepares a matrix for the given intgemm type, storing the quantization multiplier at the end
+  io::Item packIntgemm(Tensor val, const std::string& name, Type gemmElementType) {
+    using cpu::integer::cols;
+    using cpu::integer::rows;
+    auto allocator = New<TensorAllocator>(getBackend());
+
+    Tensor paramMat; //This allocates extra 4 bytes at the end because of gemmElementType
+    allocator->allocate(paramMat, val->shape(), gemmElementType);
+
+    // Compute QuantMultiplier, compress matrix and store quantMult at the end.
+    // We need to tranpose first, because of our architecture independet format requiring a transposed matrix
+    Tensor tmp;
+    allocator->allocate(tmp, val->shape(), val->type());
+    cpu::Transpose10(tmp, val);
+
+    if(sizeOf(gemmElementType) == 1) { // is 8-bit Intgemm type
+      float quantMult = cpu::integer::computeQuantMult<Type::intgemm8>(val);
+
+      // Hardware-specific conversions which allow to implement memory-mapping and avoid conversion at runtime
+      if(isSsse3(gemmElementType)) {
+        intgemm::ssse3::Kernels8::PrepareBTransposed(tmp->data(), /*input*/
+                                                paramMat->data<int8_t>(), /*output*/
+                                                quantMult, /*Quant Mult*/
+                                                rows(val),
+                                                cols(val));
+      } else if(isAvx2(gemmElementType)) {
+        intgemm::avx2::Kernels8::PrepareBTransposed(tmp->data(), /*input*/
+                                               paramMat->data<int8_t>(), /*output*/
+                                               quantMult, /*Quant Mult*/
+                                               rows(val),
+                                               cols(val));
+      } else if(isAvx512(gemmElementType)) {
+        intgemm::avx512bw::Kernels8::PrepareBTransposed(tmp->data(), /*input*/
+                                                 paramMat->data<int8_t>(), /*output*/
+                                                 quantMult, /*Quant Mult*/
+                                                 rows(val),
+                                                 cols(val));
+      } else {
+        ABORT_IF(gemmElementType != Type::intgemm8, "Type {} is not supported", gemmElementType); // shouldn't really happen, but let's make sure
+        intgemm::Int8::PrepareA(tmp->data(), /*input*/
+                                paramMat->data<int8_t>(), /*output*/
+                                quantMult, /*Quant Mult*/
+                                rows(val),
+                                cols(val));
+      }
+      //Put the quantMult at the back of the tensor
+      cpu::integer::getQuantMult<Type::intgemm8>(paramMat) = quantMult;
+
+    } else if(sizeOf(gemmElementType) == 2) { // is 16-bit Intgemm type
+      float quantMult = cpu::integer::computeQuantMult<Type::intgemm16>(val);
+
+      // Hardware-specific conversions which allow to implement memory-mapping and avoid conversion at runtime
+      if(isSse2(gemmElementType)) {
+        intgemm::sse2::Kernels16::PrepareBTransposed(tmp->data(), /*input*/
+                                                paramMat->data<int16_t>(), /*output*/
+                                                quantMult, /*Quant Mult*/
+                                                rows(val),
+                                                cols(val));
+      } else if(isAvx2(gemmElementType)) {
+        intgemm::avx2::Kernels16::PrepareBTransposed(tmp->data(), /*input*/
+                                                paramMat->data<int16_t>(), /*output*/
+                                                quantMult, /*Quant Mult*/
+                                                rows(val),
+                                                cols(val));
+      } else if(isAvx512(gemmElementType)) {
+        intgemm::avx512bw::Kernels16::PrepareBTransposed(tmp->data(), /*input*/
+                                                  paramMat->data<int16_t>(), /*output*/
+                                                  quantMult, /*Quant Mult*/
+                                                  rows(val),
+                                                  cols(val));
+      } else {
+        ABORT_IF(gemmElementType != Type::intgemm16, "Type {} is not supported", gemmElementType); // shouldn't really happen, but let's make sure
+        intgemm::Int16::PrepareA(tmp->data(), /*input*/
+                                 paramMat->data<int16_t>(), /*output*/
+                                 quantMult, /*Quant Mult*/
+                                 rows(val),
+                                 cols(val));
+      }
+      //Put the quantMult at the back of the tensor
+      cpu::integer::getQuantMult<Type::intgemm16>(paramMat) = quantMult;
+      
+    } else {
+      ABORT("Incorrect Intgemm type size: {}", sizeOf(gemmElementType));
+    }
+
+    //Save... Same as the fbgemm case
+    io::Item item;
+    item.name = name;
+    item.shape = val->shape();
+    item.type = gemmElementType;
+
+    auto mem = paramMat->memory();
+    item.bytes.resize(mem->size());
+    copy(backend_, mem->data<char>(), mem->data<char>() + mem->size(), item.bytes.data());
+    return item;
+  }
+#endif
+
+public:
   // Convert model weights into packed format and save to IO items.
+  // For intgemm, variantTypes are hardware-specific types for which the weights are stored in addition.
   // @TODO: review this
-  void packAndSave(const std::string& name, const std::string& meta, Type gemmElementType = Type::float32, Type saveElementType = Type::float32) {
+  void packAndSave(const std::string& name,
+                   const std::string& meta,
+                   Type gemmElementType = Type::float32,
+                   Type saveElementType = Type::float32,
+                   const std::vector<Type>& variantTypes = {}) {
+    for(auto variantType : variantTypes)
+      ABORT_IF(!isIntgemm(gemmElementType) || !isIntgemm(variantType) || sizeOf(variantType) != sizeOf(gemmElementType),
+               "Variant type {} has to be an intgemm type with the same bit width as GEMM type {}", variantType, gemmElementType);
+
     std::vector<io::Item> ioItems;
 
     // sorted by name in std::map
@@ -150,101 +261,17 @@ public:
       } else if (isIntgemm(gemmElementType) &&
       (pName.find("_W") == pName.length() - 3 || pName.find("_W") == pName.length() - 2 /* || pName.find("Wemb") != std::string::npos*/)) {
 #if COMPILE_CPU
-        using cpu::integer::cols;
-        using cpu::integer::rows;
-        auto allocator = New<TensorAllocator>(getBackend());
-
-        Tensor paramMat; //This allocates extra 4 bytes at the end because of gemmElementType
-        allocator->allocate(paramMat, val->shape(), gemmElementType);
-
-        // Compute QuantMultiplier, compress matrix and store quantMult at the end.
-        // We need to tranpose first, because of our architecture independet format requiring a transposed matrix
-        Tensor tmp;
-        allocator->allocate(tmp, val->shape(), val->type());
-        cpu::Transpose10(tmp, val);
-  
-        if(sizeOf(gemmElementType) == 1) { // is 8-bit Intgemm type
-          float quantMult = cpu::integer::computeQuantMult<Type::intgemm8>(val);
-
-          // Hardware-specific conversions which allow to implement memory-mapping and avoid conversion at runtime
-          cpu::integer::passOrAbort(gemmElementType); // Check if the hardware supports the GEMM type
-          if(isSsse3(gemmElementType)) {
-            intgemm::ssse3::Kernels8::PrepareBTransposed(tmp->data(), /*input*/
-                                                    paramMat->data<int8_t>(), /*output*/
-                                                    quantMult, /*Quant Mult*/
-                                                    rows(val),
-                                                    cols(val));
-          } else if(isAvx2(gemmElementType)) {
-            intgemm::avx2::Kernels8::PrepareBTransposed(tmp->data(), /*input*/
-                                                   paramMat->data<int8_t>(), /*output*/
-                                                   quantMult, /*Quant Mult*/
-                                                   rows(val),
-                                                   cols(val));
-          } else if(isAvx512(gemmElementType)) {
-            intgemm::avx512bw::Kernels8::PrepareBTransposed(tmp->data(), /*input*/
-                                                     paramMat->data<int8_t>(), /*output*/
-                                                     quantMult, /*Quant Mult*/
-                                                     rows(val),
-                                                     cols(val));
-          } else {
-            ABORT_IF(gemmElementType != Type::intgemm8, "Type {} is not supported", gemmElementType); // shouldn't really happen, but let's make sure
-            intgemm::Int8::PrepareA(tmp->data(), /*input*/
-                                    paramMat->data<int8_t>(), /*output*/
-                                    quantMult, /*Quant Mult*/
-                                    rows(val),
-                                    cols(val));
-          }
-          //Put the quantMult at the back of the tensor
-          cpu::integer::getQuantMult<Type::intgemm8>(paramMat) = quantMult;
-
-        } else if(sizeOf(gemmElementType) == 2) { // is 16-bit Intgemm type
-          float quantMult = cpu::integer::computeQuantMult<Type::intgemm16>(val);
-
-           // Hardware-specific conversions which allow to implement memory-mapping and avoid conversion at runtime
-           cpu::integer::passOrAbort(gemmElementType); // Check if the hardware supports the GEMM type
-          if(isSse2(gemmElementType)) {
-            intgemm::sse2::Kernels16::PrepareBTransposed(tmp->data(), /*input*/
-                                                    paramMat->data<int16_t>(), /*output*/
-                                                    quantMult, /*Quant Mult*/
-                                                    rows(val),
-                                                    cols(val));
-          } else if(isAvx2(gemmElementType)) {
-            intgemm::avx2::Kernels16::PrepareBTransposed(tmp->data(), /*input*/
-                                                    paramMat->data<int16_t>(), /*output*/
-                                                    quantMult, /*Quant Mult*/
-                                                    rows(val),
-                                                    cols(val));
-          } else if(isAvx512(gemmElementType)) {
-            intgemm::avx512bw::Kernels16::PrepareBTransposed(tmp->data(), /*input*/
-                                                      paramMat->data<int16_t>(), /*output*/
-                                                      quantMult, /*Quant Mult*/
-                                                      rows(val),
-                                                      cols(val));
-          } else {
-            ABORT_IF(gemmElementType != Type::intgemm16, "Type {} is not supported", gemmElementType); // shouldn't really happen, but let's make sure
-            intgemm::Int16::PrepareA(tmp->data(), /*input*/
-                                     paramMat->data<int16_t>(), /*output*/
-                                     quantMult, /*Quant Mult*/
-                                     rows(val),
-                                     cols(val));
+        cpu::integer::passOrAbort(gemmElementType); // Check if the hardware supports the GEMM type
+        ioItems.emplace_back(packIntgemm(val, pName, gemmElementType));
+
+        // Hardware-specific variants, the loader selects the best one the CPU supports
+        for(auto variantType : variantTypes) {
+          if(cpu::integer::intgemmTypeRank(variantType) < 0) {
+            LOG_ONCE(warn, "This CPU cannot prepare intgemm matrices for {}, skipping that variant", variantType);
+            continue;
           }
-          //Put the quantMult at the back of the tensor
-          cpu::integer::getQuantMult<Type::intgemm16>(paramMat) = quantMult;
-          
-        } else {
-          ABORT("Incorrect Intgemm type size: {}", sizeOf(gemmElementType));
+          ioItems.emplace_back(packIntgemm(val, io::binary::intgemmVariantName(pName, variantType), variantType));
         }
-
-        //Save... Same as the fbgemm case
-        io::Item item;
-        item.name = pName;
-        item.shape = val->shape();
-        item.type = gemmElementType;
-
-        auto mem = paramMat->memory();
-        item.bytes.resize(mem->size());
-        copy(backend_, mem->data<char>(), mem->data<char>() + mem->size(), item.bytes.data());
-        ioItems.emplace_back(std::move(item));
 #else
         ABORT("Packed type {} only supported when compiled with -DCOMPILE_CPU=on", gemmElementType);
 #endif
@@ -215,10 +215,13 @@ private:
   size_t k_;
   bool transA_;
   bool transB_;
+  Activation activation_;
 
 public:
-  FbgemmPacked16AffineNodeOp(const std::vector<Expr>& nodes, Shape bShape, bool transA, bool transB, float /*scalar*/)
-    : NaryNodeOp(nodes, newShape(nodes[0], bShape, transA, transB), Type::float32)/*, scalar_(scalar)*/ {
+  FbgemmPacked16AffineNodeOp(const std::vector<Expr>& nodes, Shape bShape, bool transA, bool transB, float /*scalar*/,
+                             Activation activation = Activation::none)
+    : NaryNodeOp(nodes, newShape(nodes[0], bShape, transA, transB), Type::float32)/*, scalar_(scalar)*/,
+      activation_(activation) {
     transA_ = transA;
     transB_ = transB;
     m_ = nodes[0]->shape().elements() / nodes[0]->shape()[-1];
@@ -261,7 +264,8 @@ public:
                                 children().size() > 2 ? child(2)->val() : nullptr, // pass only if it has a bias
                                 m_,
                                 n_,
-                                transA_))
+                                transA_);
+             AddBiasAndActivate(val_, /*bias=*/nullptr, activation_)) // the bias is added by the GEMM
     };
 #else // USE_FBGEMM
     ABORT("FbgemmPacked16AffineNodeOp can only be used with FBGEMM enabled.");
@@ -275,6 +279,21 @@ public:
   }
 
   const std::string type() override { return "gemmPacked16"; }
+
+  virtual size_t hash() override {
+    size_t seed = NaryNodeOp::hash();
+    util::hash_combine(seed, (uint8_t)activation_);
+    return seed;
+  }
+
+  virtual bool equal(Expr node) override {
+    if(!NaryNodeOp::equal(node))
+      return false;
+    auto cnode = std::dynamic_pointer_cast<FbgemmPacked16AffineNodeOp>(node);
+    if(!cnode)
+      return false;
+    return activation_ == cnode->activation_;
+  }
 };
 
 // Affine transform (matrix multiplication) using packed B matrix
@@ -293,6 +312,7 @@ private:
   bool transA_;
   bool transB_;
   Type elementType_;
+  Activation activation_;
 
 public:
   FbgemmPacked8AffineNodeOp(Type elementType,
@@ -300,9 +320,11 @@ public:
                             Shape bShape,
                             bool transA,
                             bool transB,
-                            float /*scalar*/)
+                            float /*scalar*/,
+                            Activation activation = Activation::none)
       : NaryNodeOp(nodes, newShape(nodes[0], bShape, transA, transB), Type::float32),
-        elementType_(elementType) {
+        elementType_(elementType),
+        activation_(activation) {
     transA_ = transA;
     transB_ = transB;
     m_ = nodes[0]->shape().elements() / nodes[0]->shape()[-1];
@@ -339,29 +361,17 @@ public:
   NodeOps forwardOps() override {
     NodeOps nodeOps;
 #if USE_FBGEMM
-    // Do addBias only if it has a bias term
-    if (children().size() > 2) {
-      nodeOps = { NodeOp(fbgemmPacked8Gemm(elementType_,
-                                           val_,
-                                           child(0)->val(),
-                                           child(1)->val(),
-                                           m_,
-                                           n_,
-                                           k_,
-                                           transA_,
-                                           transB_);
-                       marian::cpu::integer::AddBias(val_, child(2)->val())) };
-    } else {
-      nodeOps = { NodeOp(fbgemmPacked8Gemm(elementType_,
-                                           val_,
-                                           child(0)->val(),
-                                           child(1)->val(),
-                                           m_,
-                                           n_,
-                                           k_,
-                                           transA_,
-                                           transB_)) };
-    }
+    // Add the bias, if there is a bias term, and apply the activation in one pass after the GEMM
+    nodeOps = { NodeOp(fbgemmPacked8Gemm(elementType_,
+                                         val_,
+                                         child(0)->val(),
+                                         child(1)->val(),
+                                         m_,
+                                         n_,
+                                         k_,
+                                         transA_,
+                                         transB_);
+                       AddBiasAndActivate(val_, children().size() > 2 ? child(2)->val() : nullptr, activation_)) };
 #else // USE_FBGEMM
     ABORT("FbgemmPacked8AffineNodeOp can only be used with FBGEMM enabled.");
 #endif  // USE_FBGEMM
@@ -375,6 +385,21 @@ public:
   }
 
   const std::string type() override { return "gemmPacked8"; }
+
+  virtual size_t hash() override {
+    size_t seed = NaryNodeOp::hash();
+    util::hash_combine(seed, (uint8_t)activation_);
+    return seed;
+  }
+
+  virtual bool equal(Expr node) override {
+    if(!NaryNodeOp::equal(node))
+      return false;
+    auto cnode = std::dynamic_pointer_cast<FbgemmPacked8AffineNodeOp>(node);
+    if(!cnode)
+      return false;
+    return activation_ == cnode->activation_;
+  }
 };
 
 static inline Expr affine(Type elementType,
@@ -384,14 +409,15 @@ static inline Expr affine(Type elementType,
                           Expr c,
                           bool transA,
                           bool transB,
-                          float scalar) {
+                          float scalar,
+                          Activation activation = Activation::none) {
   std::vector<Expr> nodes = {a, b, c};
 
   if (elementType == Type::packed16)
-    return Expression<FbgemmPacked16AffineNodeOp>(nodes, bShape, transA, transB, scalar);
+    return Expression<FbgemmPacked16AffineNodeOp>(nodes, bShape, transA, transB, scalar, activation);
   else if (isPacked(elementType) && sizeOf(elementType) == 1)
     return Expression<cpu::variant::FbgemmPacked8AffineNodeOp>(
-        elementType, nodes, bShape, transA, transB, scalar);
+        elementType, nodes, bShape, transA, transB, scalar, activation);
   else {
     ABORT("Only int8 and fp16 are available. {}", elementType);
     return nullptr;
@@ -409,6 +435,31 @@ static inline Expr pack(Type elementType, Expr a, PackMatrix packMat, bool trans
   }
 }
 
+// Selects columns of a packed int8 matrix in its packed format, e.g. the shortlist of the output layer,
+// instead of gathering from the packed memory or unpacking it
+static inline Expr selectColumns(Expr b, Expr indices) {
+  Type elementType = b->value_type();
+  ABORT_IF(!isPacked(elementType) || sizeOf(elementType) != 1,
+           "Columns can only be selected from packed int8 matrices, not {}", elementType);
+
+  Shape outShape = b->shape();
+  outShape.set(-1, (int)indices->shape().elements());
+
+#if USE_FBGEMM
+  auto selectNodeOp = [elementType](Expr out, const std::vector<Expr>& children) {
+    fbgemmPacked8SelectColumns(out->val(),
+                               children[0]->val(),
+                               elementType,
+                               children[1]->val()->data<IndexType>(),
+                               children[1]->shape().elements());
+  };
+  return lambda({b, indices}, outShape, elementType, selectNodeOp); // inference-only Lambda node
+#else // USE_FBGEMM
+  outShape;
+  ABORT("Packed GEMM is not available in this build");
+#endif  // USE_FBGEMM
+}
+
 static inline Expr dot(Type elementType, Expr a, Expr b, Shape bShape, bool transA, bool transB, float scalar) {
   std::vector<Expr> nodes = {a, b};
 
@@ -636,6 +636,51 @@ void fbgemmPacked8Gemm(Type packType,
   fbgemmPacked(packA, repackedB, C->data(), (int32_t*)C->data(), (int32_t) n, outputProcObj, 0, 1, params);
 }
 
+void fbgemmPacked8SelectColumns(marian::Tensor out,
+                                const marian::Tensor in,
+                                const marian::Type packType,
+                                const IndexType* indices,
+                                const size_t numIndices) {
+  int k, n, selectedK, selectedN;
+  uint64_t packsize, selectedPacksize;
+  fbgemmPacked8PackInfo(in->shape(), packType, false, k, n, packsize);
+  fbgemmPacked8PackInfo(out->shape(), packType, false, selectedK, selectedN, selectedPacksize);
+  ABORT_IF(selectedK != k || selectedN != (int)numIndices,
+           "Packed matrix {} does not hold {} columns selected from packed matrix {}", out->shape(), numIndices, in->shape());
+
+  const fbgemm::BlockingFactors* params = getBlockingFactors(packType);
+
+  int8_t* packedBuf = in->data<int8_t>();
+  int8_t* selectedBuf = out->data<int8_t>();
+  // padding of the blocks has to be zero, as after packing
+  std::fill(selectedBuf, selectedBuf + selectedPacksize, (int8_t)0);
+
+  // wrap the pre-packed memory to look up the position of each element in the packed layout
+  PackBMatrix<int8_t> packedB(matrix_op_t::NoTranspose, k, n, packedBuf, n, 1, params);
+  PackBMatrix<int8_t> selectedB(matrix_op_t::NoTranspose, k, selectedN, selectedBuf, selectedN, 1, params);
+  for(int jj = 0; jj < selectedN; jj++) {
+    int col = (int)indices[jj];
+    ABORT_IF(col >= n, "Column index {} out of range for packed matrix {}", col, in->shape());
+    for(int ii = 0; ii < k; ii++)
+      selectedBuf[selectedB.addr(ii, jj)] = packedBuf[packedB.addr(ii, col)];
+  }
+
+  // quantization scales, offsets and column offsets are stored per column at the end
+  const char* meta = (const char*)packedBuf + (packsize - n * (sizeof(float) + sizeof(int32_t) + sizeof(int32_t)));
+  char* selectedMeta = (char*)selectedBuf + (selectedPacksize - selectedN * (sizeof(float) + sizeof(int32_t) + sizeof(int32_t)));
+  const float* quantScaleB = (const float*)meta;
+  const int32_t* quantZeropointB = (const int32_t*)(meta + n * sizeof(float));
+  const int32_t* colOffsets = (const int32_t*)(meta + n * (sizeof(float) + sizeof(int32_t)));
+  float* selectedQuantScaleB = (float*)selectedMeta;
+  int32_t* selectedQuantZeropointB = (int32_t*)(selectedMeta + selectedN * sizeof(float));
+  int32_t* selectedColOffsets = (int32_t*)(selectedMeta + selectedN * (sizeof(float) + sizeof(int32_t)));
+  for(int jj = 0; jj < selectedN; jj++) {
+    selectedQuantScaleB[jj] = quantScaleB[indices[jj]];
+    selectedQuantZeropointB[jj] = quantZeropointB[indices[jj]];
+    selectedColOffsets[jj] = colOffsets[indices[jj]];
+  }
+}
+
 #endif // USE_FBGEMM
 
 }  // namespace variant
@@ -110,6 +110,19 @@ void fbgemmPacked8Pack(marian::Tensor out,
                        const uint64_t packsize,
                        const float quantRangeStdDevs = 0.f); // @TODO: change to size_t where appropriate
 
+// Select columns of a packed int8 B matrix without unpacking it, e.g. the shortlist of an output layer
+// The result is the same as packing the selected columns of the original matrix.
+// out: output tensor - packed format, k x the number of selected columns
+// in: input tensor - packed format, k x n, packed without transposition
+// packType: Type of both matrices - packed8avx2 or packed8avx512
+// indices: the columns to select
+// numIndices: the number of columns to select
+void fbgemmPacked8SelectColumns(marian::Tensor out,
+                                const marian::Tensor in,
+                                const marian::Type packType,
+                                const IndexType* indices,
+                                const size_t numIndices);
+
 // GEMM operation on the packed B matrix
 // C: output matrix
 // A: A matrix
@@ -1,8 +1,39 @@
 #include "integer_common.h"
+#include "3rd_party/yaml-cpp/yaml.h"
+#include "common/file_stream.h"
 
 namespace marian {
 namespace cpu {
 namespace integer {
+
+ActivationCalibrator& ActivationCalibrator::global() {
+  static ActivationCalibrator calibrator;
+  return calibrator;
+}
+
+void ActivationCalibrator::record(const std::string& name, float maxAbs) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto& range = maxAbs_[name];
+  range = std::max(range, maxAbs);
+}
+
+void ActivationCalibrator::save(const std::string& fileName) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  YAML::Node ranges;
+  for(auto& range : maxAbs_)
+    ranges[range.first] = range.second;
+
+  io::OutputFileStream out(fileName);
+  out << ranges << std::endl;
+  LOG(info, "[calibration] Saved activation ranges of {} matrices to {}", maxAbs_.size(), fileName);
+}
+
+std::map<std::string, float> ActivationCalibrator::load(const std::string& fileName) {
+  io::InputFileStream in(fileName);
+  YAML::Node ranges = YAML::Load(in);
+  ABORT_IF(!ranges.IsMap(), "Activation ranges in {} are not a map from parameter names to values", fileName);
+  return ranges.as<std::map<std::string, float>>();
+}
 // This operates on floats after processing so doesn't care about int8_t vs int16_t.
 void AddBias(marian::Tensor C, const marian::Tensor Bias) {
   float* y = C->data();
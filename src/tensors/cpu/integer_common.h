@@ -35,13 +35,46 @@ namespace intgemm {
 #include <immintrin.h>
 #include <tmmintrin.h>
 #include <xmmintrin.h>
+#include <atomic>
 #include <cassert>
 #include <cstddef>
+#include <map>
+#include <mutex>
 
 namespace marian {
 namespace cpu {
 namespace integer {
 
+// Suffix of the parameter that holds the fixed quantization multiplier for the activations multiplied
+// with the intgemm8 parameter of the same name without suffix, see ActivationCalibrator.
+const std::string QUANT_MULT_A_SUFFIX = "_QuantMultA";
+
+/*
+ * Records the largest absolute value of the activations multiplied with each intgemm parameter matrix
+ * while decoding with --intgemm-calibrate. marian-conv --activation-ranges turns the recorded ranges
+ * into fixed quantization multipliers stored in the model, so that activations no longer need a pass
+ * to find their range at every multiplication and the results do not depend on the batch composition.
+ */
+class ActivationCalibrator {
+private:
+  std::atomic<bool> enabled_{false};
+  std::mutex mutex_;
+  std::map<std::string, float> maxAbs_; // parameter name -> largest absolute activation value
+
+public:
+  static ActivationCalibrator& global();
+
+  void enable() { enabled_ = true; }
+  bool enabled() const { return enabled_; }
+
+  void record(const std::string& name, float maxAbs);
+
+  // Writes the recorded ranges as a YAML map from parameter names to largest absolute values
+  void save(const std::string& fileName);
+
+  static std::map<std::string, float> load(const std::string& fileName);
+};
+
 //Convenient function to get rows and columns of a tensor, shadowed by namespace.
 inline int cols(Tensor& tensor) { return tensor->shape()[-1]; }
 inline int rows(Tensor& tensor) { return tensor->shape().elements() / cols(tensor); }
@@ -141,6 +174,37 @@ static inline Type getIntgemmType(Type vtype) {
 #endif
 }
 
+/*
+ * Ranks an intgemm type by the instruction set it needs: -1 if the CPU does not support it, 0 for
+ * the hardware non-specific types that have to be prepared at load time, higher values for
+ * hardware-specific types that use more recent instructions. Used to pick one of several variants
+ * of a matrix stored in a binary model.
+ */
+static inline int intgemmTypeRank(Type vtype) {
+#if COMPILE_CPU
+  intgemm::CPUType required;
+  if (vtype == Type::intgemm8 || vtype == Type::intgemm16) {
+    return 0;
+  } else if (vtype == Type::intgemm16sse2) {
+    required = intgemm::CPUType::SSE2;
+  } else if (vtype == Type::intgemm8ssse3) {
+    required = intgemm::CPUType::SSSE3;
+  } else if (vtype == Type::intgemm8avx2 || vtype == Type::intgemm16avx2) {
+    required = intgemm::CPUType::AVX2;
+  } else if (vtype == Type::intgemm8avx512 || vtype == Type::intgemm16avx512) {
+    required = intgemm::CPUType::AVX512BW;
+  } else if (vtype == Type::intgemm8avx512vnni) {
+    required = intgemm::CPUType::AVX512VNNI;
+  } else {
+    return -1;
+  }
+  return intgemm::kCPU >= required ? (int)required + 1 : -1;
+#else
+  vtype;
+  return -1;
+#endif
+}
+
 static inline bool passOrAbort(Type vtype) {
 #if COMPILE_CPU
   if (vtype == Type::intgemm8 || vtype == Type::intgemm16) {
@@ -3,6 +3,7 @@
 #include "graph/node.h"
 #include "graph/node_operators_unary.h"
 #include "integer_common.h"
+#include "tensors/cpu/parallel.h"
 
 namespace marian {
 
@@ -13,12 +14,17 @@ namespace integer {
 /*
  * Prepare an activation matrix into intgemm8/16 format. For now the activation matrix is just quantized.
  * Expr input: The input tensor
+ * Expr quantMultA: Fixed quantization multiplier from calibration, computed from the input if nullptr
+ * std::string calibrationName: Name under which the range of the input is recorded with --intgemm-calibrate
  */
 template<Type vtype>
-static inline Expr prepareA(Expr a) {
-  auto nodeOp = [](Expr out, const std::vector<Expr>& children) {
+static inline Expr prepareA(Expr a, Expr quantMultA = nullptr, const std::string& calibrationName = "") {
+  auto nodeOp = [calibrationName](Expr out, const std::vector<Expr>& children) {
     Expr in = children[0];
-    auto quantMult = computeQuantMult<vtype>(in->val());
+    if(!calibrationName.empty() && ActivationCalibrator::global().enabled())
+      ActivationCalibrator::global().record(calibrationName, intgemm::MaxAbsolute(in->val()->data(), in->val()->data() + in->val()->size()));
+
+    float quantMult = children.size() > 1 ? children[1]->val()->data()[0] : computeQuantMult<vtype>(in->val());
     typedef typename intgemm_<vtype>::type Integer;
     intgemm_<vtype>::width::PrepareA(in->val()->data(), /*input*/
                                      out->val()->data<Integer>(), /*output*/
@@ -28,7 +34,22 @@ static inline Expr prepareA(Expr a) {
     getQuantMult<vtype>(out->val()) = quantMult;
   };
 
-  return lambda({a}, a->shape(), vtype, nodeOp);
+  std::vector<Expr> children = {a};
+  if(quantMultA)
+    children.push_back(quantMultA);
+  return lambda(children, a->shape(), vtype, nodeOp);
+}
+
+/*
+ * Returns the name of the parameter matrix b without the namespace of the graph, or an empty string
+ * if b is not a parameter, e.g. because it has been sliced for a shortlist.
+ */
+static inline std::string parameterName(Expr b) {
+  if(b->type() != "param")
+    return "";
+  std::string name = b->name();
+  auto pos = name.rfind("::");
+  return pos == std::string::npos ? name : name.substr(pos + 2);
 }
 #endif
 
@@ -40,16 +61,25 @@ static inline Expr prepareA(Expr a) {
  * bool transA - tranpose input A if true
  * bool transB - unused here (@TODO remove?)
  * float scale - scale the output by `scale`
+ * Activation activation - activation function applied to the output directly after the product
  * the template argument controls whether we're doing 16bit integers or 8bit integers. 
  * It can be Type::intgemm8 or Type::intgemm16 and all hardware-specific variants	
  */
 template<Type vtype>
-static inline Expr affineOrDotTyped(Expr a, Expr bQuant, Expr bias, bool transA, bool /*transB*/, float scale) {
+static inline Expr affineOrDotTyped(Expr a, Expr bQuant, Expr bias, bool transA, bool /*transB*/, float scale,
+                                    Activation activation = Activation::none) {
 #if COMPILE_CPU
   ABORT_IF(!isFloat(a->value_type()), "Intgemm expects type of A to be float32 not {}", a->value_type());
   ABORT_IF(!isIntgemm(bQuant->value_type()), "Intgemm expects type of B to be a variant of intgemm not {}", bQuant->value_type());
 
-  auto aQuant = prepareA<vtype>(transA ? transpose(a) : a); // A should not be quantized yet as seen above, hence quantize here
+  // 8-bit activations are quantized with a fixed multiplier if the model has been calibrated for this matrix,
+  // 16-bit activations always use a fixed multiplier
+  std::string bName = parameterName(bQuant);
+  Expr quantMultA = nullptr;
+  if(sizeOf(vtype) == 1 && !bName.empty() && !ActivationCalibrator::global().enabled())
+    quantMultA = a->graph()->get(bName + QUANT_MULT_A_SUFFIX);
+
+  auto aQuant = prepareA<vtype>(transA ? transpose(a) : a, quantMultA, bName); // A should not be quantized yet as seen above, hence quantize here
   
   // determine the output shape m x n for A: m x k and B: k x n
   // since we transpose A beforehand we don't need to take care of transposed shapes here 
@@ -85,6 +115,10 @@ static inline Expr affineOrDotTyped(Expr a, Expr bQuant, Expr bias, bool transA,
                                        cols(bQuant->val()),
                                        intgemm::callbacks::UnquantizeAndWrite(unquant_mult, /*output=*/out->val()->data()));
     }
+
+    // intgemm has no activation callbacks, so apply the activation in place without a separate node
+    if(activation != Activation::none)
+      AddBiasAndActivate(out->val(), /*bias=*/nullptr, activation);
   };
 
   std::vector<Expr> children = {aQuant, bQuant};
@@ -93,13 +127,14 @@ static inline Expr affineOrDotTyped(Expr a, Expr bQuant, Expr bias, bool transA,
 
   return lambda(children, outShape, Type::float32, dotOrAffineNodeOp); // inference-only Lambda node
 #else
-  a, bQuant, bias, transA, scale;
+  a, bQuant, bias, transA, scale, activation;
   ABORT("You need to enable CPU compilation to use this feature. Use cmake .. -DCOMPILE_CPU=ON");
 #endif
 }
 
 // Dispatch correct hardware-agnostic or hardware-specific matrix multiplies
-static inline Expr affineOrDot(Expr a, Expr bQuant, Expr bias, bool transA, bool transB, float scale) {
+static inline Expr affineOrDot(Expr a, Expr bQuant, Expr bias, bool transA, bool transB, float scale,
+                               Activation activation = Activation::none) {
   Type bQuantElementType = bQuant->value_type();
   static const bool pass = cpu::integer::passOrAbort(bQuantElementType);
   pass; // We declare this variable as static so that passOrAbort is only ever run once during the initialization.
@@ -107,26 +142,201 @@ static inline Expr affineOrDot(Expr a, Expr bQuant, Expr bias, bool transA, bool
     //case Type::intgemm8 :  // The generic case selects CPU automatically, but we set all the types manually anyways.
     //  return cpu::integer::affineOrDotTyped<Type::intgemm8>(a, bQuant, bias, transA, transB, scale);    
     case Type::intgemm8ssse3 :
-      return cpu::integer::affineOrDotTyped<Type::intgemm8ssse3>(a, bQuant, bias, transA, transB, scale);
+      return cpu::integer::affineOrDotTyped<Type::intgemm8ssse3>(a, bQuant, bias, transA, transB, scale, activation);
     case Type::intgemm8avx2 :
-      return cpu::integer::affineOrDotTyped<Type::intgemm8avx2>(a, bQuant, bias, transA, transB, scale);
+      return cpu::integer::affineOrDotTyped<Type::intgemm8avx2>(a, bQuant, bias, transA, transB, scale, activation);
     case Type::intgemm8avx512 :
-      return cpu::integer::affineOrDotTyped<Type::intgemm8avx512>(a, bQuant, bias, transA, transB, scale);
+      return cpu::integer::affineOrDotTyped<Type::intgemm8avx512>(a, bQuant, bias, transA, transB, scale, activation);
     case Type::intgemm8avx512vnni :
-      return cpu::integer::affineOrDotTyped<Type::intgemm8avx512vnni>(a, bQuant, bias, transA, transB, scale);
+      return cpu::integer::affineOrDotTyped<Type::intgemm8avx512vnni>(a, bQuant, bias, transA, transB, scale, activation);
     //case Type::intgemm16 :  // The generic case selects CPU automatically, but we set all the types manually anyways.
     //  return cpu::integer::affineOrDotTyped<Type::intgemm16>(a, bQuant, bias, transA, transB, scale);
     case Type::intgemm16sse2 :
-      return cpu::integer::affineOrDotTyped<Type::intgemm16sse2>(a, bQuant, bias, transA, transB, scale);
+      return cpu::integer::affineOrDotTyped<Type::intgemm16sse2>(a, bQuant, bias, transA, transB, scale, activation);
     case Type::intgemm16avx2 :
-      return cpu::integer::affineOrDotTyped<Type::intgemm16avx2>(a, bQuant, bias, transA, transB, scale);
+      return cpu::integer::affineOrDotTyped<Type::intgemm16avx2>(a, bQuant, bias, transA, transB, scale, activation);
     case Type::intgemm16avx512 :
-      return cpu::integer::affineOrDotTyped<Type::intgemm16avx512>(a, bQuant, bias, transA, transB, scale);
+      return cpu::integer::affineOrDotTyped<Type::intgemm16avx512>(a, bQuant, bias, transA, transB, scale, activation);
     default:
       ABORT("Unsupported type {} for Intgemm type??", bQuantElementType);
   }
 }
 
+/*
+ * Selects columns of a prepared B matrix in its hardware-specific format, e.g. the shortlist of the output layer,
+ * so that the selection stays quantized. intgemm requires the number of selected columns to be a multiple of 8,
+ * other selections (e.g. from LSH) are padded by repeating the last index. The result then has more columns
+ * than indices and callers have to drop the padding columns from the product.
+ */
+template<Type vtype>
+static inline Expr selectColumnsBTyped(Expr b, Expr indices) {
+#if COMPILE_CPU
+  auto selectNodeOp = [](Expr out, const std::vector<Expr>& children) {
+    Expr b       = children[0];
+    Expr indices = children[1];
+
+    typedef typename intgemm_<vtype>::type Integer;
+    const IndexType* begin = indices->val()->data<IndexType>();
+    std::vector<IndexType> padded(begin, begin + indices->shape().elements());
+    padded.resize(cols(out->val()), padded.back());
+    intgemm_<vtype>::width::SelectColumnsB(/*input=*/b->val()->data<Integer>(),
+                                           /*output=*/out->val()->data<Integer>(),
+                                           /*rows=*/rows(b->val()),
+                                           /*cols_begin=*/padded.data(),
+                                           /*cols_end=*/padded.data() + padded.size());
+    getQuantMult<vtype>(out->val()) = getQuantMult<vtype>(b->val());
+  };
+
+  int numIndices = (int)indices->shape().elements();
+  Shape outShape = b->shape();
+  outShape.set(-1, (numIndices + 7) / 8 * 8);
+  return lambda({b, indices}, outShape, vtype, selectNodeOp); // inference-only Lambda node
+#else
+  b, indices;
+  ABORT("You need to enable CPU compilation to use this feature. Use cmake .. -DCOMPILE_CPU=ON");
+#endif
+}
+
+static inline Expr selectColumnsB(Expr b, Expr indices) {
+  ABORT_IF(indices->shape().elements() == 0, "Cannot select an empty set of columns in intgemm");
+  switch(b->value_type()) {
+    case Type::intgemm8ssse3 :
+      return cpu::integer::selectColumnsBTyped<Type::intgemm8ssse3>(b, indices);
+    case Type::intgemm8avx2 :
+      return cpu::integer::selectColumnsBTyped<Type::intgemm8avx2>(b, indices);
+    case Type::intgemm8avx512 :
+      return cpu::integer::selectColumnsBTyped<Type::intgemm8avx512>(b, indices);
+    case Type::intgemm8avx512vnni :
+      return cpu::integer::selectColumnsBTyped<Type::intgemm8avx512vnni>(b, indices);
+    case Type::intgemm16sse2 :
+      return cpu::integer::selectColumnsBTyped<Type::intgemm16sse2>(b, indices);
+    case Type::intgemm16avx2 :
+      return cpu::integer::selectColumnsBTyped<Type::intgemm16avx2>(b, indices);
+    case Type::intgemm16avx512 :
+      return cpu::integer::selectColumnsBTyped<Type::intgemm16avx512>(b, indices);
+    default:
+      ABORT("Unsupported type {} for selecting columns in intgemm", b->value_type());
+  }
+}
+
+#if COMPILE_CPU
+/*
+ * Computes the batched product C[i] = scale * op(A[i]) * op(B[i]) of two activation tensors in intgemm, e.g.
+ * queries times keys and attention weights times values. Each matrix of A and B is quantized with its own
+ * multiplier, i.e. per sentence and head in attention, and prepared as the B operand on the fly. The inner
+ * dimension and the columns are padded with zeros to the multiples intgemm requires.
+ */
+template<Type vtype>
+static inline void prodBatchedTyped(marian::Tensor C, const marian::Tensor A, const marian::Tensor B, bool transB, float scale) {
+  typedef typename intgemm_<vtype>::type Integer;
+  const size_t kAlign = sizeOf(vtype) == 1 ? 64 : 32; // width multiple for 8-bit and 16-bit intgemm
+  const size_t nAlign = 8;                            // B_cols multiple
+
+  size_t m = A->shape()[-2];
+  size_t k = A->shape()[-1];
+  size_t n = transB ? B->shape()[-2] : B->shape()[-1];
+  size_t batch = A->shape().elements() / (m * k);
+
+  size_t kPad = (k + kAlign - 1) / kAlign * kAlign;
+  size_t nPad = (n + nAlign - 1) / nAlign * nAlign;
+
+  // computed on the aligned padded copies, which MaxAbsolute() requires, the zero padding does not change the range
+  auto quantMult = [](intgemm::AlignedVector<float>& padded) {
+    if(sizeOf(vtype) != 1)
+      return 1024.0f; // as for 16-bit parameter matrices, see computeQuantMult()
+    float maxAbs = intgemm::MaxAbsolute(padded.begin(), padded.end());
+    return maxAbs > 0.f ? 127.0f / maxAbs : 1.0f;
+  };
+
+  parallelFor(batch, MIN_ELEMENTS_PER_CHUNK / std::max<size_t>(m * kPad + kPad * nPad, 1), [&](size_t begin, size_t end) {
+    // intgemm requires aligned inputs and outputs, also when the sizes are already multiples
+    intgemm::AlignedVector<float> aPadded(m * kPad), bPadded(kPad * nPad), cPadded(m * nPad);
+    intgemm::AlignedVector<Integer> aQuant(m * kPad), bQuant(kPad * nPad);
+    std::fill(aPadded.begin(), aPadded.end(), 0.f);
+    std::fill(bPadded.begin(), bPadded.end(), 0.f);
+
+    for(size_t i = begin; i < end; ++i) {
+      const float* a = A->data() + i * m * k;
+      const float* b = B->data() + i * n * k;
+      float* c = C->data() + i * m * n;
+
+      for(size_t r = 0; r < m; ++r)
+        std::copy(a + r * k, a + (r + 1) * k, aPadded.begin() + r * kPad);
+      float aQuantMult = quantMult(aPadded);
+      intgemm_<vtype>::width::PrepareA(aPadded.begin(), aQuant.begin(), aQuantMult, m, kPad);
+
+      if(transB) { // B[i] is stored as n x k, which intgemm prepares without transposing
+        for(size_t r = 0; r < n; ++r)
+          std::copy(b + r * k, b + (r + 1) * k, bPadded.begin() + r * kPad);
+      } else {
+        for(size_t r = 0; r < k; ++r)
+          std::copy(b + r * n, b + (r + 1) * n, bPadded.begin() + r * nPad);
+      }
+      float bQuantMult = quantMult(bPadded);
+      if(transB)
+        intgemm_<vtype>::width::PrepareBTransposed(bPadded.begin(), bQuant.begin(), bQuantMult, kPad, nPad);
+      else
+        intgemm_<vtype>::width::PrepareB(bPadded.begin(), bQuant.begin(), bQuantMult, kPad, nPad);
+
+      float unquantMult = scale / (aQuantMult * bQuantMult);
+      intgemm_<vtype>::width::Multiply(aQuant.begin(), bQuant.begin(), m, kPad, nPad,
+                                       intgemm::callbacks::UnquantizeAndWrite(unquantMult, cPadded.begin()));
+      for(size_t r = 0; r < m; ++r)
+        std::copy(cPadded.begin() + r * nPad, cPadded.begin() + r * nPad + n, c + r * n);
+    }
+  });
+}
+
+template<Type vtype>
+static inline Expr bdotTyped(Expr a, Expr b, bool transB, float scale) {
+  Shape outShape = a->shape();
+  outShape.set(-1, transB ? b->shape()[-2] : b->shape()[-1]);
+
+  auto bdotNodeOp = [=](Expr out, const std::vector<Expr>& children) {
+    prodBatchedTyped<vtype>(out->val(), children[0]->val(), children[1]->val(), transB, scale);
+  };
+  return lambda({a, b}, outShape, Type::float32, bdotNodeOp); // inference-only Lambda node
+}
+#endif
+
+/*
+ * Batched product of two float activation tensors in 8-bit or 16-bit intgemm for --gemm-type intgemm8/intgemm16,
+ * used for the attention products during inference. Returns nullptr if the shapes are not supported,
+ * i.e. if A is transposed or the batch dimensions are broadcast, so that the caller falls back to float.
+ */
+static inline Expr bdot(Expr a, Expr b, bool transA, bool transB, float scale, Type vtype) {
+#if COMPILE_CPU
+  if(transA || a->value_type() != Type::float32 || b->value_type() != Type::float32)
+    return nullptr;
+  size_t batchA = a->shape().elements() / (a->shape()[-1] * a->shape()[-2]);
+  size_t batchB = b->shape().elements() / (b->shape()[-1] * b->shape()[-2]);
+  if(batchA != batchB || a->shape()[-1] != b->shape()[transB ? -1 : -2])
+    return nullptr;
+
+  switch(getIntgemmType(vtype)) {
+    case Type::intgemm8ssse3 :
+      return bdotTyped<Type::intgemm8ssse3>(a, b, transB, scale);
+    case Type::intgemm8avx2 :
+      return bdotTyped<Type::intgemm8avx2>(a, b, transB, scale);
+    case Type::intgemm8avx512 :
+      return bdotTyped<Type::intgemm8avx512>(a, b, transB, scale);
+    case Type::intgemm8avx512vnni :
+      return bdotTyped<Type::intgemm8avx512vnni>(a, b, transB, scale);
+    case Type::intgemm16sse2 :
+      return bdotTyped<Type::intgemm16sse2>(a, b, transB, scale);
+    case Type::intgemm16avx2 :
+      return bdotTyped<Type::intgemm16avx2>(a, b, transB, scale);
+    case Type::intgemm16avx512 :
+      return bdotTyped<Type::intgemm16avx512>(a, b, transB, scale);
+    default:
+      ABORT("Unsupported type {} for Intgemm type??", vtype);
+  }
+#else
+  a, b, transA, transB, scale, vtype;
+  ABORT("You need to enable CPU compilation to use this feature. Use cmake .. -DCOMPILE_CPU=ON");
+#endif
+}
+
 }  // namespace integer
 }  // namespace cpu
 }  // namespace marian
@@ -0,0 +1,98 @@
+#include "tensors/cpu/parallel.h"
+#include "common/logging.h"
+
+namespace marian {
+namespace cpu {
+
+IntraOpThreadPool& IntraOpThreadPool::global() {
+  static IntraOpThreadPool pool;
+  return pool;
+}
+
+void IntraOpThreadPool::resize(size_t numThreads) {
+  numThreads = std::max<size_t>(numThreads, 1);
+  std::lock_guard<std::mutex> guard(resizeMutex_);
+  if(numThreads == size_)
+    return;
+
+  stop();
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    stop_ = false;
+  }
+  for(size_t i = 1; i < numThreads; ++i)
+    threads_.emplace_back([this]() { loop(); });
+  size_ = numThreads;
+
+  if(numThreads > 1)
+    LOG(info, "[cpu] Splitting large operations across {} threads", numThreads);
+}
+
+void IntraOpThreadPool::stop() {
+  size_ = 1; // new operations run on their calling threads only
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  condition_.notify_all();
+  for(auto& thread : threads_)
+    thread.join();
+  threads_.clear();
+}
+
+void IntraOpThreadPool::work(Job& job) {
+  for(;;) {
+    size_t chunk = job.next++;
+    if(chunk >= job.numChunks)
+      return;
+    size_t begin = chunk * job.grain;
+    (*job.fn)(begin, std::min(begin + job.grain, job.size));
+    job.done++;
+  }
+}
+
+void IntraOpThreadPool::loop() {
+  for(;;) {
+    Ptr<Job> job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      condition_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+      if(stop_)
+        return;
+      job = jobs_.front();
+      jobs_.pop_front();
+      if(job->next >= job->numChunks)
+        continue;
+      jobs_.push_back(job); // other threads may help with this job or serve concurrent callers
+    }
+    work(*job);
+  }
+}
+
+void IntraOpThreadPool::run(size_t size, size_t grain, const std::function<void(size_t, size_t)>& fn) {
+  auto job = New<Job>();
+  job->fn = &fn;
+  job->size = size;
+  job->grain = grain;
+  job->numChunks = (size + grain - 1) / grain;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    jobs_.push_back(job);
+  }
+  condition_.notify_all();
+
+  work(*job);
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = std::find(jobs_.begin(), jobs_.end(), job);
+    if(it != jobs_.end())
+      jobs_.erase(it);
+  }
+
+  // chunks claimed by pool threads are short, so wait actively
+  while(job->done < job->numChunks)
+    std::this_thread::yield();
+}
+
+}  // namespace cpu
+}  // namespace marian
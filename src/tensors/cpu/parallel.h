@@ -0,0 +1,110 @@
+#pragma once
+
+#include "common/definitions.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace marian {
+namespace cpu {
+
+/**
+ * Process-wide pool of threads for intra-operator parallelism in CPU kernels (--cpu-intra-threads).
+ *
+ * parallelFor() splits a range into chunks. The calling thread and all idle pool threads claim
+ * chunks one at a time until none are left, so uneven chunks balance out and a single large
+ * operation, e.g. one sentence in latency-bound decoding, can use several cores. Graphs running on
+ * several threads (--cpu-threads) share the pool. A caller always works through its own range, so it
+ * never waits for a busy pool and calls from within a chunk do not deadlock.
+ */
+class IntraOpThreadPool {
+private:
+  struct Job {
+    const std::function<void(size_t, size_t)>* fn;
+    size_t size;
+    size_t grain;
+    size_t numChunks;
+    std::atomic<size_t> next{0}; // next chunk to claim
+    std::atomic<size_t> done{0}; // number of finished chunks
+  };
+
+  std::vector<std::thread> threads_;
+  std::atomic<size_t> size_{1};
+  std::mutex resizeMutex_;
+
+  std::deque<Ptr<Job>> jobs_; // jobs that may still have unclaimed chunks
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  bool stop_{false};
+
+  // Runs chunks of the job until all of them have been claimed
+  static void work(Job& job);
+
+  void loop();
+  void stop();
+  void run(size_t size, size_t grain, const std::function<void(size_t, size_t)>& fn);
+
+public:
+  ~IntraOpThreadPool() { stop(); }
+
+  static IntraOpThreadPool& global();
+
+  // Sets the number of threads working on one operation including the calling thread, 1 disables
+  // intra-operator parallelism. Running operations finish on their calling threads.
+  void resize(size_t numThreads);
+
+  size_t size() const { return size_; }
+
+  /**
+   * Calls fn(begin, end) for consecutive sub-ranges of [0, size) of at least grain elements,
+   * possibly in parallel, and returns after all calls have finished.
+   */
+  template <class Function>
+  void parallelFor(size_t size, size_t grain, const Function& fn) {
+    grain = std::max<size_t>(grain, 1);
+    size_t threads = size_;
+    if(threads == 1 || size <= grain) {
+      fn(0, size);
+      return;
+    }
+    // a few chunks per thread are enough to balance the load
+    grain = std::max(grain, (size + 4 * threads - 1) / (4 * threads));
+    run(size, grain, fn);
+  }
+};
+
+// Minimum number of elements processed by one chunk, smaller operations run on the calling thread
+const size_t MIN_ELEMENTS_PER_CHUNK = 1 << 14;
+
+template <class Function>
+inline void parallelFor(size_t size, size_t grain, const Function& fn) {
+  IntraOpThreadPool::global().parallelFor(size, grain, fn);
+}
+
+// Calls fn(begin, end) for ranges of rows of a matrix with cols columns
+template <class Function>
+inline void parallelForRows(size_t rows, size_t cols, const Function& fn) {
+  parallelFor(rows, MIN_ELEMENTS_PER_CHUNK / std::max<size_t>(cols, 1), fn);
+}
+
+// Like parallelForRows(), but for loops that were parallelized with OpenMP before: without
+// intra-operator threads, the rows are still split by OpenMP in builds with USE_OPENMP.
+template <class Function>
+inline void parallelForRowsOmp(size_t rows, size_t cols, const Function& fn) {
+  if(IntraOpThreadPool::global().size() > 1) {
+    parallelForRows(rows, cols, fn);
+    return;
+  }
+  #pragma omp parallel for
+  for(int j = 0; j < (int)rows; ++j)
+    fn((size_t)j, (size_t)j + 1);
+}
+
+}  // namespace cpu
+}  // namespace marian
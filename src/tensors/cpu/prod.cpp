@@ -4,6 +4,7 @@
  */
 
 #include "tensors/cpu/backend.h"
+#include "tensors/cpu/parallel.h"
 #include "tensors/tensor.h"
 #include "tensors/tensor_allocator.h"
 
@@ -50,6 +51,31 @@ void Prod(marian::Tensor C,
   if(transB)
     ldc = B->shape().elements() / B->shape()[-1];
 
+  // With intra-op threads, split C into blocks of rows, or of columns if there are few rows, and
+  // multiply each block separately. Rows of op(A) are rows of A or columns of A if transposed,
+  // similarly for columns of op(B).
+  size_t threads = IntraOpThreadPool::global().size();
+  size_t flops = (size_t)m * n * k;
+  if(threads > 1 && flops >= 64 * MIN_ELEMENTS_PER_CHUNK) {
+    bool splitRows = (size_t)m >= threads || m >= n;
+    size_t size = splitRows ? m : n;
+    size_t grain = std::max<size_t>(1, 64 * MIN_ELEMENTS_PER_CHUNK / (flops / size));
+    parallelFor(size, grain, [&](size_t begin, size_t end) {
+      int part = (int)(end - begin);
+      if(splitRows)
+        sgemm(transA, transB, part, n, k, alpha,
+              A->data() + begin * (transA ? 1 : lda), lda,
+              B->data(), ldb,
+              beta, C->data() + begin * ldc, ldc);
+      else
+        sgemm(transA, transB, m, part, k, alpha,
+              A->data(), lda,
+              B->data() + begin * (transB ? ldb : 1), ldb,
+              beta, C->data() + begin, ldc);
+    });
+    return;
+  }
+
   sgemm(transA,
         transB,
         m,
@@ -222,10 +248,53 @@ void Affine(marian::Tensor C,
             float beta,
             float scalar,
             bool reluPostprocess) {
-  using namespace functional;
-  ProdWithBias(C, A, B, bias, transA, transB, beta, scalar);
-  if(reluPostprocess)
-    cpu::Element(_1 = ReLU(_1), C); // @TODO: also fuse with AddBias
+  cpu::Prod(C, A, B, transA, transB, beta, scalar);
+  AddBiasAndActivate(C, bias, reluPostprocess ? Activation::relu : Activation::none);
+}
+
+MARIAN_FFAST_MATH_BEGIN
+template <Activation activation>
+static void AddBiasAndActivateImpl(float* out, const float* bias, int rows, int cols) {
+  using Ops = functional::Ops<float>;
+  parallelForRows(rows, cols, [&](size_t begin, size_t end) {
+    for(int j = (int)begin; j < (int)end; ++j) {
+      float* so = out + j * cols;
+
+      #pragma omp simd
+      for(int i = 0; i < cols; ++i) {
+        float x = bias ? so[i] + bias[i] : so[i];
+        if(activation == Activation::relu)
+          x = x > 0.f ? x : 0.f;
+        else if(activation == Activation::swish)
+          x = x * Ops::sigmoid(x);
+        else if(activation == Activation::gelu)
+          x = x * Ops::sigmoid(1.702f * x); // same approximation as gelu()
+        so[i] = x;
+      }
+    }
+  });
+}
+MARIAN_FFAST_MATH_END
+
+void AddBiasAndActivate(marian::Tensor C, const marian::Tensor bias, Activation activation) {
+  ABORT_IF(bias && bias->shape().elements() != C->shape()[-1],
+           "Bias of shape {} does not match output of shape {}", bias->shape(), C->shape());
+
+  float* out = C->data();
+  const float* b = bias ? bias->data() : nullptr;
+  int rows = C->shape().elements() / C->shape()[-1];
+  int cols = C->shape()[-1];
+
+  switch(activation) {
+    case Activation::none:
+      if(b)
+        AddBiasAndActivateImpl<Activation::none>(out, b, rows, cols);
+      break;
+    case Activation::relu:  AddBiasAndActivateImpl<Activation::relu>(out, b, rows, cols); break;
+    case Activation::swish: AddBiasAndActivateImpl<Activation::swish>(out, b, rows, cols); break;
+    case Activation::gelu:  AddBiasAndActivateImpl<Activation::gelu>(out, b, rows, cols); break;
+    default: ABORT("Unknown activation in matrix product epilogue");
+  }
 }
 
 
@@ -5,6 +5,7 @@
 
 #include "tensors/tensor_operators.h"
 #include "tensors/cpu/backend.h"
+#include "tensors/cpu/parallel.h"
 #include "tensors/allocator.h"
 
 #include "functional/approx.h"
@@ -219,10 +220,10 @@ void Transpose0213(Tensor out, Tensor in) {
   int r2 = in->shape()[-3];
   int rest = rows / (r1 * r2);
 
-  for(int k = 0; k < rest; ++k) {
-    int shift = k * r1 * r2;
-    for(int j = 0; j < r1 * r2; ++j) {
-      int src = j + shift;
+  parallelForRows(rest * r1 * r2, cols, [&](size_t begin, size_t end) {
+    for(int src = (int)begin; src < (int)end; ++src) {
+      int shift = (src / (r1 * r2)) * r1 * r2;
+      int j = src - shift;
       int dst = j / r1 + (j % r1) * r2 + shift;
 
       const float* inRow = in->data() + src * cols;
@@ -237,7 +238,7 @@ void Transpose0213(Tensor out, Tensor in) {
         }
       }
     }
-  }
+  });
 }
 
 // This function is called only when MKL is available.
@@ -362,25 +363,27 @@ void TransposeGeneric(Tensor out, Tensor in, const std::vector<int>& vAxis) {
   int length = out->shape().elements();
 
   constexpr size_t N = functional::Shape::size();
-  functional::Array<int, N> oDims;
-  functional::Array<int, N> pDims;
   functional::Tensor<float> gOut = out;
   functional::Tensor<float> gIn = in;
 
-  for(int index = 0; index < length; ++index) {
-    gOut.shape().dims(index, oDims);
-    for(size_t i = 0; i < N; ++i)
-      pDims[permute[i]] = oDims[i];
+  parallelFor(length, MIN_ELEMENTS_PER_CHUNK, [&](size_t begin, size_t end) {
+    functional::Array<int, N> oDims;
+    functional::Array<int, N> pDims;
+    for(int index = (int)begin; index < (int)end; ++index) {
+      gOut.shape().dims(index, oDims);
+      for(size_t i = 0; i < N; ++i)
+        pDims[permute[i]] = oDims[i];
 
-    // @TODO: where does this change come from?
-    int inIndex = gIn.shape().index(pDims);
+      // @TODO: where does this change come from?
+      int inIndex = gIn.shape().index(pDims);
 
-    // @TODO: use internal conversion instead of raw indices
-    if(add)
-      gOut.data()[index] += gIn.data()[inIndex];
-    else
-      gOut.data()[index] = gIn.data()[inIndex];
-  }
+      // @TODO: use internal conversion instead of raw indices
+      if(add)
+        gOut.data()[index] += gIn.data()[inIndex];
+      else
+        gOut.data()[index] = gIn.data()[inIndex];
+    }
+  });
 }
 
 void TransposeND(Tensor out, Tensor in, const std::vector<int>& vAxis) {
@@ -416,32 +419,34 @@ void Softmax(Tensor out, Tensor in) {
   int rows = fout.shape().elements() / fout.shape().back();
   int cols = fout.shape().back();
 
-  for(int j = 0; j < rows; ++j) {
-    ElementType* so = pOut + j * cols;
-    const ElementType* sp = pIn + j * cols;
+  parallelForRows(rows, cols, [&](size_t begin, size_t end) {
+    for(int j = (int)begin; j < (int)end; ++j) {
+      ElementType* so = pOut + j * cols;
+      const ElementType* sp = pIn + j * cols;
 
-    ElementType max = sp[0];
-    for(int i = 1; i < cols; ++i) {
-      max = Ops<ElementType>::max(max, sp[i]);
-    }
+      ElementType max = sp[0];
+      for(int i = 1; i < cols; ++i) {
+        max = Ops<ElementType>::max(max, sp[i]);
+      }
 
-    // if ElementType is a complex type, e.g. float32x8, find the max of these 8 values
-    typename Ops<ElementType>::Single maxs = Ops<ElementType>::maxReduce(max);
+      // if ElementType is a complex type, e.g. float32x8, find the max of these 8 values
+      typename Ops<ElementType>::Single maxs = Ops<ElementType>::maxReduce(max);
 
-    ElementType sum = 0.f;
-    for(int i = 0; i < cols; ++i) {
-      ElementType ex = Ops<ElementType>::exp(Ops<ElementType>::sub(sp[i], maxs));
-      sum = Ops<ElementType>::add(sum, ex);
-      so[i] = ex;
-    }
+      ElementType sum = 0.f;
+      for(int i = 0; i < cols; ++i) {
+        ElementType ex = Ops<ElementType>::exp(Ops<ElementType>::sub(sp[i], maxs));
+        sum = Ops<ElementType>::add(sum, ex);
+        so[i] = ex;
+      }
 
-    // if ElementType is a complex type, e.g. float32x8, sum these 8 values
-    typename Ops<ElementType>::Single sums = Ops<ElementType>::sumReduce(sum);
+      // if ElementType is a complex type, e.g. float32x8, sum these 8 values
+      typename Ops<ElementType>::Single sums = Ops<ElementType>::sumReduce(sum);
 
-    for(int i = 0; i < cols; ++i) {
-      so[i] = Ops<ElementType>::div(so[i], sums);
+      for(int i = 0; i < cols; ++i) {
+        so[i] = Ops<ElementType>::div(so[i], sums);
+      }
     }
-  }
+  });
 }
 
 
@@ -476,29 +481,31 @@ void LogSoftmax(Tensor out, Tensor in) {
   int rows = fout.shape().elements() / fout.shape().back();
   int cols = fout.shape().back();
 
-  for(int j = 0; j < rows; ++j) {
-    ElementType* so = pOut + j * cols;
-    const ElementType* sp = pIn + j * cols;
+  parallelForRows(rows, cols, [&](size_t begin, size_t end) {
+    for(int j = (int)begin; j < (int)end; ++j) {
+      ElementType* so = pOut + j * cols;
+      const ElementType* sp = pIn + j * cols;
 
-    ElementType max = sp[0];
-    for(int i = 1; i < cols; ++i) {
-      max = Ops<ElementType>::max(max, sp[i]);
-    }
-    typename Ops<ElementType>::Single maxs = Ops<ElementType>::maxReduce(max); // global maximum
+      ElementType max = sp[0];
+      for(int i = 1; i < cols; ++i) {
+        max = Ops<ElementType>::max(max, sp[i]);
+      }
+      typename Ops<ElementType>::Single maxs = Ops<ElementType>::maxReduce(max); // global maximum
 
-    ElementType sum = 0.f;
-    for(int i = 0; i < cols; ++i) {
-      ElementType sm = Ops<ElementType>::sub(sp[i], maxs);
-      sum = Ops<ElementType>::add(sum, Ops<ElementType>::exp(sm));
-      so[i] = sm;
-    }
-    typename Ops<ElementType>::Single sums = Ops<ElementType>::sumReduce(sum); // global sum
+      ElementType sum = 0.f;
+      for(int i = 0; i < cols; ++i) {
+        ElementType sm = Ops<ElementType>::sub(sp[i], maxs);
+        sum = Ops<ElementType>::add(sum, Ops<ElementType>::exp(sm));
+        so[i] = sm;
+      }
+      typename Ops<ElementType>::Single sums = Ops<ElementType>::sumReduce(sum); // global sum
 
-    ElementType logSum = Ops<ElementType>::log(sums); // broadcasts Single to ElementType
-    for(int i = 0; i < cols; ++i) {
-      so[i] = Ops<ElementType>::sub(so[i], logSum);
+      ElementType logSum = Ops<ElementType>::log(sums); // broadcasts Single to ElementType
+      for(int i = 0; i < cols; ++i) {
+        so[i] = Ops<ElementType>::sub(so[i], logSum);
+      }
     }
-  }
+  });
 }
 
 void LogSoftmax(Tensor out, Tensor in) {
@@ -580,19 +587,20 @@ void CopyRows(Tensor out_,
   float* out = out_->data();
   const float* in = in_->data();
 
-#pragma omp parallel for
-  for(size_t j = 0; j < rows; ++j) {
-    size_t dst = j;
+  parallelForRowsOmp(rows, cols, [&](size_t begin, size_t end) {
+    for(size_t j = begin; j < end; ++j) {
+      size_t dst = j;
 
-    // @TODO: consider moving type checking to this function
-    // instead of matchOrAbort above
-    size_t src = (size_t)indices->data<IndexType>()[j];
+      // @TODO: consider moving type checking to this function
+      // instead of matchOrAbort above
+      size_t src = (size_t)indices->data<IndexType>()[j];
 
-    float* rowOut = out + dst * cols;
-    const float* rowIn = in + src * cols;
+      float* rowOut = out + dst * cols;
+      const float* rowIn = in + src * cols;
 
-    std::copy(rowIn, rowIn + cols, rowOut);
-  }
+      std::copy(rowIn, rowIn + cols, rowOut);
+    }
+  });
 }
 
 void PasteRows(Tensor out_,
@@ -1062,50 +1070,63 @@ void AttBack(Tensor gVa_,
 }
 
 MARIAN_FFAST_MATH_BEGIN
-template <int alphaStride, int betaStride, bool hasBeta>
+template <int alphaStride, int betaStride, bool hasBeta, bool hasResidual>
 void LayerNormalizationImpl(float* out,
                             const float* in,
+                            const float* residual,
                             const float* alpha,
                             const float* beta,
                             float eps,
                             int rows,
                             int cols) {
-  #pragma omp parallel for
-  for(int j = 0; j < rows; ++j) {
-    float* so = out + j * cols;
-    const float* sp = in + j * cols;
+  parallelForRowsOmp(rows, cols, [&](size_t begin, size_t end) {
+    for(int j = (int)begin; j < (int)end; ++j) {
+      float* so = out + j * cols;
+      const float* sp = in + j * cols;
+
+      // add the residual row into the output, which is normalized in place while it is still in cache
+      if(hasResidual) {
+        const float* sr = residual + j * cols;
+        #pragma omp simd
+        for(int i = 0; i < cols; ++i) {
+          so[i] = sp[i] + sr[i];
+        }
+        sp = so;
+      }
 
-    float sum = 0.f;
-    #pragma omp simd reduction(+ : sum)
-    for(int i = 0; i < cols; ++i) {
-      sum += sp[i];
-    }
+      float sum = 0.f;
+      #pragma omp simd reduction(+ : sum)
+      for(int i = 0; i < cols; ++i) {
+        sum += sp[i];
+      }
 
-    float mean = sum / cols;
-    float sqSum = 0.f;
-    #pragma omp simd reduction(+ : sqSum)
-    for(int i = 0; i < cols; ++i) {
-      float ex = sp[i] - mean;
-      sqSum += ex * ex;
-    }
+      float mean = sum / cols;
+      float sqSum = 0.f;
+      #pragma omp simd reduction(+ : sqSum)
+      for(int i = 0; i < cols; ++i) {
+        float ex = sp[i] - mean;
+        sqSum += ex * ex;
+      }
 
-    float sigma = std::sqrt(sqSum / cols + eps);
+      float sigma = std::sqrt(sqSum / cols + eps);
 
-    #pragma omp simd
-    for(int i = 0; i < cols; ++i) {
-      float t = alpha[alphaStride * i] * ((sp[i] - mean) / sigma);
-      if(hasBeta)
-        t += beta[betaStride * i];
+      #pragma omp simd
+      for(int i = 0; i < cols; ++i) {
+        float t = alpha[alphaStride * i] * ((sp[i] - mean) / sigma);
+        if(hasBeta)
+          t += beta[betaStride * i];
 
-      so[i] = t;
+        so[i] = t;
+      }
     }
-  }
+  });
 }
 MARIAN_FFAST_MATH_END
 
-template <int alphaStride>
+template <int alphaStride, bool hasResidual>
 inline void LayerNormalizationDispatchBeta(float* out,
                                            const float* in,
+                                           const float* residual,
                                            const float* alpha,
                                            Tensor beta,
                                            float eps,
@@ -1113,34 +1134,56 @@ inline void LayerNormalizationDispatchBeta(float* out,
                                            int cols) {
   if (beta) {
     if (beta->shape().back() > 1) {
-      LayerNormalizationImpl<alphaStride, 1, true>(out, in, alpha, beta->data(), eps, rows, cols);
+      LayerNormalizationImpl<alphaStride, 1, true, hasResidual>(out, in, residual, alpha, beta->data(), eps, rows, cols);
     } else {
-      LayerNormalizationImpl<alphaStride, 0, true>(out, in, alpha, beta->data(), eps, rows, cols);
+      LayerNormalizationImpl<alphaStride, 0, true, hasResidual>(out, in, residual, alpha, beta->data(), eps, rows, cols);
     }
   } else {
-    LayerNormalizationImpl<alphaStride, 0, false>(out, in, alpha, nullptr, eps, rows, cols);
+    LayerNormalizationImpl<alphaStride, 0, false, hasResidual>(out, in, residual, alpha, nullptr, eps, rows, cols);
   }
 }
 
-void LayerNormalization(Tensor out_,
-                        Tensor in_,
-                        Tensor gamma_,
-                        Tensor beta,
-                        float eps) {
+template <bool hasResidual>
+inline void LayerNormalizationDispatchAlpha(Tensor out_,
+                                            Tensor in_,
+                                            Tensor residual_,
+                                            Tensor gamma_,
+                                            Tensor beta,
+                                            float eps) {
   float* out = out_->data();
   const float* in = in_->data();
+  const float* residual = hasResidual ? residual_->data() : nullptr;
   const float* alpha = gamma_->data();
   const int alphaStride = gamma_->shape().back() > 1;  // broadcasting for alpha and beta
 
   int rows = in_->shape().elements() / in_->shape().back();
   int cols = in_->shape().back();
   if (alphaStride == 0) {
-    LayerNormalizationDispatchBeta<0>(out, in, alpha, beta, eps, rows, cols);
+    LayerNormalizationDispatchBeta<0, hasResidual>(out, in, residual, alpha, beta, eps, rows, cols);
   } else {
-    LayerNormalizationDispatchBeta<1>(out, in, alpha, beta, eps, rows, cols);
+    LayerNormalizationDispatchBeta<1, hasResidual>(out, in, residual, alpha, beta, eps, rows, cols);
   }
 }
 
+void LayerNormalization(Tensor out,
+                        Tensor in,
+                        Tensor gamma,
+                        Tensor beta,
+                        float eps) {
+  LayerNormalizationDispatchAlpha</*hasResidual=*/false>(out, in, nullptr, gamma, beta, eps);
+}
+
+void AddLayerNormalization(Tensor out,
+                           Tensor x,
+                           Tensor residual,
+                           Tensor gamma,
+                           Tensor beta,
+                           float eps) {
+  ABORT_IF(x->shape() != residual->shape(),
+           "Residual of shape {} does not match input of shape {}", residual->shape(), x->shape());
+  LayerNormalizationDispatchAlpha</*hasResidual=*/true>(out, x, residual, gamma, beta, eps);
+}
+
 MARIAN_FFAST_MATH_BEGIN
 void LayerNormalizationGrad(Tensor gradX_,
                             Tensor gradGamma_,
@@ -1263,28 +1306,29 @@ void RMSNormalizationImpl(float* out,
                           float eps,
                           int rows,
                           int cols) {
-  #pragma omp parallel for
-  for(int j = 0; j < rows; ++j) {
-    float* so = out + j * cols;
-    const float* sp = in + j * cols;
-
-    float sqSum = 0.f;
-    #pragma omp simd reduction(+ : sqSum)
-    for(int i = 0; i < cols; ++i) {
-      sqSum += sp[i] * sp[i];
-    }
+  parallelForRowsOmp(rows, cols, [&](size_t begin, size_t end) {
+    for(int j = (int)begin; j < (int)end; ++j) {
+      float* so = out + j * cols;
+      const float* sp = in + j * cols;
+
+      float sqSum = 0.f;
+      #pragma omp simd reduction(+ : sqSum)
+      for(int i = 0; i < cols; ++i) {
+        sqSum += sp[i] * sp[i];
+      }
 
-    float rms = std::sqrt(sqSum / cols + eps);
+      float rms = std::sqrt(sqSum / cols + eps);
 
-    #pragma omp simd
-    for(int i = 0; i < cols; ++i) {
-      float t = alpha[alphaStride * i] * (sp[i] / rms);
-      if(hasBeta)
-        t += beta[betaStride * i];
+      #pragma omp simd
+      for(int i = 0; i < cols; ++i) {
+        float t = alpha[alphaStride * i] * (sp[i] / rms);
+        if(hasBeta)
+          t += beta[betaStride * i];
 
-      so[i] = t;
+        so[i] = t;
+      }
     }
-  }
+  });
 }
 MARIAN_FFAST_MATH_END
 
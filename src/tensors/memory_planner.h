@@ -0,0 +1,97 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+namespace marian {
+
+/**
+ * Assigns static offsets within one block of memory to buffers whose lifetimes are known in
+ * advance, e.g. the tensors of a forward pass in inference, where a tensor lives from the step that
+ * computes it to the last step that reads it. Buffers with overlapping lifetimes get disjoint
+ * ranges. Placement is greedy by size: the largest buffers are placed first, each into the smallest
+ * sufficient gap between the buffers already placed that overlap in time, or after them.
+ *
+ * Planning is quadratic in the number of buffers in the worst case. The last plan is cached and
+ * reused if the same buffers are planned again, as is the case for repeated steps of a decoder.
+ */
+class MemoryPlanner {
+public:
+  struct Buffer {
+    size_t bytes;      // size, already aligned
+    size_t first;      // first step in which the buffer is used
+    size_t last;       // last step in which the buffer is used
+    size_t offset{0};  // result of plan()
+
+    bool overlaps(const Buffer& other) const { return first <= other.last && other.first <= last; }
+
+    bool operator==(const Buffer& other) const {
+      return bytes == other.bytes && first == other.first && last == other.last;
+    }
+  };
+
+private:
+  std::vector<Buffer> cache_;
+  size_t cacheBytes_{0};
+  size_t hits_{0};
+  size_t misses_{0};
+
+public:
+  /**
+   * Sets the offsets of the given buffers and returns the size of the block they need.
+   */
+  size_t plan(std::vector<Buffer>& buffers) {
+    if(buffers == cache_) {
+      buffers = cache_;
+      hits_++;
+      return cacheBytes_;
+    }
+    misses_++;
+
+    std::vector<size_t> order(buffers.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+      return buffers[a].bytes > buffers[b].bytes;
+    });
+
+    size_t total = 0;
+    std::vector<const Buffer*> placed; // ordered by offset
+    for(size_t i : order) {
+      auto& buffer = buffers[i];
+
+      // find the smallest gap between placed buffers of overlapping lifetime
+      const size_t none = std::numeric_limits<size_t>::max();
+      size_t bestOffset = none, bestSize = none, end = 0;
+      for(auto other : placed) {
+        if(!buffer.overlaps(*other))
+          continue;
+        if(other->offset >= end) {
+          size_t gap = other->offset - end;
+          if(gap >= buffer.bytes && gap < bestSize) {
+            bestOffset = end;
+            bestSize = gap;
+          }
+        }
+        end = std::max(end, other->offset + other->bytes);
+      }
+      buffer.offset = bestOffset != none ? bestOffset : end;
+      total = std::max(total, buffer.offset + buffer.bytes);
+
+      auto pos = std::upper_bound(placed.begin(), placed.end(), buffer.offset,
+                                  [](size_t offset, const Buffer* b) { return offset < b->offset; });
+      placed.insert(pos, &buffer);
+    }
+
+    cache_ = buffers;
+    cacheBytes_ = total;
+    return total;
+  }
+
+  size_t cacheHits() const { return hits_; }
+  size_t cacheMisses() const { return misses_; }
+};
+
+}  // namespace marian
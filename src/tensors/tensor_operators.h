@@ -107,6 +107,17 @@ DISPATCH8(ProdBatched, marian::Tensor, Ptr<Allocator>, const marian::Tensor, con
 DISPATCH9(CSRProd, marian::Tensor, Ptr<Allocator>, const marian::Tensor&, const marian::Tensor&, const marian::Tensor&, const marian::Tensor&, bool, bool, float)
 
 DISPATCH10(Affine, marian::Tensor, Ptr<Allocator>, const marian::Tensor&, const marian::Tensor&, const marian::Tensor&, bool, bool, float, float, bool)
+// clang-format on
+
+namespace cpu {
+// Activation functions that can be fused into the epilogue of a matrix product for inference on CPU
+enum class Activation : uint8_t { none, relu, swish, gelu };
+
+// Computes C = activation(C + bias) in a single pass over the rows of C, the bias may be null
+void AddBiasAndActivate(marian::Tensor C, const marian::Tensor bias, Activation activation);
+}
+
+// clang-format off
 
 DISPATCH2(Softmax, marian::Tensor, marian::Tensor)
 DISPATCH3(SoftmaxGrad, marian::Tensor, marian::Tensor, marian::Tensor)
@@ -171,6 +182,12 @@ static inline void Deconcatenate(std::vector<marian::Tensor>& outputs,
 
 // clang-format off
 DISPATCH5(LayerNormalization, marian::Tensor, marian::Tensor, marian::Tensor, marian::Tensor, float)
+// clang-format on
+
+namespace cpu {
+// Computes out = layerNorm(x + residual) without materializing the sum, for inference on CPU
+void AddLayerNormalization(Tensor out, Tensor x, Tensor residual, Tensor gamma, Tensor beta, float eps);
+}
 
 #ifdef CUDA_FOUND
 namespace gpu {
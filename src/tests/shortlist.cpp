@@ -0,0 +1,111 @@
+#include "marian.h"
+#include "common/timer.h"
+#include "data/shortlist.h"
+
+#include <random>
+#include <unordered_set>
+
+// Micro-benchmark for merging lexical shortlist candidates of a batch: compares the previous
+// hash-set based implementation with the bitset-based data::ShortlistMerger on synthetic data.
+
+using namespace marian;
+
+typedef std::vector<std::vector<WordIndex>> Candidates; // [source word] -> target candidates
+
+// previous implementation of LexicalShortlistGenerator::generate()
+static std::vector<WordIndex> generateHashSet(const Candidates& candidates,
+                                              const std::vector<WordIndex>& batch,
+                                              size_t firstNum) {
+  std::unordered_set<WordIndex> indexSet;
+  for(WordIndex i = 0; i < firstNum; ++i)
+    indexSet.insert(i);
+
+  std::unordered_set<WordIndex> srcSet;
+  for(auto i : batch)
+    srcSet.insert(i);
+
+  for(auto i : srcSet)
+    for(auto j : candidates[i])
+      indexSet.insert(j);
+
+  WordIndex i = static_cast<WordIndex>(firstNum);
+  while(indexSet.size() % 8 != 0) {
+    indexSet.insert(i);
+    i++;
+  }
+
+  std::vector<WordIndex> indices(indexSet.begin(), indexSet.end());
+  std::sort(indices.begin(), indices.end());
+  return indices;
+}
+
+static std::vector<WordIndex> generateBitset(const Candidates& candidates,
+                                             const std::vector<WordIndex>& batch,
+                                             size_t firstNum,
+                                             size_t trgVocabSize) {
+  auto& merger = data::ShortlistMerger::perThread();
+  merger.reset(trgVocabSize);
+  for(WordIndex i = 0; i < firstNum; ++i)
+    merger.insert(i);
+
+  for(auto i : batch)
+    if(merger.firstOccurrence(i))
+      merger.insert(candidates[i].begin(), candidates[i].end());
+
+  return merger.sortedIndices(static_cast<WordIndex>(firstNum));
+}
+
+int main(int /*argc*/, char** /*argv*/) {
+  const size_t srcVocabSize = 32000;
+  const size_t trgVocabSize = 32000;
+  const size_t firstNum = 100;
+  const size_t bestNum = 100;
+  const size_t sentenceLength = 25;
+  const size_t iterations = 2000;
+
+  std::mt19937 gen(1234);
+
+  // source and target words follow a Zipf-like distribution as in natural text
+  std::vector<double> weights(std::max(srcVocabSize, trgVocabSize));
+  for(size_t i = 0; i < weights.size(); ++i)
+    weights[i] = 1.0 / (i + 1);
+  std::discrete_distribution<WordIndex> srcDist(weights.begin(), weights.begin() + srcVocabSize);
+  std::discrete_distribution<WordIndex> trgDist(weights.begin(), weights.begin() + trgVocabSize);
+
+  Candidates candidates(srcVocabSize);
+  for(auto& targets : candidates) {
+    std::unordered_set<WordIndex> unique;
+    while(unique.size() < bestNum)
+      unique.insert(trgDist(gen));
+    targets.assign(unique.begin(), unique.end());
+    std::sort(targets.begin(), targets.end());
+  }
+
+  for(size_t batchSize : {1, 4, 16, 64}) {
+    std::vector<std::vector<WordIndex>> batches(16);
+    for(auto& batch : batches)
+      for(size_t i = 0; i < batchSize * sentenceLength; ++i)
+        batch.push_back(srcDist(gen));
+
+    for(const auto& batch : batches)
+      ABORT_IF(generateHashSet(candidates, batch, firstNum) != generateBitset(candidates, batch, firstNum, trgVocabSize),
+               "Shortlists differ for batch size {}", batchSize);
+
+    size_t checksum = 0;
+    timer::Timer hashTimer;
+    for(size_t i = 0; i < iterations; ++i)
+      checksum += generateHashSet(candidates, batches[i % batches.size()], firstNum).size();
+    double hashTime = hashTimer.elapsed<std::chrono::microseconds>() / iterations;
+
+    timer::Timer bitsetTimer;
+    for(size_t i = 0; i < iterations; ++i)
+      checksum -= generateBitset(candidates, batches[i % batches.size()], firstNum, trgVocabSize).size();
+    double bitsetTime = bitsetTimer.elapsed<std::chrono::microseconds>() / iterations;
+
+    ABORT_IF(checksum != 0, "Shortlist sizes differ");
+    std::cout << "batch size " << batchSize << ": hash set " << hashTime << "us, bitset " << bitsetTime
+              << "us per batch, speed-up " << hashTime / bitsetTime << "x" << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,87 @@
+#include "marian.h"
+#include "common/timer.h"
+#include "translator/helpers.h"
+#include "translator/nth_element.h"
+
+#include <random>
+
+// Micro-benchmark for one step of CPU beam search: compares log-softmax, path score expansion,
+// suppression and getNBestList() as separate graph operations with the fused n-best search of
+// --fused-top-k on synthetic logits. The separate version also includes copying the logits into
+// its graph.
+
+using namespace marian;
+
+int main(int /*argc*/, char** /*argv*/) {
+  const int dimBatch = 8;
+  const size_t iterations = 20;
+  const std::vector<WordIndex> suppressed = {1}; // <unk>
+
+  std::mt19937 gen(1234);
+  std::normal_distribution<float> logitDist(0.f, 4.f);
+  std::uniform_real_distribution<float> scoreDist(-10.f, 0.f);
+
+  auto data = New<ExpressionGraph>(true);
+  data->setDevice({0, DeviceType::cpu});
+  data->reserveWorkspaceMB(512);
+
+  auto g = New<ExpressionGraph>(true);
+  g->setDevice({0, DeviceType::cpu});
+  g->reserveWorkspaceMB(1536);
+
+  auto getNBestList = createGetNBestListFn(12, dimBatch, {0, DeviceType::cpu});
+  auto getNBestListFused = createGetNBestListFusedFn();
+
+  for(int dimVocab : {8000, 16000, 32000, 64000, 128000}) {
+    for(int dimBeam : {1, 4, 8, 12}) {
+      std::vector<float> logitValues((size_t)dimBeam * dimBatch * dimVocab);
+      for(auto& v : logitValues)
+        v = logitDist(gen);
+      std::vector<float> prevScores((size_t)dimBeam * dimBatch);
+      for(auto& v : prevScores)
+        v = scoreDist(gen);
+
+      data->clear();
+      auto logits = data->constant({dimBeam, 1, dimBatch, dimVocab}, inits::fromVector(logitValues));
+      data->forward();
+
+      std::vector<float> scores, fusedScores;
+      std::vector<unsigned> keys, fusedKeys;
+
+      timer::Timer separateTimer;
+      for(size_t i = 0; i < iterations; ++i) {
+        g->clear();
+        auto x = g->constant({dimBeam, 1, dimBatch, dimVocab}, inits::fromTensor(logits->val()));
+        auto prev = g->constant({dimBeam, 1, dimBatch, 1}, inits::fromVector(prevScores));
+        auto expanded = swapAxes(prev + logsoftmax(x), 0, 2);
+        auto indices = g->indices(suppressed);
+        g->forward();
+        suppressWords(expanded, indices);
+
+        scores.clear();
+        keys.clear();
+        getNBestList(expanded->val(), dimBeam, scores, keys, /*isFirst=*/dimBeam == 1);
+      }
+      double separateTime = separateTimer.elapsed<std::chrono::microseconds>() / iterations;
+
+      timer::Timer fusedTimer;
+      for(size_t i = 0; i < iterations; ++i) {
+        fusedScores.clear();
+        fusedKeys.clear();
+        getNBestListFused(logits->val(), prevScores, 1.f, suppressed, dimBeam, fusedScores, fusedKeys);
+      }
+      double fusedTime = fusedTimer.elapsed<std::chrono::microseconds>() / iterations;
+
+      ABORT_IF(keys != fusedKeys, "n-best keys differ for vocab {} and beam {}", dimVocab, dimBeam);
+      for(size_t i = 0; i < scores.size(); ++i)
+        ABORT_IF(std::abs(scores[i] - fusedScores[i]) > 1e-4f * std::max(1.f, std::abs(scores[i])),
+                 "n-best scores differ for vocab {} and beam {}: {} != {}", dimVocab, dimBeam, scores[i], fusedScores[i]);
+
+      std::cout << "vocab " << dimVocab << ", beam " << dimBeam << ": separate " << separateTime
+                << "us, fused " << fusedTime << "us per step, speed-up " << separateTime / fusedTime
+                << "x" << std::endl;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,99 @@
+#include "catch.hpp"
+#include "tensors/allocator.h"
+#include "tensors/memory_planner.h"
+
+using namespace marian;
+
+TEST_CASE("Allocator merges free neighbours", "[allocator]") {
+  Allocator allocator({0, DeviceType::cpu}, 4096, 4096, 256);
+  auto a = allocator.alloc(256);
+  auto b = allocator.alloc(256);
+  auto c = allocator.alloc(256);
+  CHECK( allocator.available() == 4096 - 3 * 256 );
+
+  SECTION("freeing the middle piece leaves two gaps") {
+    allocator.free(b);
+    CHECK( allocator.stats().gaps == 2 );
+    CHECK( allocator.stats().largestGap == 4096 - 3 * 256 );
+  }
+
+  SECTION("freeing all pieces in any order leaves a single gap") {
+    allocator.free(a);
+    allocator.free(c);
+    allocator.free(b);
+    auto stats = allocator.stats();
+    CHECK( stats.gaps == 1 );
+    CHECK( stats.largestGap == 4096 );
+    CHECK( stats.used == 0 );
+    CHECK( stats.peak == 3 * 256 );
+    CHECK( stats.fragmentation() == 0.f );
+  }
+
+  SECTION("freed memory is reused") {
+    allocator.free(b);
+    auto d = allocator.alloc(200);
+    CHECK( d->data() == allocator.memory()->data() + 256 );
+  }
+}
+
+TEST_CASE("Allocator moves pieces when growing", "[allocator]") {
+  Allocator allocator({0, DeviceType::cpu}, 1024, 4096, 256);
+  auto a = allocator.alloc(512);
+  a->data<float>()[0] = 42.f;
+  auto block = allocator.alloc(512);
+  auto planned = allocator.allocIn(block, 256, 256);
+  planned->data<float>()[0] = 7.f;
+
+  auto b = allocator.alloc(2048); // exceeds the reserved memory
+  auto stats = allocator.stats();
+  CHECK( stats.grows == 1 );
+  CHECK( stats.reserved == 1024 + 4096 );
+
+  auto base = allocator.memory()->data();
+  CHECK( a->data() == base );
+  CHECK( a->data<float>()[0] == 42.f );
+  CHECK( planned->data() == block->data() + 256 );
+  CHECK( planned->data<float>()[0] == 7.f );
+  CHECK( b->data() >= base + 1024 );
+
+  CHECK( allocator.planned() == 1 );
+  CHECK( allocator.free(planned) );
+  CHECK( allocator.planned() == 0 );
+}
+
+TEST_CASE("MemoryPlanner assigns disjoint ranges to live buffers", "[allocator]") {
+  typedef MemoryPlanner::Buffer Buffer;
+  std::vector<Buffer> buffers = {
+    {256, 0, 1},
+    {512, 1, 2},
+    {256, 2, 3},
+    {1024, 3, 4},
+    {256, 0, 4}
+  };
+
+  MemoryPlanner planner;
+  size_t bytes = planner.plan(buffers);
+
+  for(size_t i = 0; i < buffers.size(); ++i) {
+    CHECK( buffers[i].offset + buffers[i].bytes <= bytes );
+    for(size_t j = i + 1; j < buffers.size(); ++j) {
+      if(buffers[i].overlaps(buffers[j])) {
+        bool disjoint = buffers[i].offset + buffers[i].bytes <= buffers[j].offset
+                        || buffers[j].offset + buffers[j].bytes <= buffers[i].offset;
+        CHECK( disjoint );
+      }
+    }
+  }
+  // the buffers live in step 3 need 1536 bytes
+  CHECK( bytes == 1536 );
+
+  SECTION("the same buffers reuse the cached plan") {
+    auto again = buffers;
+    for(auto& b : again)
+      b.offset = 0;
+    CHECK( planner.plan(again) == bytes );
+    CHECK( planner.cacheHits() == 1 );
+    for(size_t i = 0; i < buffers.size(); ++i)
+      CHECK( again[i].offset == buffers[i].offset );
+  }
+}
@@ -0,0 +1,145 @@
+#include "catch.hpp"
+#include "marian.h"
+
+#include "data/batch_generator.h"
+#include "data/text_input.h"
+#include "translator/batch_fit.h"
+#include "translator/beam_search.h"
+#include "test_helpers.h"
+
+#include <cstdio>
+#include <set>
+
+using namespace marian;
+
+TEST_CASE("BatchGenerator applies fitted batch sizes to length buckets", "[batch_fit]") {
+  test::TestVocab vocab;
+  auto options = test::parseOptions(cli::mode::training)->with("mini-batch", 100, "maxi-batch", 10, "maxi-batch-sort", "src",
+                                                               "length-buckets", 4, "shuffle", "none");
+
+  // 40 sentences of 1 to 12 words, i.e. 2 to 13 tokens with </s>
+  std::string text;
+  for(size_t i = 0; i < 40; ++i) {
+    for(size_t j = 0; j <= (i * 7) % 12; ++j)
+      text += (j > 0 ? " w" : "w") + std::to_string(j);
+    text += "\n";
+  }
+  auto input = New<data::TextInput>(std::vector<std::string>({text}),
+                                    std::vector<Ptr<Vocab>>({vocab.load(options, 0)}), options);
+
+  // batch sizes for source lengths up to 4, 8 and 16
+  auto stats = New<data::BatchStats>(std::vector<size_t>({1, 4, 6, 8, 3, 16, 1}));
+
+  auto readBatches = [&](Ptr<Options> options, Ptr<data::BatchStats> stats) {
+    input->reset();
+    data::BatchGenerator<data::TextInput> batchGenerator(input, options, stats, /*runAsync=*/false);
+    batchGenerator.prepare();
+
+    std::vector<Ptr<data::CorpusBatch>> batches;
+    std::set<size_t> ids;
+    for(auto batch : batchGenerator) {
+      batches.push_back(batch);
+      for(auto id : batch->getSentenceIds())
+        ids.insert(id);
+    }
+    CHECK( ids.size() == 40 );
+    return batches;
+  };
+
+  SECTION("without fitted batch sizes each bucket is a single batch") {
+    auto batches = readBatches(options->with("mini-batch-fit", true), nullptr);
+    CHECK( batches.size() == 4 );
+  }
+
+  SECTION("batches are cut at the fitted size for the longest sentence of each bucket") {
+    auto batches = readBatches(options->with("mini-batch-fit", true), stats);
+    size_t fullBatches = 0;
+    for(auto batch : batches) {
+      size_t width = (*batch)[0]->batchWidth();
+      auto it = stats->begin();
+      size_t fittedSize = stats->findBatchSize({width}, it);
+      CHECK( batch->size() <= fittedSize );
+      if(batch->size() == fittedSize)
+        fullBatches++;
+
+      // no batch spans buckets
+      for(size_t i = 0; i < batch->size(); ++i) {
+        size_t length = 0;
+        for(size_t t = 0; t < width; ++t)
+          length += (*batch)[0]->mask()[t * batch->size() + i] != 0.f;
+        CHECK( length / 4 == width / 4 );
+      }
+    }
+    CHECK( batches.size() > 4 );
+    CHECK( fullBatches > 0 );
+  }
+}
+
+TEST_CASE("BatchFitter fits decoding batch sizes into the workspace", "[batch_fit]") {
+  Config::seed = 1234;
+
+  test::TestVocab vocab;
+  io::TemporaryFile model("/tmp/", /*earlyUnlink=*/false); // only its name and size are used, nothing is loaded
+  model << "model";
+  model.flush();
+  std::string modelName = test::tempFileName(model);
+  auto cache = modelName + ".batch-fit.yml";
+
+  // the large output layer fills the workspace of 128 MB (its minimum size) with small batches already
+  auto options = test::parseOptions(cli::mode::training)->with("type", "transformer", "dim-vocabs", std::vector<int>({16, 32000}),
+                                                               "dim-emb", 8, "transformer-heads", 2, "transformer-dim-ffn", 16,
+                                                               "enc-depth", 1, "dec-depth", 1);
+  options->set("inference", true);
+  options->set("models", std::vector<std::string>({modelName}));
+  options->set("vocabs", std::vector<std::string>(2, test::tempFileName(vocab.file)));
+  options->set("workspace", 1);
+  options->set("beam-size", 1);
+  options->set("max-length", 8);
+  options->set("max-length-factor", 1.f);
+  options->set("mini-batch-fit-step", 4);
+
+  auto graph = New<ExpressionGraph>(/*inference=*/true);
+  graph->setDevice({0, DeviceType::cpu});
+  graph->reserveWorkspaceMB(1);
+
+  // randomly initialized parameters are created by the first decoded batch
+  auto encdec = models::createModelFromOptions(options, models::usage::translation);
+  std::vector<Ptr<Scorer>> scorers = {New<ScorerWrapper>(encdec, "F0", 1.f, modelName)};
+  std::vector<Ptr<Vocab>> srcVocabs = {vocab.load(options, 0)};
+  auto trgVocab = vocab.load(options, 1);
+
+  auto fitter = [&](Ptr<Options> options) {
+    return BatchFitter<BeamSearch>(options, graph, scorers, srcVocabs, trgVocab);
+  };
+
+  // fitting decodes many batches, so all checks share the results of two fits
+  auto fitted = fitter(options).getStats()->flatten();
+  REQUIRE( filesystem::exists(cache) );
+
+  // number of streams, then source length and batch size for every step up to --max-length
+  REQUIRE( fitted.size() == 1 + 2 * 2 );
+  CHECK( fitted[1] == 4 );
+  CHECK( fitted[3] == 8 );
+  CHECK( fitted[2] >= fitted[4] ); // batch sizes do not increase with the source length
+  CHECK( fitted[4] >= 1 );
+
+  // replace the batch sizes in the cache, but keep the options they belong to
+  YAML::Node node;
+  {
+    io::InputFileStream in(cache);
+    node = YAML::Load(in);
+  }
+  node["stats"] = std::vector<size_t>({1, 8, 5});
+  {
+    io::OutputFileStream out(cache);
+    out << node << std::endl;
+  }
+
+  // cached batch sizes are reused for the same options and refitted for others
+  CHECK( fitter(options).getStats()->flatten() == std::vector<size_t>({1, 8, 5}) );
+  auto refitted = fitter(options->with("max-length", 4)).getStats()->flatten();
+  REQUIRE( refitted.size() == 1 + 2 );
+  CHECK( refitted[1] == 4 );
+
+  std::remove(cache.c_str());
+}
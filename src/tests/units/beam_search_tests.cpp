@@ -0,0 +1,185 @@
+#include "catch.hpp"
+#include "marian.h"
+
+#include "models/model_factory.h"
+#include "translator/beam_search.h"
+#include "translator/helpers.h"
+#include "translator/nth_element.h"
+#include "test_helpers.h"
+
+#include <numeric>
+#include <random>
+
+using namespace marian;
+
+// Beams with a single hypothesis for unfinished and no hypothesis for finished batch entries
+static Beams makeBeams(const std::vector<bool>& finished) {
+  Beams beams;
+  for(bool f : finished)
+    beams.push_back(f ? Beam() : Beam(1, Hypothesis::New()));
+  return beams;
+}
+
+TEST_CASE("BeamSearch::compactBatch", "[beam_search]") {
+  auto options = New<Options>();
+  options->set("beam-size", 4);
+
+  SECTION("finished entries stay in the tensors until the live fraction drops below the threshold") {
+    options->set("beam-compaction-threshold", 0.5f);
+    BeamSearch search(options, {}, nullptr);
+
+    std::vector<bool> inTensor(4, true);
+    std::vector<IndexType> batchIdxMap = {0, 1, 2, 3};
+
+    // 3 of 4 entries are unfinished
+    CHECK( !search.compactBatch(makeBeams({true, false, false, false}), inTensor, batchIdxMap) );
+    CHECK( inTensor == std::vector<bool>({true, true, true, true}) );
+    CHECK( batchIdxMap == std::vector<IndexType>({0, 1, 2, 3}) );
+
+    // 2 of 4 entries are unfinished, still not below the threshold
+    CHECK( !search.compactBatch(makeBeams({true, false, true, false}), inTensor, batchIdxMap) );
+
+    // 1 of 4 entries is unfinished, all finished entries are removed at once
+    CHECK( search.compactBatch(makeBeams({true, false, true, true}), inTensor, batchIdxMap) );
+    CHECK( inTensor == std::vector<bool>({false, true, false, false}) );
+    CHECK( batchIdxMap[1] == 0 ); // the remaining entry is now in the first row
+
+    // only entries in the tensors count, the single remaining one is live
+    CHECK( !search.compactBatch(makeBeams({true, false, true, true}), inTensor, batchIdxMap) );
+
+    auto stats = search.getCompactionStats();
+    CHECK( stats.compactions == 1 );
+    CHECK( stats.removedEntries == 3 );
+    CHECK( stats.entrySteps == 4 + 4 + 4 + 1 );
+    CHECK( stats.finishedSteps == 1 + 2 + 3 + 0 );
+  }
+
+  SECTION("threshold 1 removes finished entries immediately") {
+    options->set("beam-compaction-threshold", 1.f);
+    BeamSearch search(options, {}, nullptr);
+
+    std::vector<bool> inTensor(3, true);
+    std::vector<IndexType> batchIdxMap = {0, 1, 2};
+    CHECK( search.compactBatch(makeBeams({false, true, false}), inTensor, batchIdxMap) );
+    CHECK( inTensor == std::vector<bool>({true, false, true}) );
+    CHECK( batchIdxMap[0] == 0 );
+    CHECK( batchIdxMap[2] == 1 );
+  }
+
+  SECTION("threshold 0 never removes finished entries") {
+    options->set("beam-compaction-threshold", 0.f);
+    BeamSearch search(options, {}, nullptr);
+
+    std::vector<bool> inTensor(3, true);
+    std::vector<IndexType> batchIdxMap = {0, 1, 2};
+    CHECK( !search.compactBatch(makeBeams({true, true, false}), inTensor, batchIdxMap) );
+    CHECK( !search.compactBatch(makeBeams({true, true, true}), inTensor, batchIdxMap) );
+    CHECK( inTensor == std::vector<bool>({true, true, true}) );
+    CHECK( search.getCompactionStats().compactions == 0 );
+  }
+}
+
+TEST_CASE("Fused n-best search gives the same results as separate operations (cpu)", "[beam_search]") {
+  const int dimBatch = 3;
+  const std::vector<WordIndex> suppressed = {1}; // <unk>
+
+  std::mt19937 gen(1234);
+  std::normal_distribution<float> logitDist(0.f, 4.f);
+  std::uniform_real_distribution<float> scoreDist(-10.f, 0.f);
+
+  auto graph = New<ExpressionGraph>(/*inference=*/true);
+  graph->setDevice({0, DeviceType::cpu});
+  graph->reserveWorkspaceMB(16);
+
+  auto getNBestList = createGetNBestListFn(4, dimBatch, {0, DeviceType::cpu});
+  auto getNBestListFused = createGetNBestListFusedFn();
+
+  // a vocabulary size that is not a multiple of the vector width
+  const int dimVocab = 1003;
+  for(int dimBeam : {1, 4}) {
+    for(float weight : {1.f, 0.5f}) {
+      std::vector<float> logitValues((size_t)dimBeam * dimBatch * dimVocab);
+      for(auto& v : logitValues)
+        v = logitDist(gen);
+      std::vector<float> prevScores((size_t)dimBeam * dimBatch);
+      for(auto& v : prevScores)
+        v = scoreDist(gen);
+
+      graph->clear();
+      auto logits = graph->constant({dimBeam, 1, dimBatch, dimVocab}, inits::fromVector(logitValues));
+      auto prev = graph->constant({dimBeam, 1, dimBatch, 1}, inits::fromVector(prevScores));
+      auto expanded = swapAxes(prev + weight * logsoftmax(logits), 0, 2);
+      auto indices = graph->indices(suppressed);
+      graph->forward();
+      suppressWords(expanded, indices);
+
+      std::vector<float> scores, fusedScores;
+      std::vector<unsigned> keys, fusedKeys;
+      getNBestList(expanded->val(), dimBeam, scores, keys, /*isFirst=*/dimBeam == 1);
+      getNBestListFused(logits->val(), prevScores, weight, suppressed, dimBeam, fusedScores, fusedKeys);
+
+      CHECK( fusedKeys == keys );
+      REQUIRE( fusedScores.size() == scores.size() );
+      for(size_t i = 0; i < scores.size(); ++i)
+        CHECK( fusedScores[i] == Approx(scores[i]).epsilon(0.0001f) );
+    }
+  }
+}
+
+TEST_CASE("BeamSearch reports every sentence once with its final history (cpu)", "[beam_search]") {
+  Config::seed = 1234;
+
+  test::TestVocab vocab;
+  auto options = test::parseOptions(cli::mode::training)->with("type", "transformer", "dim-vocabs", std::vector<int>({16, 16}),
+                                                               "dim-emb", 8, "transformer-heads", 2, "transformer-dim-ffn", 16,
+                                                               "enc-depth", 1, "dec-depth", 1);
+  options->set("inference", true);
+  options->set("beam-size", 2);
+  options->set("max-length-factor", 2.f);
+
+  auto graph = New<ExpressionGraph>(/*inference=*/true);
+  graph->setDevice({0, DeviceType::cpu});
+  graph->reserveWorkspaceMB(16);
+
+  // randomly initialized parameters are created by the first search and shared by the second
+  auto encdec = models::createModelFromOptions(options, models::usage::translation);
+  std::vector<Ptr<Scorer>> scorers = {New<ScorerWrapper>(encdec, "F0", 1.f, "model.npz")};
+  std::vector<Ptr<Vocab>> srcVocabs = {vocab.load(options, 0)};
+  auto trgVocab = vocab.load(options, 1);
+
+  const size_t dimBatch = 4;
+  auto batch = data::CorpusBatch::fakeBatch({3}, srcVocabs, dimBatch, /*options=*/nullptr);
+  std::vector<size_t> sentenceIds(dimBatch);
+  std::iota(sentenceIds.begin(), sentenceIds.end(), 0);
+  batch->setSentenceIds(sentenceIds);
+
+  auto expected = BeamSearch(options, scorers, trgVocab).search(graph, batch);
+
+  BeamSearch search(options, scorers, trgVocab);
+  std::vector<std::pair<size_t, Ptr<History>>> reported;
+  std::vector<size_t> reportedLengths;
+  search.setFinishedCallback([&](size_t batchIdx, Ptr<History> history) {
+    reported.push_back({batchIdx, history});
+    reportedLengths.push_back(history->size());
+  });
+  auto histories = search.search(graph, batch);
+
+  REQUIRE( histories.size() == dimBatch );
+  REQUIRE( reported.size() == dimBatch );
+  std::vector<bool> seen(dimBatch, false);
+  for(size_t i = 0; i < reported.size(); ++i) {
+    size_t batchIdx = reported[i].first;
+    REQUIRE( batchIdx < dimBatch );
+    CHECK( !seen[batchIdx] );
+    seen[batchIdx] = true;
+    // the reported history is the returned one, and it did not change after it was reported
+    CHECK( reported[i].second == histories[batchIdx] );
+    CHECK( reportedLengths[i] == histories[batchIdx]->size() );
+  }
+
+  // the callback does not change the translations
+  for(size_t batchIdx = 0; batchIdx < dimBatch; ++batchIdx) {
+    CHECK( std::get<0>(histories[batchIdx]->top()) == std::get<0>(expected[batchIdx]->top()) );
+    CHECK( histories[batchIdx]->getLineNum() == expected[batchIdx]->getLineNum() );
+  }
+}
@@ -1,6 +1,8 @@
 #include "catch.hpp"
 #include "common/binary.h"
 #include "common/file_stream.h"
+#include "graph/expression_graph.h"
+#include "tensors/cpu/integer_common.h"
 
 #include "3rd_party/mio/mio.hpp"
 
@@ -58,4 +60,88 @@ TEST_CASE("a few operations on binary files", "[binary]") {
       CHECK( std::equal(item2.data(), item2.data() + item2.size(), items[1].data()) );
     }
   }
+
+  SECTION("Map the intgemm variant for the most recent instruction set the CPU supports") {
+    io::TemporaryFile temp("/tmp/", /*earlyUnlink=*/false);
+
+    auto makeItem = [](const std::string& name, Type type, char value) {
+      io::Item item;
+      item.name  = name;
+      item.shape = { 8, 8 };
+      item.type  = type;
+      item.bytes.resize(item.size(), value);
+      return item;
+    };
+
+    // variants are named after the matrix they replace and skipped by loaders that do not know them
+    std::vector<io::Item> items = {
+      makeItem("W", Type::intgemm8avx512vnni, 1),
+      makeItem(io::binary::intgemmVariantName("W", Type::intgemm8ssse3), Type::intgemm8ssse3, 2),
+      makeItem("b", Type::float32, 3)
+    };
+    io::binary::saveItems(temp.getFileName(), items);
+
+    mio::mmap_source mmap(temp.getFileName());
+    std::vector<io::Item> loaded;
+    io::binary::loadItems(mmap.data(), loaded, /*mapped=*/true);
+
+    REQUIRE( loaded.size() == 2 );
+    CHECK( loaded[0].name == "W" );
+    CHECK( loaded[1].name == "b" );
+    CHECK( loaded[0].mapped );
+
+    bool hasVnni = cpu::integer::intgemmTypeRank(Type::intgemm8avx512vnni) >= 0;
+    CHECK( loaded[0].type == (hasVnni ? Type::intgemm8avx512vnni : Type::intgemm8ssse3) );
+    CHECK( loaded[0].data()[0] == (hasVnni ? 1 : 2) );
+  }
+}
+
+TEST_CASE("Memory-mapped graphs prepare hardware non-specific intgemm matrices", "[binary]") {
+  io::TemporaryFile temp("/tmp/", /*earlyUnlink=*/false);
+  {
+    // a quantized intgemm8 matrix, followed by its quantization multiplier, as stored by marian-conv
+    io::Item W;
+    W.name  = "W";
+    W.shape = { 64, 64 };
+    W.type  = Type::intgemm8;
+    W.bytes.resize(W.size(), 0);
+    for(int i = 0; i < W.shape.elements(); ++i)
+      W.bytes[i] = (char)(i % 7 - 3);
+    *(float*)(W.bytes.data() + W.shape.elements()) = 0.5f;
+
+    io::Item b;
+    b.name  = "b";
+    b.shape = { 1, 4 };
+    b.type  = Type::float32;
+    std::vector<float> values = { 1.f, 2.f, 3.f, 4.f };
+    b.bytes.assign((char*)values.data(), (char*)(values.data() + values.size()));
+
+    std::vector<io::Item> items = {W, b};
+    io::binary::saveItems(temp.getFileName(), items);
+  }
+
+  mio::mmap_source mmap(temp.getFileName());
+  auto isMapped = [&](Expr param) {
+    auto data = param->val()->data<char>();
+    return data >= mmap.data() && data < mmap.data() + mmap.size();
+  };
+
+  auto graph = New<ExpressionGraph>(/*inference=*/true);
+  graph->setDevice({0, DeviceType::cpu});
+  graph->reserveWorkspaceMB(4);
+  graph->mmap(mmap.data());
+  graph->forward(); // allocates and initializes the parameters
+
+  auto W = graph->get("W");
+  REQUIRE( W );
+  CHECK( W->value_type() == cpu::integer::getIntgemmType(Type::intgemm8) );
+  CHECK( !isMapped(W) ); // prepared for this CPU in memory
+  CHECK( cpu::integer::getQuantMult<Type::intgemm8>(W->val()) == 0.5f );
+
+  auto b = graph->get("b");
+  REQUIRE( b );
+  CHECK( isMapped(b) );
+  std::vector<float> values;
+  b->val()->get(values);
+  CHECK( values == std::vector<float>({1.f, 2.f, 3.f, 4.f}) );
 }
@@ -0,0 +1,131 @@
+#include "catch.hpp"
+#include "data/corpus.h"
+#include "data/corpus_binary.h"
+#include "test_helpers.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+using namespace marian;
+
+// A parallel corpus of 300 sentence pairs of 1 to 7 words from a vocabulary of 10 words
+struct TestCorpus {
+  io::TemporaryFile src{"/tmp/", /*earlyUnlink=*/false};
+  io::TemporaryFile trg{"/tmp/", /*earlyUnlink=*/false};
+  io::TemporaryFile vocab{"/tmp/", /*earlyUnlink=*/false};
+
+  TestCorpus() {
+    for(size_t i = 0; i < 300; ++i) {
+      for(size_t j = 0; j <= i % 7; ++j)
+        src << (j > 0 ? " " : "") << "w" << (i * 3 + j) % 10;
+      for(size_t j = 0; j <= (i + 3) % 7; ++j)
+        trg << (j > 0 ? " " : "") << "w" << (i + j) % 10;
+      src << "\n";
+      trg << "\n";
+    }
+    vocab << "</s>\n<unk>\n";
+    for(size_t i = 0; i < 10; ++i)
+      vocab << "w" << i << "\n";
+    src.flush();
+    trg.flush();
+    vocab.flush();
+  }
+
+  Ptr<data::Corpus> open(Ptr<Options> options) {
+    std::vector<Ptr<Vocab>> vocabs;
+    for(size_t i = 0; i < 2; ++i) {
+      vocabs.push_back(New<Vocab>(options, i));
+      vocabs.back()->load(test::tempFileName(vocab));
+    }
+    return New<data::Corpus>(std::vector<std::string>({test::tempFileName(src), test::tempFileName(trg)}), vocabs, options);
+  }
+};
+
+// Reads up to the given number of sentence tuples as id and words of all streams
+template <class CorpusType>
+static std::vector<std::pair<size_t, std::vector<Words>>> read(CorpusType& corpus, size_t limit = (size_t)-1) {
+  std::vector<std::pair<size_t, std::vector<Words>>> tuples;
+  while(tuples.size() < limit) {
+    auto tup = corpus.next();
+    if(tup.empty())
+      break;
+    tuples.push_back({tup.getId(), std::vector<Words>(tup.begin(), tup.end())});
+  }
+  return tuples;
+}
+
+TEST_CASE("Corpus encodes sentences with several data threads", "[data]") {
+  TestCorpus files;
+  auto options = test::parseOptions(cli::mode::training);
+  options->set("max-length", 7); // skips the sentences with 7 words, i.e. 8 tokens with </s>
+
+  auto expected = read(*files.open(options->with("data-threads", 1)));
+  REQUIRE( expected.size() == 300 - 42 - 43 ); // sources and targets with 7 words
+  CHECK( expected[0].first == 0 );
+  CHECK( expected[0].second[0].size() == 1 + 1 );
+  CHECK( expected[0].second[1].size() == 4 + 1 );
+
+  SECTION("sentences are returned in reading order") {
+    auto corpus = files.open(options->with("data-threads", 3));
+    CHECK( read(*corpus) == expected );
+    CHECK( corpus->next().empty() );
+  }
+
+  SECTION("pending chunks are discarded on reset") {
+    auto corpus = files.open(options->with("data-threads", 3));
+    auto first = read(*corpus, 10);
+    CHECK( first == decltype(first)(expected.begin(), expected.begin() + 10) );
+
+    corpus->reset();
+    CHECK( read(*corpus) == expected );
+
+    corpus->reset(); // after reading everything
+    CHECK( read(*corpus) == expected );
+  }
+}
+
+TEST_CASE("Binary corpus gives the same sentences as the text files", "[data]") {
+  TestCorpus files;
+  io::TemporaryFile temp("/tmp/", /*earlyUnlink=*/true); // only used for a unique file name
+  auto binary = test::tempFileName(temp) + ".bin";
+
+  auto options = test::parseOptions(cli::mode::training);
+  options->set("max-length", 7);
+  options->set("train-sets", std::vector<std::string>({test::tempFileName(files.src), test::tempFileName(files.trg)}));
+  options->set("vocabs", std::vector<std::string>({test::tempFileName(files.vocab), test::tempFileName(files.vocab)}));
+  options->set("binary-corpus", binary);
+
+  auto expected = read(*files.open(options));
+  REQUIRE( expected.size() == 300 - 42 - 43 );
+
+  SECTION("the binary file is created on first use and reused afterwards") {
+    CHECK( !data::CorpusBinary::isBinaryCorpus(test::tempFileName(files.src)) );
+    {
+      data::CorpusBinary corpus(options);
+      CHECK( data::CorpusBinary::isBinaryCorpus(binary) );
+      CHECK( read(corpus) == expected );
+      CHECK( corpus.next().empty() );
+    }
+    std::ofstream(test::tempFileName(files.src)) << "w1\n"; // the text files are not read again
+
+    data::CorpusBinary corpus(options);
+    CHECK( read(corpus) == expected );
+
+    corpus.reset();
+    CHECK( read(corpus) == expected );
+  }
+
+  SECTION("shuffling permutes the sentences") {
+    data::CorpusBinary corpus(options);
+    corpus.shuffle();
+    auto shuffled = read(corpus);
+    CHECK( shuffled != expected );
+
+    std::sort(shuffled.begin(), shuffled.end(), [](const decltype(shuffled)::value_type& a,
+                                                   const decltype(shuffled)::value_type& b) { return a.first < b.first; });
+    CHECK( shuffled == expected );
+  }
+
+  std::remove(binary.c_str());
+}
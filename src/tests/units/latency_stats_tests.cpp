@@ -0,0 +1,78 @@
+#include "catch.hpp"
+#include "translator/latency_stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+using namespace marian;
+
+// Value of the given field of a phase in the JSON output of LatencyStats::toJson()
+static double jsonValue(const std::string& json, const std::string& phase, const std::string& field) {
+  auto begin = json.find("\"" + phase + "\":{");
+  REQUIRE( begin != std::string::npos );
+  auto end = json.find("}", begin);
+  auto pos = json.find("\"" + field + "\":", begin);
+  REQUIRE( pos < end );
+  return std::stod(json.substr(pos + field.size() + 3));
+}
+
+TEST_CASE("LatencyStats reports only phases with samples", "[latency_stats]") {
+  LatencyStats stats;
+  CHECK( stats.toJson() == "{}" );
+
+  stats.add(LatencyPhase::encoder, 0.002);
+  stats.add(LatencyPhase::topK, 0.001);
+  auto json = stats.toJson();
+  CHECK( json.find("\"encoder\":{\"count\":1,") != std::string::npos );
+  CHECK( json.find("\"top_k\":{\"count\":1,") != std::string::npos );
+  CHECK( json.find("decoder_step") == std::string::npos );
+  CHECK( json.find("request") == std::string::npos );
+}
+
+TEST_CASE("LatencyStats percentiles match exact percentiles within the bucket width", "[latency_stats]") {
+  // latencies between 0.1ms and 100ms, log-uniformly distributed like typical step and batch times
+  std::mt19937 gen(1234);
+  std::uniform_real_distribution<double> dist(std::log(1e-4), std::log(1e-1));
+  std::vector<double> samples(10000);
+  for(auto& s : samples)
+    s = std::exp(dist(gen));
+
+  LatencyStats stats;
+  for(auto s : samples)
+    stats.add(LatencyPhase::decoderStep, s);
+  auto json = stats.toJson();
+
+  std::sort(samples.begin(), samples.end());
+  double sum = 0;
+  for(auto s : samples)
+    sum += s;
+
+  // values are printed in milliseconds with 3 decimals
+  const double rounding = 0.0005;
+  CHECK( jsonValue(json, "decoder_step", "count") == samples.size() );
+  CHECK( std::abs(jsonValue(json, "decoder_step", "mean") - 1000 * sum / samples.size()) <= rounding );
+  CHECK( std::abs(jsonValue(json, "decoder_step", "max") - 1000 * samples.back()) <= rounding );
+
+  for(auto p : {std::make_pair("p50", 0.50), std::make_pair("p95", 0.95), std::make_pair("p99", 0.99)}) {
+    // nearest-rank percentile of the sorted samples
+    double exact = 1000 * samples[(size_t)std::ceil(p.second * samples.size()) - 1];
+    double reported = jsonValue(json, "decoder_step", p.first);
+    CHECK( reported >= exact - rounding );
+    CHECK( reported <= exact * 1.02 + rounding );
+  }
+}
+
+TEST_CASE("ScopedLatency adds a single sample and ignores missing stats", "[latency_stats]") {
+  auto stats = New<LatencyStats>();
+  {
+    ScopedLatency latency(stats, LatencyPhase::batch);
+    latency.stop();
+    latency.stop(); // later calls and the destructor do nothing
+  }
+  auto json = stats->toJson();
+  CHECK( jsonValue(json, "batch", "count") == 1 );
+
+  { ScopedLatency latency(nullptr, LatencyPhase::batch); }
+  CHECK( stats->toJson() == json );
+}
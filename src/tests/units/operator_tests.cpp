@@ -5,11 +5,19 @@
 #include "catch.hpp"
 #include "graph/expression_graph.h"
 #include "graph/expression_operators.h"
+#include "tensors/cpu/parallel.h"
+#include "tensors/cpu/intgemm_interface.h"
+#include "test_helpers.h"
 
 #ifdef CUDA_FOUND
 #include "tensors/gpu/backend.h"
 #endif
 
+#if USE_FBGEMM
+#include "fbgemm/Utils.h"
+#include "tensors/cpu/fbgemm/packed_gemm.h"
+#endif
+
 #include <cmath>
 
 using namespace marian;
@@ -615,6 +623,42 @@ void tests(DeviceType device, Type floatType = Type::float32) {
     CHECK(values2 == values);
   }
 
+  SECTION("affine transformation with fused activation and layer normalization") {
+    graph->clear();
+    values.clear();
+    values2.clear();
+
+    auto A = graph->constant({2, 3, 4}, inits::glorotUniform());
+    auto B = graph->constant({4, 5}, inits::glorotUniform());
+    auto bias = graph->constant({1, 5}, inits::glorotUniform());
+    auto residual = graph->constant({2, 3, 5}, inits::glorotUniform());
+    auto gamma = graph->param("gamma", {1, 5}, inits::glorotUniform());
+    auto beta = graph->param("beta", {1, 5}, inits::glorotUniform());
+
+    auto affSwish1 = affineWithActivation(A, B, bias, "swish");
+    auto affSwish2 = swish(dot(A, B) + bias);
+    auto affGelu1 = affineWithActivation(A, B, bias, "gelu");
+    auto affGelu2 = gelu(dot(A, B) + bias);
+    auto ln1 = residualLayerNorm(affSwish2, residual, gamma, beta);
+    auto ln2 = layerNorm(affSwish2 + residual, gamma, beta);
+
+    graph->forward();
+
+    CHECK(affSwish1->shape() == Shape({2, 3, 5}));
+    affSwish1->val()->get(values);
+    affSwish2->val()->get(values2);
+    CHECK( std::equal(values.begin(), values.end(), values2.begin(), floatApprox) );
+
+    affGelu1->val()->get(values);
+    affGelu2->val()->get(values2);
+    CHECK( std::equal(values.begin(), values.end(), values2.begin(), floatApprox) );
+
+    CHECK(ln1->shape() == ln2->shape());
+    ln1->val()->get(values);
+    ln2->val()->get(values2);
+    CHECK( std::equal(values.begin(), values.end(), values2.begin(), floatApprox) );
+  }
+
   SECTION("repeat") {
     graph->clear();
     values.clear();
@@ -1056,6 +1100,310 @@ TEST_CASE("Expression graph supports basic math operations (gpu fp16)", "[operat
 TEST_CASE("Expression graph supports basic math operations (cpu)", "[operator]") {
   tests<float>(DeviceType::cpu);
 }
+
+TEST_CASE("CPU operations split across intra-op threads give the same results", "[operator]") {
+  auto run = [](size_t intraThreads) {
+    cpu::IntraOpThreadPool::global().resize(intraThreads);
+
+    auto graph = New<ExpressionGraph>();
+    graph->setInference(true);
+    graph->setDevice({0, DeviceType::cpu});
+    graph->reserveWorkspaceMB(64);
+
+    std::vector<float> values(512 * 512);
+    for(size_t i = 0; i < values.size(); ++i)
+      values[i] = std::sin(0.1f * i);
+    std::vector<float> gammas(512), betas(512);
+    for(size_t i = 0; i < gammas.size(); ++i) {
+      gammas[i] = 1.f + 0.01f * i;
+      betas[i] = std::cos(0.3f * i);
+    }
+    std::vector<IndexType> indices = {511, 0, 17, 17, 42, 5, 310, 8};
+
+    auto x = graph->constant({512, 512}, inits::fromVector(values));
+    auto gamma = graph->constant({1, 512}, inits::fromVector(gammas));
+    auto beta = graph->constant({1, 512}, inits::fromVector(betas));
+    auto w = graph->constant({512, 256}, inits::fromVector(std::vector<float>(values.begin(), values.begin() + 512 * 256)));
+
+    std::vector<Expr> outputs = {
+      tanh(x * gamma + beta),
+      softmax(x),
+      logsoftmax(x),
+      layerNorm(x, gamma, beta),
+      rmsNorm(x, gamma, beta),
+      dot(x, w),
+      dot(w, x, /*transA=*/true, /*transB=*/true),
+      transpose(reshape(x, {16, 16, 8, 128}), {0, 2, 1, 3}),
+      transpose(reshape(x, {32, 16, 512}), {2, 0, 1}),
+      rows(x, indices)
+    };
+    graph->forward();
+
+    std::vector<std::vector<float>> results(outputs.size());
+    for(size_t i = 0; i < outputs.size(); ++i)
+      outputs[i]->val()->get(results[i]);
+    return results;
+  };
+
+  auto single = run(1);
+  auto multi = run(4);
+  cpu::IntraOpThreadPool::global().resize(1);
+
+  auto floatApprox = [](float x, float y) -> bool { return x == Approx(y).margin(0.001f); };
+  REQUIRE( single.size() == multi.size() );
+  for(size_t i = 0; i < single.size(); ++i) {
+    CHECK( single[i].size() == multi[i].size() );
+    CHECK( std::equal(single[i].begin(), single[i].end(), multi[i].begin(), floatApprox) );
+  }
+}
+
+TEST_CASE("Fused CPU epilogues give the same results as separate operations", "[operator]") {
+  auto run = [](bool optimize, std::vector<std::string>& types) {
+    auto graph = New<ExpressionGraph>();
+    graph->setInference(true);
+    graph->setDevice({0, DeviceType::cpu});
+    graph->getBackend()->setOptimized(optimize);
+    graph->reserveWorkspaceMB(4);
+
+    auto values = [](size_t size, float frequency) {
+      std::vector<float> v(size);
+      for(size_t i = 0; i < v.size(); ++i)
+        v[i] = std::sin(frequency * (i + 1));
+      return v;
+    };
+    auto A = graph->constant({2, 3, 4}, inits::fromVector(values(24, 0.3f)));
+    auto B = graph->constant({4, 5}, inits::fromVector(values(20, 0.7f)));
+    auto bias = graph->constant({1, 5}, inits::fromVector(values(5, 1.1f)));
+    auto residual = graph->constant({2, 3, 5}, inits::fromVector(values(30, 0.2f)));
+    auto gamma = graph->constant({1, 5}, inits::fromVector(values(5, 0.5f)));
+    auto beta = graph->constant({1, 5}, inits::fromVector(values(5, 0.9f)));
+
+    auto swish1 = affineWithActivation(A, B, bias, "swish");
+    std::vector<Expr> outputs = {
+      affineWithRelu(A, B, bias),
+      swish1,
+      affineWithActivation(A, B, bias, "gelu"),
+      affineWithActivation(A, B, bias, "gelu", /*transA=*/false, /*transB=*/false, /*scale=*/0.5f),
+      residualLayerNorm(swish1, residual, gamma, beta)
+    };
+
+    // identical fused operations are memoized, different activations and scales are not
+    if(optimize) {
+      CHECK( affineWithActivation(A, B, bias, "swish") == swish1 );
+      CHECK( residualLayerNorm(swish1, residual, gamma, beta) == outputs[4] );
+    }
+    CHECK( outputs[2] != outputs[3] );
+    CHECK( outputs[1] != outputs[2] );
+
+    graph->forward();
+
+    std::vector<std::vector<float>> results(outputs.size());
+    for(size_t i = 0; i < outputs.size(); ++i) {
+      outputs[i]->val()->get(results[i]);
+      types.push_back(outputs[i]->type());
+    }
+    return results;
+  };
+
+  std::vector<std::string> fusedTypes, separateTypes;
+  auto fused = run(/*optimize=*/true, fusedTypes);
+  auto separate = run(/*optimize=*/false, separateTypes);
+
+  CHECK( fusedTypes == std::vector<std::string>({"affineWithActivation", "affineWithActivation", "affineWithActivation",
+                                                 "affineWithActivation", "residual_layer_normalization"}) );
+  // without --optimize, e.g. for the ONNX exporter, the graph consists of the usual operations
+  CHECK( separateTypes == std::vector<std::string>({"ReLU", "swish", "swish", "swish", "layer_normalization"}) );
+
+  auto floatApprox = [](float x, float y) -> bool { return x == Approx(y).margin(0.001f); };
+  REQUIRE( fused.size() == separate.size() );
+  for(size_t i = 0; i < fused.size(); ++i) {
+    CHECK( fused[i].size() == separate[i].size() );
+    CHECK( std::equal(fused[i].begin(), fused[i].end(), separate[i].begin(), floatApprox) );
+  }
+}
+#endif
+
+#if COMPILE_CPU
+// Row-major product of a [m x k] and b [k x n], or b [n x k] if transB
+static std::vector<float> referenceProduct(const std::vector<float>& a, const std::vector<float>& b,
+                                           size_t m, size_t k, size_t n, bool transB = false) {
+  std::vector<float> c(m * n, 0.f);
+  for(size_t i = 0; i < m; ++i)
+    for(size_t j = 0; j < n; ++j)
+      for(size_t l = 0; l < k; ++l)
+        c[i * n + j] += a[i * k + l] * (transB ? b[j * k + l] : b[l * n + j]);
+  return c;
+}
+
+static std::vector<float> sinValues(size_t size, float frequency) {
+  std::vector<float> values(size);
+  for(size_t i = 0; i < values.size(); ++i)
+    values[i] = std::sin(frequency * (i + 1));
+  return values;
+}
+
+TEST_CASE("intgemm activation ranges and fixed quantization multipliers (cpu)", "[operator]") {
+  SECTION("the calibrator keeps the largest absolute value per matrix") {
+    cpu::integer::ActivationCalibrator calibrator;
+    calibrator.record("decoder_ff_logit_out_Wt", 0.5f);
+    calibrator.record("decoder_ff_logit_out_Wt", 2.f);
+    calibrator.record("decoder_ff_logit_out_Wt", 1.f);
+    calibrator.record("encoder_l1_ffn_W1", 3.f);
+
+    io::TemporaryFile ranges("/tmp/", /*earlyUnlink=*/false);
+    calibrator.save(test::tempFileName(ranges));
+
+    auto loaded = cpu::integer::ActivationCalibrator::load(test::tempFileName(ranges));
+    CHECK( loaded == std::map<std::string, float>({{"decoder_ff_logit_out_Wt", 2.f}, {"encoder_l1_ffn_W1", 3.f}}) );
+  }
+
+  SECTION("activations are quantized with the fixed multiplier instead of their own range") {
+    auto graph = New<ExpressionGraph>();
+    graph->setInference(true);
+    graph->setDevice({0, DeviceType::cpu});
+    graph->reserveWorkspaceMB(4);
+
+    auto values = sinValues(2 * 64, 0.7f);
+    auto a = graph->constant({2, 64}, inits::fromVector(values));
+    auto fixed = cpu::integer::prepareA<Type::intgemm8>(a, graph->constant({1}, inits::fromValue(20.f)));
+    auto dynamic = cpu::integer::prepareA<Type::intgemm8>(a);
+    graph->forward();
+
+    CHECK( cpu::integer::getQuantMult<Type::intgemm8>(fixed->val()) == 20.f );
+    float maxAbs = 0.f;
+    for(auto v : values)
+      maxAbs = std::max(maxAbs, std::abs(v));
+    CHECK( cpu::integer::getQuantMult<Type::intgemm8>(dynamic->val()) == Approx(127.f / maxAbs) );
+
+    const int8_t* quantized = fixed->val()->data<int8_t>();
+    for(size_t i = 0; i < values.size(); ++i)
+      CHECK( quantized[i] == (int8_t)std::nearbyint(values[i] * 20.f) );
+  }
+}
+
+TEST_CASE("Batched products of activations in intgemm (cpu)", "[operator]") {
+  // inner dimension and columns that are not multiples of what intgemm requires
+  const size_t batch = 3, m = 5, k = 37, n = 11;
+  auto aValues = sinValues(batch * m * k, 0.3f);
+  auto bValues = sinValues(batch * k * n, 0.11f);
+
+  for(std::string gemmType : {"intgemm8", "intgemm16"}) {
+    for(bool transB : {false, true}) {
+      auto graph = New<ExpressionGraph>();
+      graph->setInference(true);
+      graph->setDevice({0, DeviceType::cpu});
+      graph->getBackend()->setGemmType(gemmType);
+      graph->reserveWorkspaceMB(4);
+
+      auto a = graph->constant({(int)batch, (int)m, (int)k}, inits::fromVector(aValues));
+      auto b = graph->constant(transB ? Shape({(int)batch, (int)n, (int)k}) : Shape({(int)batch, (int)k, (int)n}),
+                               inits::fromVector(bValues));
+      auto c = bdot(a, b, /*transA=*/false, transB, /*scale=*/0.5f);
+      CHECK( c->type() == "lambda" ); // not the float DotBatchedNodeOp
+      graph->forward();
+
+      std::vector<float> values;
+      c->val()->get(values);
+      REQUIRE( values.size() == batch * m * n );
+
+      float margin = gemmType == "intgemm8" ? 0.05f : 0.005f;
+      for(size_t i = 0; i < batch; ++i) {
+        std::vector<float> aMatrix(aValues.begin() + i * m * k, aValues.begin() + (i + 1) * m * k);
+        std::vector<float> bMatrix(bValues.begin() + i * k * n, bValues.begin() + (i + 1) * k * n);
+        auto expected = referenceProduct(aMatrix, bMatrix, m, k, n, transB);
+        for(size_t j = 0; j < m * n; ++j)
+          CHECK( values[i * m * n + j] == Approx(0.5f * expected[j]).margin(margin) );
+      }
+    }
+  }
+}
+
+// Prepares a float matrix as intgemm B operand in the format of the CPU
+template <Type vtype>
+static Expr prepareIntgemmB(Expr b) {
+  auto prepareNodeOp = [](Expr out, const std::vector<Expr>& children) {
+    typedef typename cpu::integer::intgemm_<vtype>::type Integer;
+    float quantMult = cpu::integer::computeQuantMult<vtype>(children[0]->val());
+    cpu::integer::intgemm_<vtype>::width::PrepareB(children[0]->val()->data(),
+                                                   out->val()->data<Integer>(),
+                                                   quantMult,
+                                                   children[0]->shape()[-2],
+                                                   children[0]->shape()[-1]);
+    cpu::integer::getQuantMult<vtype>(out->val()) = quantMult;
+  };
+  return lambda({b}, b->shape(), cpu::integer::getIntgemmType(vtype), prepareNodeOp);
+}
+
+TEST_CASE("Columns are selected from prepared intgemm and packed matrices (cpu)", "[operator]") {
+  const size_t m = 3, k = 64, n = 24;
+  auto aValues = sinValues(m * k, 0.3f);
+  auto bValues = sinValues(k * n, 0.17f);
+  // not a multiple of 8, e.g. from LSH
+  std::vector<IndexType> indices = {23, 0, 5, 5, 17, 2, 9, 11, 20, 1, 7, 3, 14};
+
+  std::vector<float> gathered;
+  for(size_t i = 0; i < k; ++i)
+    for(auto j : indices)
+      gathered.push_back(bValues[i * n + j]);
+  auto expected = referenceProduct(aValues, gathered, m, k, indices.size());
+
+  auto graph = New<ExpressionGraph>();
+  graph->setInference(true);
+  graph->setDevice({0, DeviceType::cpu});
+  graph->reserveWorkspaceMB(4);
+
+  auto a = graph->constant({(int)m, (int)k}, inits::fromVector(aValues));
+  auto b = graph->constant({(int)k, (int)n}, inits::fromVector(bValues));
+
+  SECTION("intgemm pads the selection by repeating the last column") {
+    for(auto prepared : {prepareIntgemmB<Type::intgemm8>(b), prepareIntgemmB<Type::intgemm16>(b)}) {
+      auto selected = index_select(prepared, -1, indices);
+      CHECK( selected->value_type() == prepared->value_type() );
+      CHECK( selected->shape() == Shape({(int)k, 16}) );
+
+      auto c = dot(a, selected);
+      graph->forward();
+
+      std::vector<float> values;
+      c->val()->get(values);
+      REQUIRE( values.size() == m * 16 );
+
+      float margin = sizeOf(prepared->value_type()) == 1 ? 0.1f : 0.01f;
+      for(size_t i = 0; i < m; ++i) {
+        for(size_t j = 0; j < indices.size(); ++j)
+          CHECK( values[i * 16 + j] == Approx(expected[i * indices.size() + j]).margin(margin) );
+        for(size_t j = indices.size(); j < 16; ++j)
+          CHECK( values[i * 16 + j] == values[i * 16 + indices.size() - 1] );
+      }
+    }
+  }
+
+#if USE_FBGEMM
+  SECTION("packed int8 matrices select exactly the columns that would have been packed") {
+    auto packType = fbgemm::fbgemmHasAvx512Support() ? Type::packed8avx512 : Type::packed8avx2;
+    auto pack = [packType](Expr b) {
+      auto packNodeOp = [packType](Expr out, const std::vector<Expr>& children) {
+        int nrow, ncol;
+        uint64_t packsize;
+        cpu::variant::fbgemmPacked8PackInfo(children[0]->shape(), packType, /*transpose=*/false, nrow, ncol, packsize);
+        cpu::variant::fbgemmPacked8Pack(out->val(), children[0]->val()->data(), packType, /*transpose=*/false, nrow, ncol, packsize);
+      };
+      return lambda({b}, b->shape(), packType, packNodeOp);
+    };
+
+    auto selected = dot(a, index_select(pack(b), -1, indices));
+    auto packedGathered = dot(a, pack(graph->constant({(int)k, (int)indices.size()}, inits::fromVector(gathered))));
+    graph->forward();
+
+    std::vector<float> values, gatheredValues;
+    selected->val()->get(values);
+    packedGathered->val()->get(gatheredValues);
+    CHECK( values == gatheredValues );
+    for(size_t i = 0; i < values.size(); ++i)
+      CHECK( values[i] == Approx(expected[i]).margin(0.1f) );
+  }
+#endif
+}
 #endif
 
 #ifdef BLAS_FOUND
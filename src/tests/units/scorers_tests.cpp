@@ -0,0 +1,90 @@
+#include "catch.hpp"
+#include "marian.h"
+
+#include "models/model_factory.h"
+#include "translator/scorers.h"
+#include "test_helpers.h"
+
+#include <cstdio>
+
+using namespace marian;
+
+// Logits of the first two decoder steps for two sentences of three source words
+static std::vector<float> decode(Ptr<ExpressionGraph> graph, Ptr<Scorer> scorer) {
+  auto srcBatch = New<data::SubBatch>(2, 3, nullptr);
+  std::vector<WordIndex> srcWords = {3, 4, 5, 6, 7, 2};
+  for(size_t i = 0; i < srcWords.size(); ++i)
+    srcBatch->data()[i] = Word::fromWordIndex(srcWords[i]);
+  auto batch = New<data::CorpusBatch>(std::vector<Ptr<data::SubBatch>>({srcBatch}));
+
+  graph->clear();
+  scorer->clear(graph);
+  std::vector<IndexType> batchIndices = {0, 1};
+  auto state = scorer->startState(graph, batch);
+  state = scorer->step(graph, state, {}, {}, batchIndices, /*beamSize=*/1);
+  state = scorer->step(graph, state, {0, 1}, {Word::fromWordIndex(5), Word::fromWordIndex(8)}, batchIndices, /*beamSize=*/1);
+  auto logits = state->getLogProbs().getLogits();
+  graph->forward();
+
+  std::vector<float> values;
+  logits->val()->get(values);
+  return values;
+}
+
+static Ptr<ExpressionGraph> cpuGraph() {
+  auto graph = New<ExpressionGraph>(/*inference=*/true);
+  graph->setDevice({0, DeviceType::cpu});
+  graph->reserveWorkspaceMB(16);
+  return graph;
+}
+
+TEST_CASE("Memory-mapped models decode like loaded models", "[scorers]") {
+  Config::seed = 1234;
+
+  io::TemporaryFile temp("/tmp/", /*earlyUnlink=*/false);
+  std::string modelName = test::tempFileName(temp) + ".bin"; // only binary models can be mapped
+
+  auto options = test::parseOptions(cli::mode::translation,
+      {"--type", "transformer", "--dim-vocabs", "16", "16", "--dim-emb", "8",
+       "--transformer-heads", "2", "--transformer-dim-ffn", "16", "--enc-depth", "1", "--dec-depth", "1",
+       "--cpu-threads", "1"});
+  options->set("models", std::vector<std::string>({modelName}));
+
+  // save a randomly initialized model, parameters are created by the first decoder step
+  auto expected = [&]() {
+    auto encdec = models::createModelFromOptions(options, models::usage::translation);
+    auto scorer = New<ScorerWrapper>(encdec, "F0", 1.f, modelName);
+    auto graph = cpuGraph();
+    graph->switchParams(scorer->getName());
+    auto logits = decode(graph, scorer);
+    std::static_pointer_cast<IEncoderDecoder>(encdec)->save(graph, modelName, /*saveTranslatorConfig=*/true);
+    return logits;
+  }();
+
+  auto loadedGraph = cpuGraph();
+  auto loadedScorer = createScorers(options)[0];
+  loadedScorer->init(loadedGraph);
+  auto loaded = decode(loadedGraph, loadedScorer);
+
+  auto mmaps = mmapModels(options);
+  REQUIRE( mmaps.size() == 1 );
+  auto mappedGraph = cpuGraph();
+  auto mappedScorer = createScorers(options, mmaps)[0];
+  mappedScorer->init(mappedGraph);
+  auto mapped = decode(mappedGraph, mappedScorer);
+
+  // the parameters are not copied, they point into the mapped file
+  size_t numParams = 0;
+  for(auto param : *mappedGraph->params()) {
+    auto data = param->val()->data<char>();
+    CHECK( (data >= mmaps[0].data() && data < mmaps[0].data() + mmaps[0].size()) );
+    numParams++;
+  }
+  CHECK( numParams > 0 );
+
+  CHECK( loaded == expected );
+  CHECK( mapped == loaded );
+
+  mmaps.clear();
+  std::remove(modelName.c_str());
+}
@@ -0,0 +1,329 @@
+#include "catch.hpp"
+#include "marian.h"
+
+#include "models/model_factory.h"
+#include "translator/beam_search.h"
+#include "translator/model_registry.h"
+#include "translator/request_scheduler.h"
+#include "translator/translator.h"
+#include "test_helpers.h"
+
+#include <atomic>
+#include <cstdio>
+#include <future>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+using namespace marian;
+
+// Creates the sentences of a request with the given source lengths, their line numbers are the positions
+static std::vector<PendingSentence> makeSentences(Ptr<ServiceRequest> request, const std::vector<size_t>& lengths) {
+  std::vector<PendingSentence> sentences;
+  for(size_t i = 0; i < lengths.size(); ++i) {
+    data::SentenceTuple tuple(i);
+    tuple.push_back(Words(lengths[i], Word::fromWordIndex(1)));
+    sentences.push_back({tuple, request, std::chrono::steady_clock::now()});
+  }
+  return sentences;
+}
+
+static std::string errorMessage(std::exception_ptr error) {
+  try {
+    std::rethrow_exception(error);
+  } catch(const std::exception& e) {
+    return e.what();
+  }
+}
+
+TEST_CASE("ServiceRequest completes or fails once", "[server]") {
+  std::vector<std::string> outputs;
+  std::vector<std::string> errors;
+  auto onDone  = [&](const std::string& output) { outputs.push_back(output); };
+  auto onError = [&](std::exception_ptr error) { errors.push_back(errorMessage(error)); };
+
+  SECTION("translations are joined in line order") {
+    ServiceRequest request(2, /*quiet=*/true, /*nbest=*/false, onDone, nullptr, onError);
+    request.add(1, "b", "");
+    CHECK( outputs.empty() );
+    request.add(0, "a", "");
+    CHECK( outputs == std::vector<std::string>({"a\nb"}) );
+    CHECK( errors.empty() );
+  }
+
+  SECTION("a failed request is not completed") {
+    ServiceRequest request(2, /*quiet=*/true, /*nbest=*/false, onDone, nullptr, onError);
+    request.add(0, "a", "");
+    request.fail(std::make_exception_ptr(std::runtime_error("first")));
+    request.fail(std::make_exception_ptr(std::runtime_error("second")));
+    request.add(1, "b", "");
+    CHECK( outputs.empty() );
+    CHECK( errors == std::vector<std::string>({"first"}) );
+  }
+}
+
+TEST_CASE("Failing batches fail their requests only", "[server]") {
+  RequestScheduler scheduler(/*maxSentences=*/4, /*maxTokens=*/0, /*maxLatencyMs=*/0);
+
+  std::mutex mutex;
+  std::map<std::string, std::string> results; // request name -> output or error
+  auto makeRequest = [&](const std::string& name, size_t numSentences) {
+    return New<ServiceRequest>(numSentences, /*quiet=*/true, /*nbest=*/false,
+      [&, name](const std::string& output) { std::lock_guard<std::mutex> lock(mutex); results[name] = output; },
+      nullptr,
+      [&, name](std::exception_ptr error) { std::lock_guard<std::mutex> lock(mutex); results[name] = "error: " + errorMessage(error); });
+  };
+
+  // worker that fails on batches with a sentence of length 3 and translates others into their lengths
+  size_t numBatches = 0, numFailed = 0;
+  std::thread worker([&]() {
+    for(;;) {
+      auto batch = scheduler.pop();
+      if(batch.empty())
+        break;
+      numBatches++;
+      bool translated = translateBatch(batch, [&]() {
+        for(auto& sentence : batch)
+          if(sentence.tuple[0].size() == 3)
+            throw std::runtime_error("cannot translate");
+        for(auto& sentence : batch)
+          sentence.request->add((long)sentence.tuple.getId(), std::to_string(sentence.tuple[0].size()), "");
+      });
+      if(!translated)
+        numFailed++;
+    }
+  });
+
+  auto a = makeRequest("a", 2);
+  auto b = makeRequest("b", 1);
+  { // a and b end up in the same failing batch
+    auto sentences = makeSentences(a, {1, 3});
+    auto more = makeSentences(b, {2});
+    sentences.insert(sentences.end(), more.begin(), more.end());
+    scheduler.push(std::move(sentences));
+  }
+  // wait until the failing batch has been processed, then the worker must still serve new requests
+  for(;;) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if(results.size() == 2)
+        break;
+    }
+    std::this_thread::yield();
+  }
+  auto c = makeRequest("c", 2);
+  scheduler.push(makeSentences(c, {4, 5}));
+
+  scheduler.shutdown();
+  worker.join();
+
+  CHECK( numFailed == 1 );
+  CHECK( numBatches == 2 );
+  CHECK( results["a"] == "error: cannot translate" );
+  CHECK( results["b"] == "error: cannot translate" );
+  CHECK( results["c"] == "4\n5" );
+}
+
+// Stands in for a translation service, remembers the model it has been created for
+struct FakeService {
+  static size_t created;
+  std::string model;
+  FakeService(Ptr<Options> options) : model(options->get<std::vector<std::string>>("models")[0]) {
+    ABORT_IF(options->get<bool>("fail-to-load", false), "Cannot load model {}", model);
+    created++;
+  }
+};
+size_t FakeService::created = 0;
+
+// Options of a server with the given model configs
+static Ptr<Options> registryOptions(const std::vector<std::string>& specs) {
+  auto options = New<Options>();
+  options->set("model-configs", specs);
+  options->set("workspace", 1);
+  options->set("cpu-threads", 1);
+  options->set("devices", std::vector<std::string>({"0"}));
+  return options;
+}
+
+TEST_CASE("ModelRegistry loads, evicts and reloads models", "[server]") {
+  io::TemporaryFile vocab("/tmp/", /*earlyUnlink=*/false); // only checked for existence
+
+  // three models of 1 MB plus 1 MB workspace each, only two of them fit into the budget
+  std::vector<UPtr<io::TemporaryFile>> files;
+  std::vector<std::string> specs;
+  for(std::string name : {"a", "b", "c"}) {
+    files.emplace_back(new io::TemporaryFile("/tmp/", /*earlyUnlink=*/false));
+    auto& model = *files.back();
+    model << std::string(1024 * 1024, '0');
+    model.flush();
+
+    files.emplace_back(new io::TemporaryFile("/tmp/", /*earlyUnlink=*/false));
+    auto& config = *files.back();
+    config << "models: [" << test::tempFileName(model) << "]\n"
+           << "vocabs: [" << test::tempFileName(vocab) << ", " << test::tempFileName(vocab) << "]\n";
+    config.flush();
+    specs.push_back(name + "=" + test::tempFileName(config));
+  }
+  auto modelFile = [&](size_t i) { return test::tempFileName(*files[2 * i]); };
+
+  auto options = registryOptions(specs);
+  options->set("models-memory-budget", 4);
+
+  FakeService::created = 0;
+  ModelRegistry<FakeService> registry(options);
+  CHECK( registry.has("") );
+  CHECK( registry.has("b") );
+  CHECK( !registry.has("d") );
+
+  // models are loaded on their first request only
+  CHECK( registry.getIfLoaded("a") == nullptr );
+  auto a = registry.get("a");
+  CHECK( a->model == modelFile(0) );
+  CHECK( registry.get("") == a ); // the first registered model is the default
+  CHECK( registry.getIfLoaded("a") == a );
+  auto b = registry.get("b");
+  CHECK( FakeService::created == 2 );
+
+  // loading c unloads the least recently used model a, requests keep their service meanwhile
+  registry.get("a");
+  registry.get("b");
+  auto c = registry.get("c");
+  CHECK( c->model == modelFile(2) );
+  CHECK( registry.getIfLoaded("a") == nullptr );
+  CHECK( registry.getIfLoaded("b") == b );
+  CHECK( a->model == modelFile(0) );
+
+  // b has been used after c, so loading a again unloads c
+  auto a2 = registry.get("a");
+  CHECK( a2 != a );
+  CHECK( FakeService::created == 4 );
+  CHECK( registry.getIfLoaded("c") == nullptr );
+  CHECK( registry.getIfLoaded("b") == b );
+
+  // reloading swaps in a new service without unloading other models
+  registry.reload("b");
+  auto b2 = registry.getIfLoaded("b");
+  CHECK( b2 != nullptr );
+  CHECK( b2 != b );
+  CHECK( registry.getIfLoaded("a") == a2 );
+  CHECK( FakeService::created == 5 );
+}
+
+TEST_CASE("ModelRegistry keeps serving the previous model if a reload fails", "[server]") {
+  io::TemporaryFile model("/tmp/", /*earlyUnlink=*/false);
+  io::TemporaryFile vocab("/tmp/", /*earlyUnlink=*/false);
+  io::TemporaryFile config("/tmp/", /*earlyUnlink=*/false);
+  std::string files = "models: [" + test::tempFileName(model) + "]\n"
+                    + "vocabs: [" + test::tempFileName(vocab) + ", " + test::tempFileName(vocab) + "]\n";
+  auto writeConfig = [&](const std::string& text) {
+    io::OutputFileStream out(test::tempFileName(config));
+    out << text;
+  };
+
+  writeConfig(files);
+  FakeService::created = 0;
+  ModelRegistry<FakeService> registry(registryOptions({"a=" + test::tempFileName(config)}));
+  auto a = registry.get("a");
+  REQUIRE( a != nullptr );
+
+  std::vector<std::string> broken = {
+    "vocabs: [" + test::tempFileName(vocab) + ", " + test::tempFileName(vocab) + "]\n", // no models
+    files + "shortlist: [" + test::tempFileName(model) + ".missing]\n",                // missing file
+    files + "fail-to-load: true\n",                                                     // aborts while loading
+    "models: [unclosed\n"                                                               // not YAML
+  };
+  for(const auto& text : broken) {
+    writeConfig(text);
+    CHECK_THROWS( registry.reload("a") );
+    CHECK( registry.getIfLoaded("a") == a );
+    CHECK( !getThrowExceptionOnAbort() ); // aborts only throw while loading
+  }
+  CHECK( FakeService::created == 1 );
+
+  // the model can be reloaded once the config is fixed
+  writeConfig(files);
+  registry.reload("a");
+  CHECK( registry.getIfLoaded("a") != a );
+  CHECK( FakeService::created == 2 );
+}
+
+// Saves a tiny transformer with random parameters, which are created by a first decoder step
+static void saveRandomModel(Ptr<Options> options, const std::string& fileName) {
+  auto encdec = std::static_pointer_cast<IEncoderDecoder>(models::createModelFromOptions(options, models::usage::translation));
+  auto graph = New<ExpressionGraph>(/*inference=*/true);
+  graph->setDevice({0, DeviceType::cpu});
+  graph->reserveWorkspaceMB(16);
+
+  auto srcBatch = New<data::SubBatch>(1, 2, nullptr);
+  srcBatch->data()[0] = Word::fromWordIndex(3);
+  srcBatch->data()[1] = Word::fromWordIndex(0);
+  auto batch = New<data::CorpusBatch>(std::vector<Ptr<data::SubBatch>>({srcBatch}));
+  std::vector<IndexType> batchIndices = {0};
+  auto state = encdec->startState(graph, batch);
+  encdec->step(graph, state, {}, {}, batchIndices, /*beamSize=*/1);
+  graph->forward();
+  encdec->save(graph, fileName, /*saveTranslatorConfig=*/true);
+}
+
+TEST_CASE("Streamed sentences arrive before their request completes", "[server]") {
+  Config::seed = 1234;
+
+  test::TestVocab vocab;
+  io::TemporaryFile temp("/tmp/", /*earlyUnlink=*/true); // only used for a unique file name
+  auto model = test::tempFileName(temp) + ".bin";
+  auto options = test::parseOptions(cli::mode::server,
+      {"--type", "transformer", "--dim-vocabs", "16", "16", "--dim-emb", "8",
+       "--transformer-heads", "2", "--transformer-dim-ffn", "16", "--enc-depth", "1", "--dec-depth", "1",
+       "--cpu-threads", "1", "--beam-size", "2", "--mini-batch", "1", "--quiet-translation",
+       "--stream-sentences"});
+  options->set("models", std::vector<std::string>({model}));
+  options->set("vocabs", std::vector<std::string>(2, test::tempFileName(vocab.file)));
+  saveRandomModel(options, model);
+
+  // without --shared-batching, streamed requests are translated on a request thread
+  auto service = New<TranslateService<BeamSearch>>(options);
+
+  std::promise<void> firstSentence;
+  std::promise<void> release;
+  auto released = release.get_future().share();
+  std::promise<std::string> output;
+  std::atomic<bool> done{false};
+  std::mutex mutex;
+  std::map<long, std::string> sentences;
+
+  // one batch per sentence, so the first sentence is final before the others are translated. The
+  // first sentence waits until the caller has seen it, which only happens if run() has returned.
+  service->run("w0 w1 w2\nw3 w4\nw5 w6 w7 w8",
+               [&](const std::string& translation) {
+                 done = true;
+                 output.set_value(translation);
+               },
+               [&](long lineNum, const std::string& translation) {
+                 bool first;
+                 {
+                   std::lock_guard<std::mutex> lock(mutex);
+                   first = sentences.empty();
+                   sentences[lineNum] = translation;
+                 }
+                 if(first) {
+                   firstSentence.set_value();
+                   released.wait_for(std::chrono::seconds(10));
+                 }
+               },
+               [&](std::exception_ptr error) { output.set_exception(error); });
+
+  CHECK( firstSentence.get_future().wait_for(std::chrono::seconds(10)) == std::future_status::ready );
+  CHECK( !done );
+  release.set_value();
+
+  // the streamed sentences are the lines of the complete translation
+  auto lines = utils::split(output.get_future().get(), "\n", /*keepEmpty=*/true);
+  REQUIRE( lines.size() == 3 );
+  std::lock_guard<std::mutex> lock(mutex);
+  REQUIRE( sentences.size() == 3 );
+  for(long i = 0; i < 3; ++i)
+    CHECK( sentences[i] == lines[i] );
+
+  std::remove(model.c_str());
+}
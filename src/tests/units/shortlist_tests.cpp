@@ -0,0 +1,66 @@
+#include "catch.hpp"
+#include "data/shortlist.h"
+
+using namespace marian;
+
+// Returns the source words of a batch as shortlist and counts how often it has been called
+class CountingShortlistGenerator : public data::ShortlistGenerator {
+public:
+  mutable size_t calls{0};
+
+  Ptr<data::Shortlist> generate(Ptr<data::CorpusBatch> batch) const override {
+    calls++;
+    std::vector<WordIndex> indices;
+    for(auto w : (*batch)[0]->data())
+      indices.push_back(w.toWordIndex());
+    return New<data::Shortlist>(indices);
+  }
+};
+
+// Creates a batch with a single source sentence
+static Ptr<data::CorpusBatch> makeBatch(const std::vector<WordIndex>& words) {
+  auto subBatch = New<data::SubBatch>(1, words.size(), nullptr);
+  for(size_t i = 0; i < words.size(); ++i)
+    subBatch->data()[i] = Word::fromWordIndex(words[i]);
+  return New<data::CorpusBatch>(std::vector<Ptr<data::SubBatch>>({subBatch}));
+}
+
+TEST_CASE("CachedShortlistGenerator reuses shortlists of recent batches", "[shortlist]") {
+  auto generator = New<CountingShortlistGenerator>();
+  data::CachedShortlistGenerator cached(generator, /*srcIdx=*/0, /*capacity=*/2);
+
+  SECTION("batches with the same set of source words share a shortlist") {
+    auto first = cached.generate(makeBatch({3, 1, 2}));
+    auto second = cached.generate(makeBatch({1, 2, 3, 3}));
+    CHECK( first == second );
+    CHECK( generator->calls == 1 );
+    CHECK( cached.hits() == 1 );
+    CHECK( cached.misses() == 1 );
+
+    auto other = cached.generate(makeBatch({1, 2}));
+    CHECK( other != first );
+    CHECK( generator->calls == 2 );
+  }
+
+  SECTION("the least recently used shortlist is evicted") {
+    auto a = cached.generate(makeBatch({1, 2, 3}));
+    cached.generate(makeBatch({4}));
+    cached.generate(makeBatch({5})); // evicts {1, 2, 3}
+    CHECK( generator->calls == 3 );
+
+    cached.generate(makeBatch({4})); // {4} becomes the most recently used
+    CHECK( generator->calls == 3 );
+
+    auto again = cached.generate(makeBatch({1, 2, 3})); // generated again, evicts {5}
+    CHECK( generator->calls == 4 );
+    CHECK( again != a );
+    CHECK( again->indices() == a->indices() );
+
+    cached.generate(makeBatch({4}));
+    CHECK( generator->calls == 4 );
+    cached.generate(makeBatch({5}));
+    CHECK( generator->calls == 5 );
+    CHECK( cached.hits() == 2 );
+    CHECK( cached.misses() == 5 );
+  }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+// Helpers shared by the unit tests
+
+#include "common/config_parser.h"
+#include "common/file_stream.h"
+#include "data/vocab.h"
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace marian {
+namespace test {
+
+// Options with the defaults of the given mode and the given command-line arguments, e.g.
+// parseOptions(cli::mode::training, {"--type", "transformer"}). Each set of arguments is parsed once
+// per test program, since parsing creates the loggers; every call returns a copy that can be changed.
+static inline Ptr<Options> parseOptions(cli::mode mode, const std::vector<std::string>& args = {}) {
+  static std::map<std::pair<cli::mode, std::vector<std::string>>, Ptr<Options>> parsed;
+  auto& options = parsed[{mode, args}];
+  if(!options) {
+    std::vector<std::string> argStrings = {"marian"};
+    argStrings.insert(argStrings.end(), args.begin(), args.end());
+    std::vector<char*> argv;
+    for(auto& arg : argStrings)
+      argv.push_back(&arg[0]);
+    options = ConfigParser(mode).parseOptions((int)argv.size(), argv.data(), /*doValidate=*/false);
+  }
+  return New<Options>(*options);
+}
+
+// Name of a temporary file. TemporaryFile::getFileName() includes the null character that terminates
+// the name template, which breaks concatenation and comparison with other strings.
+static inline std::string tempFileName(const io::TemporaryFile& file) {
+  return file.getFileName().c_str();
+}
+
+// A vocabulary of </s>, <unk> and the words w0 to w13
+struct TestVocab {
+  io::TemporaryFile file{"/tmp/", /*earlyUnlink=*/false};
+
+  TestVocab() {
+    file << "</s>\n<unk>\n";
+    for(size_t i = 0; i < 14; ++i)
+      file << "w" << i << "\n";
+    file.flush();
+  }
+
+  Ptr<Vocab> load(Ptr<Options> options, size_t index) {
+    auto vocab = New<Vocab>(options, index);
+    vocab->load(tempFileName(file));
+    return vocab;
+  }
+};
+
+}  // namespace test
+}  // namespace marian
@@ -0,0 +1,192 @@
+#include "catch.hpp"
+#include "marian.h"
+
+#include "common/filesystem.h"
+#include "training/checkpoint_writer.h"
+#include "training/communicator.h"
+#include "training/gradient_buckets.h"
+#include "test_helpers.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+
+using namespace marian;
+
+static io::Item makeItem(const std::string& name, const std::vector<float>& values) {
+  io::Item item;
+  item.name  = name;
+  item.shape = { 1, (int)values.size() };
+  item.type  = Type::float32;
+  item.bytes.resize(values.size() * sizeof(float));
+  std::copy((char*)values.data(), (char*)values.data() + item.bytes.size(), item.bytes.data());
+  return item;
+}
+
+static std::vector<float> itemValues(const io::Item& item) {
+  return std::vector<float>((const float*)item.data(), (const float*)item.data() + item.shape.elements());
+}
+
+TEST_CASE("AsyncCheckpointWriter writes files in the background", "[training]") {
+  // only used for unique file names
+  io::TemporaryFile temp("/tmp/", /*earlyUnlink=*/true);
+  std::string base = test::tempFileName(temp);
+
+  for(std::string suffix : {".npz", ".bin"}) {
+    SECTION("items and text are written in order in " + suffix + " format") {
+      auto model = base + suffix;
+      auto progress = base + ".progress.yml";
+      {
+        AsyncCheckpointWriter writer;
+        std::vector<io::Item> items = {makeItem("W", {1.f, 2.f, 3.f}), makeItem("b", {4.f})};
+        writer.write(model, items);
+        items[0] = makeItem("W", {5.f, 6.f, 7.f}); // a later checkpoint replaces the first one
+        writer.write(model, items);
+        writer.write(progress, std::string("batches: 2\n"));
+        writer.wait();
+
+        CHECK( filesystem::exists(model) );
+        CHECK( !filesystem::exists(base + ".tmp" + suffix) );
+        CHECK( !filesystem::exists(base + ".progress.tmp.yml") );
+
+        auto loaded = io::loadItems(model);
+        REQUIRE( loaded.size() == 2 );
+        for(auto& item : loaded) {
+          if(item.name == "W")
+            CHECK( itemValues(item) == std::vector<float>({5.f, 6.f, 7.f}) );
+          else
+            CHECK( itemValues(item) == std::vector<float>({4.f}) );
+        }
+
+        std::ifstream in(progress);
+        CHECK( std::string(std::istreambuf_iterator<char>(in), {}) == "batches: 2\n" );
+
+        // the destructor waits for files that are still queued
+        writer.write(progress, std::string("batches: 3\n"));
+      }
+      std::ifstream in(progress);
+      CHECK( std::string(std::istreambuf_iterator<char>(in), {}) == "batches: 3\n" );
+
+      std::remove(model.c_str());
+      std::remove(progress.c_str());
+    }
+  }
+}
+
+TEST_CASE("Gradients reduced in buckets during the backward pass", "[training]") {
+  const size_t numDevices = 3;
+  std::vector<Ptr<ExpressionGraph>> graphs;
+  for(size_t i = 0; i < numDevices; ++i) {
+    auto graph = New<ExpressionGraph>();
+    graph->setDevice({i, DeviceType::cpu});
+    graph->reserveWorkspaceMB(4);
+    graphs.push_back(graph);
+  }
+  auto comm = New<DefaultCommunicator>(graphs, nullptr);
+
+  auto values = [](size_t size, float offset) {
+    std::vector<float> v(size);
+    for(size_t i = 0; i < size; ++i)
+      v[i] = 0.5f * std::sin(offset + 0.7f * i);
+    return v;
+  };
+
+  // A fixed parameter that forms a bucket without trainable parameters, and a parameter "extra"
+  // that is not used by all batches. With parameters sorted by name, the shards of the three
+  // devices are {W1, W2[:64]}, {W2[64:], a_fixed, b1} and {b2, extra}.
+  auto build = [&](Ptr<ExpressionGraph> graph, float input, bool useExtra) {
+    graph->clear();
+    auto W1 = graph->param("W1", {8, 16}, inits::fromVector(values(8 * 16, 1.f)));
+    auto b1 = graph->param("b1", {1, 16}, inits::fromVector(values(16, 2.f)));
+    auto W2 = graph->param("W2", {16, 8}, inits::fromVector(values(16 * 8, 3.f)));
+    auto b2 = graph->param("b2", {1, 8}, inits::fromVector(values(8, 4.f)));
+    auto a  = graph->param("a_fixed", {1, 16}, inits::fromValue(0.5f), /*fixed=*/true);
+    auto x  = graph->constant({4, 8}, inits::fromVector(values(4 * 8, input)));
+
+    auto y = affine(tanh(affine(x, W1, b1) * a), W2, b2);
+    auto loss = sum(sum(y * y, -1), 0);
+    if(useExtra) {
+      auto extra = graph->param("extra", {2, 64}, inits::fromVector(values(2 * 64, 5.f)));
+      loss = loss + input * sum(sum(extra * extra, -1), 0);
+    }
+    return loss;
+  };
+
+  for(size_t i = 0; i < numDevices; ++i) {
+    build(graphs[i], 0.f, /*useExtra=*/true);
+    graphs[i]->forward();
+    graphs[i]->params()->allocateBackward();
+    graphs[i]->params()->set_zero_adjoint();
+  }
+  REQUIRE( graphs[0]->params()->grads()->size() % numDevices == 0 );
+
+  // Device 0 processes two batches, the second one without "extra", device 1 one batch and device 2 none.
+  // Returns the gradients of all devices after the reduction.
+  auto computeGradients = [&](std::function<void(size_t, Ptr<ExpressionGraph>, bool)> backward,
+                              std::function<void(size_t)> done,
+                              std::function<void()> reduce) {
+    std::vector<std::vector<std::pair<float, bool>>> batches = {{{1.f, true}, {2.f, false}}, {{3.f, true}}, {}};
+    comm->foreach([&](size_t i, size_t /*begin*/, size_t /*end*/) {
+      for(size_t warp = 0; warp < batches[i].size(); ++warp) {
+        build(graphs[i], batches[i][warp].first, batches[i][warp].second);
+        graphs[i]->forward();
+        backward(i, graphs[i], warp + 1 == batches[i].size());
+      }
+      done(i);
+      return true;
+    });
+    reduce();
+
+    std::vector<std::vector<float>> grads(numDevices);
+    for(size_t i = 0; i < numDevices; ++i) {
+      graphs[i]->params()->grads()->get(grads[i]);
+      graphs[i]->params()->set_zero_adjoint();
+    }
+    return grads;
+  };
+
+  auto expected = computeGradients([](size_t, Ptr<ExpressionGraph> graph, bool) { graph->backward(/*zero=*/false); },
+                                   [](size_t) {},
+                                   [&]() { comm->scatterReduceAndResetGrads(); });
+
+  for(size_t bucketBytes : {64, 1024, 1024 * 1024}) {
+    SECTION("with buckets of " + std::to_string(bucketBytes) + " bytes") {
+      std::vector<size_t> localReady(numDevices, 0); // [local device index] number of completed buckets
+      std::vector<size_t> reduced;                   // beginnings of the reduced buckets in order
+      GradientBuckets buckets(graphs[0], bucketBytes, numDevices,
+                              [&](size_t i, size_t, size_t) { localReady[i]++; },
+                              [&](size_t begin, size_t end) {
+                                reduced.push_back(begin);
+                                comm->scatterReduceAndResetGrads(begin, end);
+                              });
+      size_t expectedBuckets = bucketBytes == 64 ? 6 : (bucketBytes == 1024 ? 2 : 1);
+      REQUIRE( buckets.size() == expectedBuckets );
+      CHECK( buckets.range(0).first == 0 );
+      CHECK( buckets.range(buckets.size() - 1).second == graphs[0]->params()->grads()->size() );
+
+      // the buckets are reused for several updates
+      for(size_t update = 0; update < 2; ++update) {
+        buckets.start();
+        auto grads = computeGradients(
+            [&](size_t i, Ptr<ExpressionGraph> graph, bool lastWarp) {
+              if(lastWarp)
+                graph->setParamGradientHook([&, i](Expr param) { buckets.paramGradientReady(i, param); });
+              graph->backward(/*zero=*/false);
+              graph->setParamGradientHook(nullptr);
+            },
+            [&](size_t i) { buckets.release(i); },
+            [&]() { buckets.wait(); });
+
+        CHECK( grads == expected );
+        CHECK( localReady == std::vector<size_t>(numDevices, (update + 1) * buckets.size()) );
+        CHECK( reduced.size() == (update + 1) * buckets.size() );
+      }
+
+      // all buckets are reduced in the same order
+      for(size_t i = 0; i < reduced.size(); ++i)
+        CHECK( reduced[i] == buckets.range(buckets.size() - 1 - i % buckets.size()).first );
+    }
+  }
+}
@@ -0,0 +1,98 @@
+#include "catch.hpp"
+#include "marian.h"
+
+#include "models/encoder_decoder.h"
+#include "models/model_factory.h"
+#include "test_helpers.h"
+
+using namespace marian;
+
+// Options of a tiny transformer for inference
+static Ptr<Options> transformerOptions() {
+  auto options = test::parseOptions(cli::mode::training,
+      {"--type", "transformer", "--dim-vocabs", "16", "16", "--dim-emb", "8",
+       "--transformer-heads", "2", "--transformer-dim-ffn", "16", "--enc-depth", "1", "--dec-depth", "2",
+       "--vocabs", "vocab.src", "vocab.trg"}); // names only, the vocabularies are not loaded
+  options->set("inference", true);
+  return options;
+}
+
+TEST_CASE("Transformer decoder with and without key/value cache", "[transformer]") {
+  Config::seed = 1234;
+
+  auto graph = New<ExpressionGraph>(/*inference=*/true);
+  graph->setDevice({0, DeviceType::cpu});
+  graph->reserveWorkspaceMB(16);
+
+  // two sentences of three source words
+  auto srcBatch = New<data::SubBatch>(2, 3, nullptr);
+  std::vector<WordIndex> srcWords = {3, 4, 5, 6, 7, 2};
+  for(size_t i = 0; i < srcWords.size(); ++i)
+    srcBatch->data()[i] = Word::fromWordIndex(srcWords[i]);
+  auto batch = New<data::CorpusBatch>(std::vector<Ptr<data::SubBatch>>({srcBatch}));
+
+  // shapes of the decoder states of the first layer after each step
+  std::vector<Shape> stateShapes;
+
+  // decodes with beam size 2 and a fixed choice of words and hypotheses, returns the logits of all steps
+  auto decode = [&](bool kvCache, float maxLengthFactor) {
+    auto options = transformerOptions()->with("transformer-decoder-kv-cache", kvCache,
+                                              "max-length-factor", maxLengthFactor);
+    auto model = std::dynamic_pointer_cast<IEncoderDecoder>(models::createModelFromOptions(options, models::usage::translation));
+
+    graph->clear(); // parameters are kept, so both models use the same ones
+    model->clear(graph);
+    auto state = model->startState(graph, batch);
+    std::vector<IndexType> batchIndices = {0, 1};
+
+    std::vector<Expr> logits;
+    stateShapes.clear();
+    state = model->step(graph, state, {}, {}, batchIndices, /*beamSize=*/1);
+    logits.push_back(state->getLogProbs().getLogits());
+    stateShapes.push_back(state->getStates()[0].output->shape());
+
+    // [beamIndex * batch size + batchIndex]
+    std::vector<std::vector<IndexType>> hypIndices = {{0, 1, 0, 1}, {2, 1, 0, 3}, {0, 3, 2, 1}};
+    std::vector<std::vector<WordIndex>> words = {{5, 8, 9, 3}, {4, 4, 10, 11}, {12, 6, 7, 13}};
+    for(size_t t = 0; t < hypIndices.size(); ++t) {
+      Words stepWords;
+      for(auto w : words[t])
+        stepWords.push_back(Word::fromWordIndex(w));
+      state = model->step(graph, state, hypIndices[t], stepWords, batchIndices, /*beamSize=*/2);
+      logits.push_back(state->getLogProbs().getLogits());
+      stateShapes.push_back(state->getStates()[0].output->shape());
+    }
+    graph->forward();
+
+    std::vector<std::vector<float>> values(logits.size());
+    for(size_t t = 0; t < logits.size(); ++t)
+      logits[t]->val()->get(values[t]);
+    return values;
+  };
+
+  auto uncached = decode(/*kvCache=*/false, /*maxLengthFactor=*/3.f);
+
+  auto checkEqual = [&](const std::vector<std::vector<float>>& cached) {
+    REQUIRE( cached.size() == uncached.size() );
+    for(size_t t = 0; t < cached.size(); ++t) {
+      REQUIRE( cached[t].size() == uncached[t].size() );
+      for(size_t i = 0; i < cached[t].size(); ++i)
+        CHECK( cached[t][i] == Approx(uncached[t][i]).margin(0.0001f) );
+    }
+  };
+
+  SECTION("cache preallocated for the maximum output length") {
+    checkEqual(decode(/*kvCache=*/true, /*maxLengthFactor=*/3.f));
+    // 3 source words * 3 + 1 positions for 2 heads, the same shape in all steps after the first
+    CHECK( stateShapes[0] == Shape({1, 2, 2 * 10, 4}) );
+    for(size_t t = 1; t < stateShapes.size(); ++t)
+      CHECK( stateShapes[t] == Shape({2, 2, 2 * 10, 4}) );
+  }
+
+  SECTION("cache extended beyond the maximum output length") {
+    checkEqual(decode(/*kvCache=*/true, /*maxLengthFactor=*/0.5f));
+    // ceil(3 source words * 0.5) + 1 positions, doubled in the last step
+    CHECK( stateShapes[2] == Shape({2, 2, 2 * 3, 4}) );
+    CHECK( stateShapes[3] == Shape({2, 2, 2 * 6, 4}) );
+  }
+}
@@ -0,0 +1,54 @@
+#include "training/checkpoint_writer.h"
+#include "common/filesystem.h"
+#include "common/logging.h"
+
+#include <fstream>
+
+namespace marian {
+
+AsyncCheckpointWriter::~AsyncCheckpointWriter() {
+  try {
+    wait();
+  } catch(const std::exception& e) {
+    LOG(critical, "[training] Writing checkpoint failed: {}", e.what());
+  }
+}
+
+std::string AsyncCheckpointWriter::tempName(const std::string& fileName) {
+  // keep the suffix, io::saveItems() determines the format from it
+  auto pos = fileName.find_last_of('.');
+  if(pos == std::string::npos)
+    return fileName + ".tmp";
+  return fileName.substr(0, pos) + ".tmp" + fileName.substr(pos);
+}
+
+void AsyncCheckpointWriter::write(const std::string& fileName, std::vector<io::Item> items) {
+  auto snapshot = New<std::vector<io::Item>>(std::move(items));
+  pending_.push_back(pool_.enqueue([fileName, snapshot]() {
+    auto tmp = tempName(fileName);
+    io::saveItems(tmp, *snapshot);
+    filesystem::rename(tmp, fileName);
+    LOG(info, "[training] Finished writing {}", fileName);
+  }));
+}
+
+void AsyncCheckpointWriter::write(const std::string& fileName, std::string text) {
+  auto content = New<std::string>(std::move(text));
+  pending_.push_back(pool_.enqueue([fileName, content]() {
+    auto tmp = tempName(fileName);
+    {
+      std::ofstream out(tmp);
+      out << *content;
+      ABORT_IF(!out, "Could not write {}", tmp);
+    }
+    filesystem::rename(tmp, fileName);
+  }));
+}
+
+void AsyncCheckpointWriter::wait() {
+  for(auto& done : pending_)
+    done.get();
+  pending_.clear();
+}
+
+}  // namespace marian
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "3rd_party/threadpool.h"
+#include "common/definitions.h"
+#include "common/io.h"
+
+#include <future>
+#include <string>
+#include <vector>
+
+namespace marian {
+
+/**
+ * Writes model and checkpoint files on a background thread for --async-checkpoint.
+ *
+ * The caller hands over host copies of the items (see io::SaveItemsRedirect), so training can
+ * continue while they are serialized and written to disk. Files are written in the order they were
+ * passed in, first to a temporary file next to the target which is then renamed, so that an
+ * interrupted write never leaves a truncated model or checkpoint behind.
+ */
+class AsyncCheckpointWriter {
+private:
+  ThreadPool pool_{1}; // a single thread keeps the files in order
+  std::vector<std::future<void>> pending_;
+
+  static std::string tempName(const std::string& fileName);
+
+public:
+  ~AsyncCheckpointWriter();
+
+  // Queues items for writing to fileName in .npz or .bin format
+  void write(const std::string& fileName, std::vector<io::Item> items);
+
+  // Queues text, e.g. the training progress, for writing to fileName
+  void write(const std::string& fileName, std::string text);
+
+  // Blocks until all queued files have been written
+  void wait();
+};
+
+}  // namespace marian
@@ -53,6 +53,14 @@ public:
   // @TODO: We probably can still share foreach() between the two implementations. Just need to move some helper functions from the .cu file.
 
   virtual void scatterReduceAndResetGrads() const = 0; // reduce param gradients and scatter into gradient shards
+
+  // Whether scatterReduceAndResetGrads(begin, end) is supported, to reduce parts of the gradient while the backward pass runs
+  virtual bool supportsPartialReduce() const { return false; }
+  // Same as scatterReduceAndResetGrads() for the index range [begin, end) of the concatenated gradient vector only.
+  // May be called from a different thread than foreach(), for a range that no local graph writes to anymore.
+  virtual void scatterReduceAndResetGrads(size_t /*begin*/, size_t /*end*/) const {
+    ABORT("Partial gradient reduction is not supported by this communicator");
+  }
   virtual void allGatherParams() const = 0;     // redistribute value shards into param values
   virtual void broadcastParams(bool average = false) const = 0;  // average corresponding parameters across all workers
   virtual void broadcastShards(const std::vector<Ptr<OptimizerBase>>& opts, bool average = false) const = 0;
@@ -253,6 +261,35 @@ public:
     foreach(reset);
   }
 
+  bool supportsPartialReduce() const override { return true; }
+
+  void scatterReduceAndResetGrads(size_t begin, size_t end) const override {
+    const_cast<DefaultCommunicator*>(this)->lazyInit();
+
+    // Sum the parts of the range that fall into each shard into the shard owner, and reset them everywhere else
+    for(size_t idx = 0; idx < graphs_.size(); ++idx) {
+      size_t shardBegin, shardEnd; std::tie
+      (shardBegin, shardEnd) = localShardRange(idx);
+      size_t partBegin = std::max(begin, shardBegin);
+      size_t partEnd   = std::min(end, shardEnd);
+      if(partBegin >= partEnd)
+        continue;
+
+      auto curGrad = graphs_[idx]->params()->grads()->subtensor(partBegin, partEnd - partBegin);
+      auto tmp = tmpTensors_[idx]->subtensor(0, partEnd - partBegin);
+      for(auto graph : graphs_) {
+        if(graph != graphs_[idx]) {
+          auto subGrad = graph->params()->grads()->subtensor(partBegin, partEnd - partBegin);
+          tmp->copyFrom(subGrad);
+
+          using namespace functional;
+          Element(_1 = _1 + _2, curGrad, tmp);
+          subGrad->set(0.f);
+        }
+      }
+    }
+  }
+
   void allGatherParams() const override {
     // Update all graphs with parameter shard
     auto gather = [this](size_t idx, size_t begin, size_t end) {
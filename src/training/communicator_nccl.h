@@ -306,6 +306,60 @@ public:
     foreach(resetGrads);
   }
 
+  bool supportsPartialReduce() const override { return true; }
+
+  // Reduces the range [begin, end) while the backward pass may still run on the compute streams.
+  // The caller makes sure that the range is complete on all local devices, so we do not synchronize
+  // with the NULL stream here. All processes must reduce their ranges in the same order.
+  void scatterReduceAndResetGrads(size_t begin, size_t end) const override {
+    // the part of [begin, end) that falls into the shard of the given (local or global) rank
+    auto overlap = [&](std::pair<size_t, size_t> shard) {
+      size_t partBegin = std::min(std::max(begin, shard.first), end);
+      size_t partEnd   = std::max(partBegin, std::min(end, shard.second));
+      return std::make_pair(partBegin, partEnd);
+    };
+
+    groupStart();
+    for(int i = 0; i < graphs_.size(); ++i) {
+      auto grads = graphs_[i]->params()->grads();
+      ncclDataType_t ncclFloatType = ncclFloat32;
+      if(grads->type() == Type::float16)
+        ncclFloatType = ncclFloat16;
+
+      if(shardingMode_ == ShardingMode::global) {
+        auto* buf = grads->subtensor(begin, end-begin)->data();
+        NCCL_CHECK(ncclAllReduce(buf, buf, end-begin, ncclFloatType, ncclSum, globalComms_[i], streams_[i]));
+      } else {
+        // the shards are not aligned with the range, so reduce each part into the local device that owns it
+        for(size_t j = 0; j < numLocalRanks(); ++j) {
+          auto part = overlap(localShardRange(j));
+          if(part.first < part.second) {
+            auto* buf = grads->subtensor(part.first, part.second-part.first)->data();
+            NCCL_CHECK(ncclReduce(buf, buf, part.second-part.first, ncclFloatType, ncclSum, (int)j, localComms_[i], streams_[i]));
+          }
+        }
+        auto part = overlap(localShardRange(i)); // then do tuple-wise allReduce across processes
+        if(part.first < part.second) {
+          auto* buf = grads->subtensor(part.first, part.second-part.first)->data();
+          NCCL_CHECK(ncclAllReduce(buf, buf, part.second-part.first, ncclFloatType, ncclSum, globalComms_[i], streams_[i]));
+        }
+      }
+    }
+    groupEnd();
+
+    // reset the gradients of the range outside the local shard, queued behind the reduction
+    for(int i = 0; i < graphs_.size(); ++i) {
+      auto grads = graphs_[i]->params()->grads();
+      auto part = overlap(localShardRange(i));
+      CUDA_CHECK(cudaSetDevice(devices_[i]));
+      if(begin < part.first)
+        CUDA_CHECK(cudaMemsetAsync(grads->subtensor(begin, part.first-begin)->data(), 0, (part.first-begin) * sizeOf(grads->type()), streams_[i]));
+      if(part.second < end)
+        CUDA_CHECK(cudaMemsetAsync(grads->subtensor(part.second, end-part.second)->data(), 0, (end-part.second) * sizeOf(grads->type()), streams_[i]));
+    }
+    synchronizeAll();
+  }
+
   // This distributes all 64 model shards to all 64 GPUs.
   // @TODO: For unknown reasons, this takes longer than any other operation incl. scatterReduceAndResetGrads().
   //        But both should have the same number of data transfers of the same size.
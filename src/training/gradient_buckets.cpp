@@ -0,0 +1,87 @@
+#include "training/gradient_buckets.h"
+
+#include <algorithm>
+
+namespace marian {
+
+GradientBuckets::GradientBuckets(Ptr<ExpressionGraph> graph,
+                                 size_t bucketBytes,
+                                 size_t numLocalDevices,
+                                 const LocalFunc& localFunc,
+                                 const ReduceFunc& reduceFunc)
+    : numLocalDevices_(numLocalDevices),
+      localFunc_(localFunc),
+      reduceFunc_(reduceFunc),
+      pendingParams_(numLocalDevices),
+      reduceThread_(1) {
+  auto grads = graph->params()->grads();
+  ABORT_IF(!grads, "Gradients must be allocated before they can be split into buckets");
+
+  // all graphs have the same memory layout, see Parameters::allocateBackward()
+  std::vector<Expr> params(graph->params()->begin(), graph->params()->end());
+  std::sort(params.begin(), params.end(),
+            [](Expr a, Expr b) { return a->grad()->data<char>() < b->grad()->data<char>(); });
+
+  size_t begin = 0;
+  size_t numParams = 0;
+  for(auto p : params) {
+    if(p->trainable()) { // fixed parameters are not on the tape
+      paramBuckets_[p->name()] = buckets_.size();
+      numParams++;
+    }
+    size_t end = (p->grad()->data<char>() - grads->data<char>()) / sizeOf(grads->type()) + p->grad()->size();
+    if((end - begin) * sizeOf(grads->type()) >= bucketBytes) {
+      buckets_.push_back({begin, end});
+      bucketParams_.push_back(numParams);
+      begin = end;
+      numParams = 0;
+    }
+  }
+  if(begin < grads->size() || buckets_.empty()) {
+    buckets_.push_back({begin, grads->size()});
+    bucketParams_.push_back(numParams);
+  }
+}
+
+void GradientBuckets::start() {
+  for(auto& pending : pendingParams_)
+    pending = bucketParams_;
+  pendingDevices_.assign(buckets_.size(), numLocalDevices_);
+  nextBucket_ = buckets_.size();
+}
+
+void GradientBuckets::paramGradientReady(size_t localDeviceIndex, Expr param) {
+  auto it = paramBuckets_.find(param->name());
+  if(it == paramBuckets_.end()) // e.g. parameters of another element type
+    return;
+  if(--pendingParams_[localDeviceIndex][it->second] == 0)
+    localBucketReady(localDeviceIndex, it->second);
+}
+
+void GradientBuckets::release(size_t localDeviceIndex) {
+  for(size_t bucket = 0; bucket < buckets_.size(); ++bucket)
+    if(pendingParams_[localDeviceIndex][bucket] != 0 || bucketParams_[bucket] == 0)
+      localBucketReady(localDeviceIndex, bucket);
+}
+
+void GradientBuckets::wait() {
+  for(auto& reduction : reductions_)
+    reduction.get();
+  reductions_.clear();
+  ABORT_IF(nextBucket_ != 0, "Gradient buckets were not released on all local devices");
+}
+
+void GradientBuckets::localBucketReady(size_t localDeviceIndex, size_t bucket) {
+  localFunc_(localDeviceIndex, buckets_[bucket].first, buckets_[bucket].second);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  --pendingDevices_[bucket];
+  // enqueue all buckets complete on all local devices that are next in order
+  for(; nextBucket_ > 0 && pendingDevices_[nextBucket_ - 1] == 0; nextBucket_--) {
+    size_t begin = buckets_[nextBucket_ - 1].first;
+    size_t end   = buckets_[nextBucket_ - 1].second;
+    reductions_.push_back(reduceThread_.enqueue([this, begin, end]() { reduceFunc_(begin, end); }));
+  }
+}
+
+}  // namespace marian
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "graph/expression_graph.h"
+#include "3rd_party/threadpool.h"
+
+#include <functional>
+#include <future>
+#include <mutex>
+#include <unordered_map>
+
+namespace marian {
+
+// Splits the concatenated gradient vector of a set of local graphs with identical memory layout at
+// parameter boundaries into contiguous buckets of at least a given size, and tracks during the backward
+// pass which buckets are complete. A bucket is reduced on a separate thread as soon as the gradients of
+// all its trainable parameters are complete on all local devices, while the backward pass continues.
+//
+// Buckets are reduced in order of decreasing index, i.e. roughly in the order in which the backward
+// pass completes them, and in the same order on all processes, as required by NCCL collectives.
+class GradientBuckets {
+public:
+  // Called on the thread of the local device once the device has completed the range [begin, end)
+  typedef std::function<void(size_t /*localDeviceIndex*/, size_t /*begin*/, size_t /*end*/)> LocalFunc;
+  // Called on the reduction thread once all local devices have completed the range [begin, end)
+  typedef std::function<void(size_t /*begin*/, size_t /*end*/)> ReduceFunc;
+
+  GradientBuckets(Ptr<ExpressionGraph> graph,
+                  size_t bucketBytes,
+                  size_t numLocalDevices,
+                  const LocalFunc& localFunc,
+                  const ReduceFunc& reduceFunc);
+
+  size_t size() const { return buckets_.size(); }
+  const std::pair<size_t, size_t>& range(size_t bucket) const { return buckets_[bucket]; }
+
+  // Prepares for the backward pass of all local devices
+  void start();
+  // Called from the backward pass of the local device when the gradient of a parameter is complete
+  void paramGradientReady(size_t localDeviceIndex, Expr param);
+  // Marks all remaining buckets of the local device as complete, e.g. with parameters not used by the
+  // batch, buckets without trainable parameters, or all buckets of a device without sub-batch
+  void release(size_t localDeviceIndex);
+  // Waits for the reductions of all buckets, after release() was called for all local devices
+  void wait();
+
+private:
+  std::vector<std::pair<size_t, size_t>> buckets_;       // [bucket index] range in the concatenated gradient vector
+  std::unordered_map<std::string, size_t> paramBuckets_; // trainable parameter name -> bucket index
+  std::vector<size_t> bucketParams_;                     // [bucket index] number of trainable parameters in the bucket
+  size_t numLocalDevices_;
+  LocalFunc localFunc_;
+  ReduceFunc reduceFunc_;
+
+  std::vector<std::vector<size_t>> pendingParams_;       // [local device index][bucket index] parameters whose gradients are not complete yet
+  std::vector<size_t> pendingDevices_;                   // [bucket index] local devices that have not completed the bucket yet
+  size_t nextBucket_{0};                                 // buckets with a lower index have not been enqueued for reduction yet
+  std::vector<std::future<void>> reductions_;            // running bucket reductions of the current backward pass
+  std::mutex mutex_;                                     // guards pendingDevices_, nextBucket_ and reductions_
+  ThreadPool reduceThread_;                              // runs the bucket reductions
+
+  void localBucketReady(size_t localDeviceIndex, size_t bucket);
+};
+
+}  // namespace marian
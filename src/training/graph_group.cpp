@@ -49,6 +49,11 @@ GraphGroup::GraphGroup(Ptr<Options> options, Ptr<IMPIWrapper> mpi)
     LOG_ONCE(info, "Checking gradient for NaN");
   }
 
+  if(options_->get<bool>("async-checkpoint", false)) {
+    checkpointWriter_ = New<AsyncCheckpointWriter>();
+    LOG_ONCE(info, "Writing model files and checkpoints in the background");
+  }
+
   initGraphsAndOpts();
 
   // Note: We may well end up with only one MPI process or only one graph per worker.
@@ -385,7 +390,10 @@ void GraphGroup::saveCheckpoint(const std::string& modelFileName,
 
     
     LOG(info, "[training] Saving training checkpoint to {} and {}", modelFileName, checkpointName);
-    io::saveItems(checkpointName, items);
+    if(checkpointWriter_)
+      checkpointWriter_->write(checkpointName, std::move(items));
+    else
+      io::saveItems(checkpointName, items);
   }
 }
 
@@ -405,13 +413,34 @@ void GraphGroup::save(bool isFinal,
   barrier(); // (for better grouping of log messages)
   
   std::string modelFileName = options_->get<std::string>("model");
+
+  // With --async-checkpoint the host copies of all parameters and optimizer states are handed over
+  // to the background writer, so training resumes as soon as they have been gathered. Waiting for
+  // the previous checkpoint first keeps at most one of them in memory.
+  std::unique_ptr<io::SaveItemsRedirect> redirect;
+  std::vector<std::pair<std::string, std::string>> schedulerFiles;
+  if(checkpointWriter_) {
+    checkpointWriter_->wait();
+    redirect.reset(new io::SaveItemsRedirect([this](const std::string& fileName, const std::vector<io::Item>& items) {
+      checkpointWriter_->write(fileName, items);
+    }));
+  }
+
+  auto saveScheduler = [&]() {
+    if(!scheduler_)
+      return;
+    if(checkpointWriter_) // written after the checkpoint, so that the progress never refers to files that are not complete yet
+      schedulerFiles = scheduler_->snapshot(modelFileName);
+    else
+      scheduler_->save(modelFileName);
+  };
+
   if(isMainProcess()) {
     // save main model file
     if(options_->get<bool>("overwrite")) {
       models_[0]->save(graphs_[0], modelFileName, /*saveTranslatorConfig=*/true);
       // save scheduler-related state
-      if(scheduler_)
-        scheduler_->save(modelFileName);
+      saveScheduler();
     } else {
       if(!isFinal) { // save a model with iteration number
         std::string numberOfBatches = scheduler_ ? std::to_string(scheduler_->numberOfBatches()) : "unknown";
@@ -422,13 +451,20 @@ void GraphGroup::save(bool isFinal,
       models_[0]->save(graphs_[0], modelFileName, /*saveTranslatorConfig=*/true);
 
       // save scheduler-related state
-      if(scheduler_)
-        scheduler_->save(modelFileName);
+      saveScheduler();
     }
   }
+  redirect.reset();
 
   swapWithSmoothed();
   saveCheckpoint(modelFileName, gatherOptimizerStateFn);
+
+  if(checkpointWriter_) {
+    for(auto& file : schedulerFiles)
+      checkpointWriter_->write(file.first, std::move(file.second));
+    if(isFinal) // the final model has to be complete when training ends
+      checkpointWriter_->wait();
+  }
   
   barrier(); // (for better grouping of log messages)
 }
@@ -453,6 +489,8 @@ void GraphGroup::validate() { //@TODO: rename this function to something less co
 }
 
 void GraphGroup::finalize() {
+  if(checkpointWriter_)
+    checkpointWriter_->wait();
   finalized_ = true;
 }
 
@@ -6,6 +6,7 @@
 #include "graph/expression_graph.h"
 #include "models/model_base.h"
 #include "optimizers/optimizers.h"
+#include "training/checkpoint_writer.h"
 #include "training/scheduler.h"
 #include "training/communicator.h"
 
@@ -76,6 +77,8 @@ protected:
 
   bool checkGradientNan_{false};
 
+  Ptr<AsyncCheckpointWriter> checkpointWriter_; // writes model and checkpoint files in the background if --async-checkpoint
+
   // determines the number of input streams (i.e. input files or fields in the TSV input) that need
   // to be included in the batch, i.e. without alignments and weights
   size_t numberOfInputFiles();
@@ -49,6 +49,45 @@ void SyncGraphGroup::initialize(const Ptr<data::Batch>& exampleBatch) {
   double multiplier = devices_.size() /** mpi_->numMPIProcesses()*/ * delay_; // @TODO: make this optional? Comment what is going on.
   bool isDynamic = scheduler_->isDynamicMBSizeScaling();
   updateMultiplier_ = isDynamic ? multiplier : 1.; // multiplier applied later in update()
+
+  initializeBuckets();
+}
+
+// Reduces the gradients in buckets of at least --sync-bucket-size MB while the backward pass is still running,
+// see GradientBuckets.
+void SyncGraphGroup::initializeBuckets() {
+  size_t bucketBytes = options_->get<size_t>("sync-bucket-size", 0) * 1024 * 1024;
+  if(bucketBytes == 0 || devices_.size() * mpi_->numMPIProcesses() < 2)
+    return;
+
+  if(!comm_->supportsPartialReduce()) {
+    LOG(info, "[training] The communicator cannot reduce gradients in buckets, ignoring --sync-bucket-size");
+    return;
+  }
+
+  auto localFunc = [this](size_t localDeviceIndex, size_t begin, size_t end) {
+    auto graph = graphs_[localDeviceIndex];
+    clipLocalGradients(graph->params()->grads()->subtensor(begin, end - begin));
+    graph->getBackend()->synchronize(); // the bucket is reduced on another thread
+  };
+  auto reduceFunc = [this](size_t begin, size_t end) { comm_->scatterReduceAndResetGrads(begin, end); };
+  buckets_ = New<GradientBuckets>(graphs_[0], bucketBytes, devices_.size(), localFunc, reduceFunc);
+  LOG(info, "[training] Reducing gradients in {} buckets during the backward pass", buckets_->size());
+}
+
+// Handle local gradient explosion but only clip to largest possible value
+// given number of GPUs and type. Should clip rarely. Also clips inf
+// We do another clipping/rescaling after summation.
+void SyncGraphGroup::clipLocalGradients(Tensor grads) {
+#if 1
+  // experimental and should eventually be somewhere else
+  if(sizeOf(grads->type()) < sizeOf(Type::float32)) {
+    using namespace functional;
+    size_t numGpus = mpi_->numMPIProcesses() * devices_.size();
+    float clipValue = NumericLimits<float>(grads->type()).max / (float)numGpus;
+    Element(_1 = clip(_1, clipValue), grads);
+  }
+#endif
 }
 
 Ptr<data::BatchStats> SyncGraphGroup::collectStats(const std::vector<Ptr<Vocab>>& vocabs) {
@@ -235,6 +274,9 @@ void SyncGraphGroup::update(std::vector<Ptr<data::Batch>> subBatches, size_t num
     first_ = false;
   }
 
+  if(buckets_)
+    buckets_->start();
+
   // Compute gradients
   // This happens in multiple steps in case of delay > 1.
   std::vector<StaticLoss> localDeviceLosses(devices_.size()); // [local device index] aggregate cost for each local device
@@ -259,29 +301,29 @@ void SyncGraphGroup::update(std::vector<Ptr<data::Batch>> subBatches, size_t num
         localDeviceLosses[localDeviceIndex] += *rationalLoss;
       }
 
+      // the last backward pass on this device completes the gradients, so buckets can be reduced while it runs
+      bool lastWarp = buckets_ && !getSubBatch(warp + 1, localDeviceIndex, mpi_->myMPIRank());
+      if(lastWarp)
+        graph->setParamGradientHook([this, localDeviceIndex](Expr param) { buckets_->paramGradientReady(localDeviceIndex, param); });
       graph->backward(/*zero=*/false); // (gradients are reset before we get here)
+      if(lastWarp)
+        graph->setParamGradientHook(nullptr);
     }
 
-#if 1 
-    // experimental and should eventually be somewhere else
-    // Handle local gradient explosion but only clip to largest possible value
-    // given number of GPUs and type. Should clip rarely. Also clips inf
-    // We do another clipping/rescaling after summation.
-    auto gradType = graph->params()->grads()->type();
-    if(sizeOf(gradType) < sizeOf(Type::float32)) {
-      using namespace functional;
-      size_t numGpus = mpi_->numMPIProcesses() * devices_.size();
-      float clipValue = NumericLimits<float>(gradType).max / (float)numGpus;
-      Element(_1 = clip(_1, clipValue), graph->params()->grads());
-    }
-#endif
+    if(buckets_)
+      buckets_->release(localDeviceIndex); // clips the remaining buckets of this device
+    else
+      clipLocalGradients(graph->params()->grads());
 
     return true; // dummy success
   });
 
   // At this point, each device on each MPI process has a gradient aggregated over a subset of the sub-batches.
   // check for Nan or Inf in all summed up shards
-  comm_->scatterReduceAndResetGrads(); // reduce gradients across all devices (globally) into shards
+  if(buckets_) // gradients were reduced during the backward pass
+    buckets_->wait();
+  else
+    comm_->scatterReduceAndResetGrads(); // reduce gradients across all devices (globally) into shards
   
   float gradNorm = 0.f; 
   if(costScale_ || dynamicGradientScaling_ || checkGradientNan_) {
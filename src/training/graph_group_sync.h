@@ -1,6 +1,7 @@
 #pragma once
 
 #include "optimizers/quantizer.h"
+#include "training/gradient_buckets.h"
 #include "training/graph_group.h"
 
 namespace marian {
@@ -20,7 +21,11 @@ class SyncGraphGroup : public GraphGroup {
   std::vector<Ptr<data::Batch>> pendingBatches_; // in case of dynamic MB-size scaling, we temporarly buffer up batches across update() calls until enough
   double updateMultiplier_{1};                  // multiplier not applied in collectStats() (no multiplier if not mini-batch-fit)
 
+  Ptr<GradientBuckets> buckets_; // reduces gradients during the backward pass (--sync-bucket-size), null if disabled
+
   void initialize(const Ptr<data::Batch>& exampleBatch);
+  void initializeBuckets();
+  void clipLocalGradients(Tensor grads);
 
   bool tryGetSubBatches(Ptr<data::Batch> newBatch, std::vector<Ptr<data::Batch>>& subBatches, size_t& numReadBatches);
   void update(std::vector<Ptr<data::Batch>> subBatches, size_t numReadBatches);
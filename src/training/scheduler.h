@@ -526,6 +526,13 @@ public:
     state_->save(name + ".progress.yml");
   }
 
+  // Returns the names and contents of the files written by save(), so that they can be written later
+  std::vector<std::pair<std::string, std::string>> snapshot(const std::string& name) const {
+    std::stringstream progress;
+    state_->save(progress);
+    return {{name + ".yml", options_->asYamlString()}, {name + ".progress.yml", progress.str()}};
+  }
+
   size_t numberOfBatches() { return state_->batches; }
 
   void registerTrainingObserver(Ptr<TrainingObserver> observer) {
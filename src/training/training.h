@@ -3,10 +3,12 @@
 #include "common/config.h"
 #include "common/utils.h"
 #include "data/batch_generator.h"
+#include "data/corpus_binary.h"
 #ifndef _MSC_VER // @TODO: include SqLite in Visual Studio project
 #include "data/corpus_sqlite.h"
 #endif
 #include "models/model_task.h"
+#include "tensors/cpu/parallel.h"
 #include "training/scheduler.h"
 #include "training/validator.h"
 
@@ -32,6 +34,8 @@ public:
       LOG(info, "Synced seed {}", Config::seed);
     }
 
+    cpu::IntraOpThreadPool::global().resize(options_->get<size_t>("cpu-intra-threads", 1));
+
     Ptr<CorpusBase> dataset;
     auto corpusSeed = Config::seed + (mpi ? mpi->myMPIRank() : 0); // @BUGBUG: no correct resume right now
     if(!options_->get<std::string>("sqlite").empty())
@@ -40,6 +44,8 @@ public:
 #else
       ABORT("SqLite presently not supported on Windows");
 #endif
+    else if(options_->hasAndNotEmpty("binary-corpus"))
+      dataset = New<CorpusBinary>(options_, corpusSeed);
     else
       dataset = New<Corpus>(options_, /*translate=*/false, corpusSeed);
 
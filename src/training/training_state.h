@@ -243,6 +243,10 @@ public:
 
   void save(const std::string& name) const {
     std::ofstream fout(name);
+    save(fout);
+  }
+
+  void save(std::ostream& fout) const {
     YAML::Node config;
 
     config["epochs"] = epochs;
@@ -0,0 +1,160 @@
+#pragma once
+
+#include "common/file_stream.h"
+#include "common/filesystem.h"
+#include "common/options.h"
+#include "common/utils.h"
+#include "data/batch_stats.h"
+#include "graph/expression_graph.h"
+#include "tensors/allocator.h"
+#include "translator/scorers.h"
+
+#include <cmath>
+#include <fstream>
+#include <numeric>
+#include <sstream>
+
+namespace marian {
+
+/**
+ * Determines the largest batch size per source length that can be decoded in the workspace of the
+ * given graph without reallocation, the decoding counterpart of GraphGroup::collectStats() for
+ * --mini-batch-fit. Every tested batch is decoded with the given scorers up to the maximum output
+ * length (source length times --max-length-factor) with the full beam, by suppressing EOS.
+ *
+ * Fitting decodes many batches, so the statistics are cached in a file next to the first model
+ * together with the options they depend on, and reused as long as these do not change.
+ */
+template <class Search>
+class BatchFitter {
+private:
+  Ptr<Options> options_;
+  Ptr<ExpressionGraph> graph_;
+  std::vector<Ptr<Scorer>> scorers_;
+  std::vector<Ptr<Vocab>> srcVocabs_;
+  Ptr<const Vocab> trgVocab_;
+
+  // options and model files that the fitted batch sizes depend on
+  std::string cacheKey() const {
+    std::stringstream key;
+    for(auto model : options_->get<std::vector<std::string>>("models"))
+      key << "model=" << model << ":" << filesystem::fileSize(filesystem::Path(model)) << ";";
+    key << "device=" << (graph_->getDeviceId().type == DeviceType::cpu ? "cpu" : "gpu") << ";"
+        << "workspace=" << options_->get<size_t>("workspace") << ";"
+        << "precision=" << utils::join(options_->get<std::vector<std::string>>("precision", {"float32"}), ",") << ";"
+        << "gemm-type=" << options_->get<std::string>("gemm-type", "float32") << ";"
+        << "beam-size=" << options_->get<size_t>("beam-size") << ";"
+        << "max-length=" << options_->get<size_t>("max-length") << ";"
+        << "max-length-factor=" << options_->get<float>("max-length-factor") << ";"
+        << "mini-batch-fit-step=" << options_->get<size_t>("mini-batch-fit-step") << ";"
+        << "shortlist=" << utils::join(options_->get<std::vector<std::string>>("shortlist", {}), ",");
+    return key.str();
+  }
+
+  // Decodes a fake batch and returns false if the workspace had to grow for it
+  bool fits(Ptr<Search> search, size_t length, size_t batchSize) {
+    std::vector<size_t> lengths(srcVocabs_.size(), length);
+    auto batch = data::CorpusBatch::fakeBatch(lengths, srcVocabs_, batchSize, /*options=*/nullptr);
+    std::vector<size_t> sentenceIds(batchSize);
+    std::iota(sentenceIds.begin(), sentenceIds.end(), 0);
+    batch->setSentenceIds(sentenceIds);
+
+    graph_->throwAtReallocation(true);
+    try {
+      search->search(graph_, batch);
+    } catch(AllocationException&) {
+      graph_->throwAtReallocation(false);
+      return false;
+    }
+    graph_->throwAtReallocation(false);
+    return true;
+  }
+
+  Ptr<data::BatchStats> fit() {
+    auto search = New<Search>(options_, scorers_, trgVocab_);
+    search->setSuppressEos(true);
+
+    size_t step = options_->get<size_t>("mini-batch-fit-step");
+    size_t maxLength = options_->get<size_t>("max-length");
+    maxLength = (size_t)(std::ceil(maxLength / (float)step) * step);
+
+    LOG(info, "[batching] Fitting decoding batch sizes for source lengths up to {} into {} MB workspace",
+        maxLength, options_->get<size_t>("workspace"));
+
+    size_t maxBatch = 64;
+    while(fits(search, step, maxBatch))
+      maxBatch *= 2;
+
+    // binary search for the largest batch size that fits, which decreases with the length
+    std::vector<size_t> flattened = {srcVocabs_.size()};
+    for(size_t length = step; length <= maxLength; length += step) {
+      size_t start = 1;
+      size_t end = maxBatch;
+      while(end >= start) {
+        size_t current = (start + end) / 2;
+        bool fit = fits(search, length, current);
+        LOG(debug, "[batching] length: {} - size: {} - fits: {}", length, current, fit);
+        if(fit)
+          start = current + 1;
+        else
+          end = current - 1;
+      }
+      // a single sentence is always allowed, even if it does not fit without reallocation
+      size_t batchSize = std::max<size_t>(end, 1);
+      flattened.insert(flattened.end(), srcVocabs_.size(), length);
+      flattened.push_back(batchSize);
+      LOG(debug, "[batching] length: {} - batch size: {}", length, batchSize);
+      maxBatch = batchSize;
+
+      if(batchSize == 1) { // longer sentences can only be translated one at a time
+        flattened.insert(flattened.end(), srcVocabs_.size(), maxLength);
+        flattened.push_back(1);
+        break;
+      }
+    }
+
+    graph_->clear();
+    return New<data::BatchStats>(flattened);
+  }
+
+public:
+  BatchFitter(Ptr<Options> options,
+              Ptr<ExpressionGraph> graph,
+              const std::vector<Ptr<Scorer>>& scorers,
+              const std::vector<Ptr<Vocab>>& srcVocabs,
+              Ptr<const Vocab> trgVocab)
+      : options_(options), graph_(graph), scorers_(scorers), srcVocabs_(srcVocabs), trgVocab_(trgVocab) {}
+
+  // Returns cached batch statistics if they were fitted with the same options, fits and caches them otherwise
+  Ptr<data::BatchStats> getStats() {
+    auto key = cacheKey();
+    auto path = options_->get<std::vector<std::string>>("models").front() + ".batch-fit.yml";
+
+    if(filesystem::exists(path)) {
+      io::InputFileStream strm(path);
+      YAML::Node cache = YAML::Load(strm);
+      if(cache["key"] && cache["key"].as<std::string>() == key) {
+        LOG(info, "[batching] Reusing decoding batch sizes from {}", path);
+        return New<data::BatchStats>(cache["stats"].as<std::vector<size_t>>());
+      }
+      LOG(info, "[batching] Options have changed since {} was written, fitting again", path);
+    }
+
+    auto stats = fit();
+
+    std::ofstream out(path);
+    if(out) {
+      YAML::Node cache;
+      cache["key"] = key;
+      cache["stats"] = stats->flatten();
+      out << cache << std::endl;
+    }
+    if(out)
+      LOG(info, "[batching] Saved decoding batch sizes to {}", path);
+    else
+      LOG(warn, "[batching] Could not save decoding batch sizes to {}", path);
+    return stats;
+  }
+};
+
+}  // namespace marian
@@ -12,6 +12,7 @@ Beams BeamSearch::toHyps(const std::vector<unsigned int>& nBestKeys, // [current
                          const std::vector<float>& nBestPathScores,  // [currentDimBatch, beamSize] flattened
                          const size_t nBestBeamSize, // for interpretation of nBestKeys
                          const size_t vocabSize,     // ditto.
+                         const size_t currentDimBatch, // number of batch entries in the current state tensors, incl. finished ones that are not compacted yet
                          const Beams& beams,
                          const std::vector<Ptr<ScorerState /*const*/>>& states,
                          Ptr<data::CorpusBatch /*const*/> batch, // for alignments only
@@ -26,18 +27,12 @@ Beams BeamSearch::toHyps(const std::vector<unsigned int>& nBestKeys, // [current
   Beams newBeams(origDimBatch);           // return value of this function goes here. There are always origDimBatch beams.
 
   // create a reverse batchMap to obtain original batchIdx in the starting batch size
-  // and calculate the current batch size based on non-empty beams
   std::vector<IndexType> reverseBatchIdxMap; // empty if not purging batch entries
-  size_t currentDimBatch = beams.size();
   if(PURGE_BATCH) {
     reverseBatchIdxMap.resize(batchIdxMap.size()); // adjust size if doing batch purging.
-    currentDimBatch = 0;
-    for(int i = 0; i < batchIdxMap.size(); ++i) {
+    for(int i = 0; i < batchIdxMap.size(); ++i)
       reverseBatchIdxMap[batchIdxMap[i]] = i; // reverse batch index mapping, multiple occurences get overwritten with the last one,
                                               // which is expected due to down-shifting
-      if(!beams[i].empty())
-        currentDimBatch++;
-    }
   }
 
   for(size_t i = 0; i < nBestKeys.size(); ++i) { // [currentDimBatch, beamSize] flattened
@@ -224,26 +219,52 @@ std::vector<float> BeamSearch::getAlignmentsForHypothesis( // -> P(s|t) for curr
 }
 
 // remove all beam entries that have reached EOS
-Beams BeamSearch::purgeBeams(const Beams& beams, /*in/out=*/std::vector<IndexType>& batchIdxMap) {
+Beams BeamSearch::purgeBeams(const Beams& beams) {
   const auto trgEosId = trgVocab_->getEosId();
   Beams newBeams;
-  size_t beamIdx = 0; // beam index
   for(auto beam : beams) {
     Beam newBeam; // a beam of surviving hyps
     for(auto hyp : beam)
       if(hyp->getWord() != trgEosId) // if this hyp is not finished,
         newBeam.push_back(hyp);      // move over to beam of surviving hyps
+    newBeams.push_back(newBeam);
+  }
+  return newBeams;
+}
 
-    if(PURGE_BATCH)
-      if(newBeam.empty() && !beam.empty()) {      // previous beam had hyps, but all were finished in this step, newBeam will now stay empty
-        for(size_t i = beamIdx + 1; i < beams.size(); ++i) // for all entries above this beam
-          batchIdxMap[i] = batchIdxMap[i] - 1;  // make them look at one batch index below, as the current entry will be removed from the batch.
+// remove finished batch entries from the state tensors if too few unfinished ones are left
+bool BeamSearch::compactBatch(const Beams& beams,
+                              /*in/out=*/std::vector<bool>& inTensor,
+                              /*in/out=*/std::vector<IndexType>& batchIdxMap) {
+  size_t dimBatch = 0, dimLive = 0;
+  for(size_t i = 0; i < beams.size(); ++i) {
+    if(inTensor[i]) {
+      dimBatch++;
+      if(!beams[i].empty())
+        dimLive++;
     }
+  }
 
-    newBeams.push_back(newBeam);
-    beamIdx++; // move to next beam index
+  compactionStats_.entrySteps    += dimBatch;
+  compactionStats_.finishedSteps += dimBatch - dimLive;
+
+  // keep finished entries as dead rows until the live fraction drops below the threshold
+  if(dimLive == dimBatch || dimLive >= compactionThreshold_ * dimBatch)
+    return false;
+
+  IndexType currentBatchIdx = 0;
+  for(size_t i = 0; i < beams.size(); ++i) {
+    // removed entries look at the row of the next remaining entry, this matches the reverse mapping in toHyps()
+    batchIdxMap[i] = currentBatchIdx;
+    if(inTensor[i] && beams[i].empty()) {
+      inTensor[i] = false;
+      compactionStats_.removedEntries++;
+    }
+    if(inTensor[i])
+      currentBatchIdx++;
   }
-  return newBeams;
+  compactionStats_.compactions++;
+  return true;
 }
 
 //**********************************************************************
@@ -261,6 +282,15 @@ Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch>
 
   auto getNBestList = createGetNBestListFn(beamSize_, origDimBatch, graph->getDeviceId());
 
+  // with --fused-top-k the scorer returns raw logits, which are normalized by the fused n-best search
+  GetNBestListFusedFn getNBestListFused;
+  if(fusedTopK_) {
+    ABORT_IF(graph->getDeviceId().type != DeviceType::cpu, "--fused-top-k is only supported on the CPU");
+    ABORT_IF(scorers_.size() != 1, "--fused-top-k does not support ensembles");
+    ABORT_IF(factoredVocab, "--fused-top-k does not support factored vocabularies");
+    getNBestListFused = createGetNBestListFusedFn();
+  }
+
   for(auto scorer : scorers_) {
     scorer->clear(graph);
   }
@@ -279,6 +309,13 @@ Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch>
     states.push_back(scorer->startState(graph, batch));
   }
 
+  // the encoders are computed in the forward pass of the first decoder step; their latency is the
+  // time until the last node of the start states has been computed
+  timer::Timer forwardTimer;
+  double encoderSeconds = 0;
+  if(latencyStats_)
+    graph->setForwardMark([&]() { encoderSeconds = forwardTimer.elapsed(); });
+
   // create one beam per batch entry with sentence-start hypothesis
   Beams beams(origDimBatch, Beam(beamSize_, Hypothesis::New())); // array [origDimBatch] of array [maxBeamSize] of Hypothesis, keeps full size through search.
                                                                  // batch purging is determined from an empty sub-beam.
@@ -298,10 +335,14 @@ Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch>
   }
 
   Expr suppressedWordIndices;
+  std::vector<WordIndex> suppressed;
   bool suppressUnk     = !options_->get<bool>("allow-unk", false);
   bool suppressSpecial = !options_->get<bool>("allow-special", false);
-  if (suppressUnk || suppressSpecial) { // do we need to suppress unk or special?
-    std::vector<WordIndex> suppressed = trgVocab_->suppressedIndices(suppressUnk, suppressSpecial);
+  if (suppressUnk || suppressSpecial || suppressEos_) { // do we need to suppress unk or special?
+    if(suppressUnk || suppressSpecial)
+      suppressed = trgVocab_->suppressedIndices(suppressUnk, suppressSpecial);
+    if(suppressEos_)
+      suppressed.push_back(trgEosId.toWordIndex());
 
     auto shortlist = scorers_[0]->getShortlist(); // first shortlist is generally ok, @TODO: make sure they are the same across scorers?
     if(shortlist) // check if suppressed words are allowed by the shortlist, if not, remove
@@ -326,6 +367,19 @@ Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch>
   //    with History: vector [t] of array [maxBeamSize] of Hypothesis
   //    with Hypothesis: (last word, aggregate score, prev Hypothesis)
 
+  // Finished batch entries keep their rows in the state tensors until compactBatch() removes them,
+  // only then the encoder states are gathered down to the remaining entries.
+  std::vector<bool> inTensor(origDimBatch, true); // [origBatchIdx] -> entry occupies a row in the current state tensors
+
+  // hand each history to the finished-callback exactly once, as soon as it is final
+  std::vector<bool> reported(origDimBatch, false);
+  auto reportFinished = [&](int batchIdx) {
+    if(finishedCallback_ && !reported[batchIdx]) {
+      reported[batchIdx] = true;
+      finishedCallback_(batchIdx, histories[batchIdx]);
+    }
+  };
+
   IndexType currentDimBatch = origDimBatch;
   auto prevBatchIdxMap = batchIdxMap; // [origBatchIdx -> currentBatchIdx] but shifted by one time step
   // main loop over output time steps
@@ -353,6 +407,7 @@ Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch>
       std::vector<IndexType> hypIndices;      // [maxBeamSize, 1, currentDimBatch, 1] (flattened) tensor index ((beamHypIdx, batchIdx), flattened) of prev hyp that a hyp originated from
       std::vector<Word> prevWords;            // [maxBeamSize, 1, currentDimBatch, 1] (flattened) word that a hyp ended in, for advancing the decoder-model's history
       Expr prevPathScores;                    // [maxBeamSize, 1, currentDimBatch, 1], path score that a hyp ended in (last axis will broadcast into vocab size when adding expandedPathScores)
+      std::vector<float> prevScores;          // [maxBeamSize, 1, currentDimBatch, 1] (flattened) values of prevPathScores, empty if all zero
 
       bool anyCanExpand = false; // stays false if all hyps are invalid factor expansions
       if(t == 0 && factorGroup == 0) { // no scores yet
@@ -365,10 +420,9 @@ Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch>
       } else {
         if(factorGroup == 0)                                                              // only factorGroup==0 can subselect neural state
           for(int currentBatchIdx = 0; currentBatchIdx < beams.size(); ++currentBatchIdx) // loop over batch entries (active sentences)
-            if(!beams[currentBatchIdx].empty() || !PURGE_BATCH)                           // for each beam check
-              batchIndices.push_back(prevBatchIdxMap[currentBatchIdx]);                   // which batch entries were active in previous step
+            if(inTensor[currentBatchIdx] || !PURGE_BATCH)                                 // for each beam check
+              batchIndices.push_back(prevBatchIdxMap[currentBatchIdx]);                   // which batch entries keep their rows from previous step
 
-        std::vector<float> prevScores;
         for(size_t beamHypIdx = 0; beamHypIdx < maxBeamSize; ++beamHypIdx) { // loop over globally maximal beam-size (maxBeamSize)
           for(int origBatchIdx = 0; origBatchIdx < origDimBatch; ++origBatchIdx) { // loop over all batch entries (active and inactive)
             auto& beam = beams[origBatchIdx];
@@ -395,7 +449,7 @@ Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch>
               prevWords .push_back(word);
               prevScores.push_back(canExpand ? hyp->getPathScore() : INVALID_PATH_SCORE);
             } else {  // pad to maxBeamSize (dummy hypothesis)
-              if(!PURGE_BATCH || !beam.empty()) { // but only if we are not pruning and the beam is not deactivated yet
+              if(!PURGE_BATCH || inTensor[origBatchIdx]) { // but only if we are not pruning and the entry has not been compacted away yet
                 hypIndices.push_back(0);
                 prevWords.push_back(trgEosId);    // (unused, but must be valid)
                 prevScores.push_back((float)INVALID_PATH_SCORE);
@@ -412,6 +466,7 @@ Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch>
 
       //**********************************************************************
       // compute expanded path scores with word prediction probs from all scorers
+      ScopedLatency stepLatency(latencyStats_, LatencyPhase::decoderStep);
       auto expandedPathScores = prevPathScores; // will become [maxBeamSize, 1, currDimBatch, dimVocab]
       Expr logProbs;
       for(size_t i = 0; i < scorers_.size(); ++i) {
@@ -448,21 +503,30 @@ Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch>
           logProbs = states[i]->getLogProbs().getFactoredLogits(factorGroup, /*shortlist=*/ nullptr, hypIndices, maxBeamSize); // [maxBeamSize, 1, currentDimBatch, dimVocab]
         }
         // expand all hypotheses, [maxBeamSize, 1, currentDimBatch, 1] -> [maxBeamSize, 1, currentDimBatch, dimVocab]
-        expandedPathScores = expandedPathScores + scorers_[i]->getWeight() * logProbs;
+        if(!fusedTopK_) // the fused n-best search expands the raw logits itself
+          expandedPathScores = expandedPathScores + scorers_[i]->getWeight() * logProbs;
       }
 
       // make beams continuous
-      expandedPathScores = swapAxes(expandedPathScores, 0, 2); // -> [currentDimBatch, 1, maxBeamSize, dimVocab]
+      if(!fusedTopK_)
+        expandedPathScores = swapAxes(expandedPathScores, 0, 2); // -> [currentDimBatch, 1, maxBeamSize, dimVocab]
 
       // perform NN computation
-      if(t == 0 && factorGroup == 0)
+      if(t == 0 && factorGroup == 0) {
+        forwardTimer.start();
         graph->forward();
-      else
+        if(latencyStats_) { // not attributed to the first decoder step
+          latencyStats_->add(LatencyPhase::encoder, encoderSeconds);
+          stepLatency.exclude(encoderSeconds);
+        }
+      } else {
         graph->forwardNext();
+      }
+      stepLatency.stop();
 
       //**********************************************************************
       // suppress specific symbols if not at right positions
-      if(suppressedWordIndices && factorGroup == 0)
+      if(suppressedWordIndices && factorGroup == 0 && !fusedTopK_)
         suppressWords(expandedPathScores, suppressedWordIndices);
 
       //**********************************************************************
@@ -471,18 +535,38 @@ Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch>
       // find N best amongst the (maxBeamSize * dimVocab) hypotheses
       std::vector<unsigned int> nBestKeys; // [currentDimBatch, maxBeamSize] flattened -> (batchIdx, beamHypIdx, word idx) flattened
       std::vector<float> nBestPathScores;  // [currentDimBatch, maxBeamSize] flattened
-      getNBestList(/*in*/   expandedPathScores->val(),   // [currentDimBatch, 1, maxBeamSize, dimVocab or dimShortlist]
-                  /*N=*/    maxBeamSize,                 // desired beam size
-                  /*out*/   nBestPathScores,
-                   /*out*/  nBestKeys,
-                  /*first=*/t == 0 && factorGroup == 0); // @TODO: this is only used for checking presently, and should be removed altogether
+      ScopedLatency topKLatency(latencyStats_, LatencyPhase::topK);
+      size_t nBestBeamSize, vocabSize; // used for interpretation of keys
+      if(fusedTopK_) {
+        getNBestListFused(/*in*/  logProbs->val(),  // [maxBeamSize, 1, currentDimBatch, dimVocab or dimShortlist], raw logits
+                          /*in*/  prevScores,       // [maxBeamSize, 1, currentDimBatch, 1] flattened
+                          /*in*/  scorers_[0]->getWeight(),
+                          /*in*/  suppressed,
+                          /*N=*/  maxBeamSize,
+                          /*out*/ nBestPathScores,
+                          /*out*/ nBestKeys);
+        nBestBeamSize = logProbs->shape()[-4];
+        vocabSize     = logProbs->shape()[-1];
+      } else {
+        getNBestList(/*in*/   expandedPathScores->val(),   // [currentDimBatch, 1, maxBeamSize, dimVocab or dimShortlist]
+                    /*N=*/    maxBeamSize,                 // desired beam size
+                    /*out*/   nBestPathScores,
+                     /*out*/  nBestKeys,
+                    /*first=*/t == 0 && factorGroup == 0); // @TODO: this is only used for checking presently, and should be removed altogether
+        nBestBeamSize = expandedPathScores->shape()[-2];
+        vocabSize     = expandedPathScores->shape()[-1];
+      }
       // Now, nBestPathScores contain N-best expandedPathScores for each batch and beam,
       // and nBestKeys for each their original location (batchIdx, beamHypIdx, word).
 
+      topKLatency.stop();
+
       // combine N-best sets with existing search space (beams) to updated search space
+      ScopedLatency toHypsLatency(latencyStats_, LatencyPhase::toHyps);
       beams = toHyps(nBestKeys, nBestPathScores,
-                     /*nBestBeamSize*/expandedPathScores->shape()[-2], // used for interpretation of keys
-                     /*vocabSize=*/expandedPathScores->shape()[-1],    // used for interpretation of keys
+                     nBestBeamSize,
+                     vocabSize,
+                     currentDimBatch,
                      beams,
                      states,            // used for keeping track of per-ensemble-member path score
                      batch,             // only used for propagating alignment info
@@ -495,8 +579,11 @@ Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch>
 
     // remove all hyps that end in EOS
     // The position of a hyp in the beam may change.
-    // in/out = shifts the batch index map if a beam gets fully purged
-    const auto purgedNewBeams = purgeBeams(beams, /*in/out=*/batchIdxMap);
+    const auto purgedNewBeams = purgeBeams(beams);
+
+    // in/out = shifts the batch index map if finished entries get removed from the state tensors
+    if(PURGE_BATCH)
+      compactBatch(purgedNewBeams, /*in/out=*/inTensor, /*in/out=*/batchIdxMap);
 
     // add updated search space (beams) to our return value
     bool maxLengthReached = false;
@@ -506,6 +593,9 @@ Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch>
         if (histories[batchIdx]->size() >= options_->get<float>("max-length-factor") * batch->front()->batchWidth())
           maxLengthReached = true;
         histories[batchIdx]->add(beams[batchIdx], trgEosId, purgedNewBeams[batchIdx].empty() || maxLengthReached);
+        // a batch entry is final once all of its hyps have ended in EOS
+        if(purgedNewBeams[batchIdx].empty())
+          reportFinished(batchIdx);
       }
     }
     if (maxLengthReached) // early exit if max length limit was reached
@@ -515,6 +605,16 @@ Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch>
     beams = purgedNewBeams;
   } // end of main loop over output time steps
 
+  // entries that were still active when the max length was reached are final now
+  for(int batchIdx = 0; batchIdx < origDimBatch; ++batchIdx)
+    reportFinished(batchIdx);
+
+  auto memory = graph->allocator()->stats();
+  LOG(debug, "[memory] Workspace of {} MB: peak use {} MB, {} free ranges, fragmentation {:.2f}, {} reallocations",
+      memory.reserved / (1024 * 1024), memory.peak / (1024 * 1024), memory.gaps, memory.fragmentation(), memory.grows);
+  LOG(debug, "[beam] {} compactions removed {} finished entries, {} of {} entry steps were spent on finished entries",
+      compactionStats_.compactions, compactionStats_.removedEntries, compactionStats_.finishedSteps, compactionStats_.entrySteps);
+
   return histories; // [origDimBatch][t][N best hyps]
 }
 
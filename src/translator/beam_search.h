@@ -2,6 +2,7 @@
 
 #include "marian.h"
 #include "translator/history.h"
+#include "translator/latency_stats.h"
 #include "translator/scorers.h"
 
 namespace marian {
@@ -16,6 +17,39 @@ private:
   const float INVALID_PATH_SCORE;
   const bool PURGE_BATCH = true; // @TODO: diagnostic, to-be-removed once confirmed there are no issues.
 
+  // Finished batch entries are only removed from the state tensors once the fraction of unfinished
+  // entries drops below this threshold. 1 removes them immediately, 0 never.
+  const float compactionThreshold_;
+
+  // Use the fused log-softmax and n-best search on raw logits, see createGetNBestListFusedFn()
+  const bool fusedTopK_;
+
+  // Never end hypotheses with EOS, see setSuppressEos()
+  bool suppressEos_{false};
+
+public:
+  // counters of the batch compaction over all searches run by this object
+  struct CompactionStats {
+    size_t compactions{0};    // number of times the state tensors were gathered down to fewer entries
+    size_t removedEntries{0}; // number of finished batch entries removed by these compactions
+    size_t entrySteps{0};     // sum over decoding steps of the batch entries in the state tensors
+    size_t finishedSteps{0};  // sum over decoding steps of the finished entries still in the state tensors
+  };
+
+public:
+  // called with the batch index and history of a sentence as soon as its translation is final
+  typedef std::function<void(size_t, Ptr<History>)> FinishedCallback;
+
+private:
+  FinishedCallback finishedCallback_;
+  Ptr<LatencyStats> latencyStats_;
+  CompactionStats compactionStats_;
+
+  // --skip-cost takes precedence, its raw logits are not normalized at all
+  static bool useFusedTopK(Ptr<Options> options) {
+    return options->get<bool>("fused-top-k", false) && !options->get<bool>("skip-cost", false);
+  }
+
   static float chooseInvalidPathScore(Ptr<Options> options) {
     auto prec = options->get<std::vector<std::string>>("precision", {"float32"});
     auto computeType = typeFromString(prec[0]);
@@ -25,7 +59,9 @@ private:
 public:
   BeamSearch(Ptr<Options> options, const std::vector<Ptr<Scorer>>& scorers, const Ptr<const Vocab> trgVocab)
       : options_(options), scorers_(scorers), beamSize_(options_->get<size_t>("beam-size")), trgVocab_(trgVocab),
-        INVALID_PATH_SCORE{chooseInvalidPathScore(options)}
+        INVALID_PATH_SCORE{chooseInvalidPathScore(options)},
+        compactionThreshold_{options_->get<float>("beam-compaction-threshold", 1.f)},
+        fusedTopK_{useFusedTopK(options)}
   {}
 
   // combine new expandedPathScores and previous beams into new set of beams
@@ -33,6 +69,7 @@ public:
                const std::vector<float>& nBestPathScores,  // [currentDimBatch, beamSize] flattened
                const size_t nBestBeamSize, // for interpretation of nBestKeys
                const size_t vocabSize,     // ditto.
+               const size_t currentDimBatch, // number of batch entries in the current state tensors
                const Beams& beams,
                const std::vector<Ptr<ScorerState /*const*/>>& states,
                Ptr<data::CorpusBatch /*const*/> batch, // for alignments only
@@ -49,7 +86,28 @@ public:
       int currentDimBatch) const;
 
   // remove all beam entries that have reached EOS
-  Beams purgeBeams(const Beams& beams, /*in/out=*/std::vector<IndexType>& batchIdxMap);
+  Beams purgeBeams(const Beams& beams);
+
+  // Remove finished batch entries, i.e. empty beams, from the state tensors if the fraction of
+  // unfinished entries among the entries in the tensors has dropped below the compaction threshold.
+  // Updates which entries are in the tensors and the batch index map, returns true if entries were removed.
+  bool compactBatch(const Beams& beams,
+                    /*in/out=*/std::vector<bool>& inTensor,
+                    /*in/out=*/std::vector<IndexType>& batchIdxMap);
+
+  const CompactionStats& getCompactionStats() const { return compactionStats_; }
+
+  // Report every sentence as soon as its translation is final, before search() returns. This allows
+  // streaming results of sentences that finish early in a batch.
+  void setFinishedCallback(FinishedCallback callback) { finishedCallback_ = callback; }
+
+  // Collect latencies of the encoder, decoder steps, top-k selection and toHyps(). The encoder
+  // time is taken from a mark on the tape of the first forward pass and excluded from the first step.
+  void setLatencyStats(Ptr<LatencyStats> latencyStats) { latencyStats_ = latencyStats; }
+
+  // Suppress EOS, so every sentence is decoded up to the maximum output length. Used to measure
+  // the memory needed for a batch in the worst case.
+  void setSuppressEos(bool suppressEos) { suppressEos_ = suppressEos; }
 
   // main decoding function
   Histories search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch> batch);
@@ -0,0 +1,91 @@
+#include "translator/latency_stats.h"
+
+#include <cmath>
+#include <sstream>
+
+namespace marian {
+
+// buckets grow by 2% starting at 1 microsecond, the last bucket collects everything above ~1000s
+static const double kMinSeconds = 1e-6;
+static const double kGrowth = 1.02;
+static const size_t kNumBuckets = 1050;
+
+LatencyStats::LatencyStats() {
+  for(auto& histogram : phases_)
+    histogram.buckets.resize(kNumBuckets, 0);
+}
+
+const char* LatencyStats::phaseName(LatencyPhase phase) {
+  switch(phase) {
+    case LatencyPhase::batching:    return "batching";
+    case LatencyPhase::queue:       return "queue";
+    case LatencyPhase::shortlist:   return "shortlist";
+    case LatencyPhase::encoder:     return "encoder";
+    case LatencyPhase::decoderStep: return "decoder_step";
+    case LatencyPhase::topK:        return "top_k";
+    case LatencyPhase::toHyps:      return "to_hyps";
+    case LatencyPhase::output:      return "output";
+    case LatencyPhase::batch:       return "batch";
+    case LatencyPhase::request:     return "request";
+    default: ABORT("Unknown latency phase {}", (size_t)phase);
+  }
+}
+
+size_t LatencyStats::bucket(double seconds) {
+  if(seconds <= kMinSeconds)
+    return 0;
+  size_t i = (size_t)std::ceil(std::log(seconds / kMinSeconds) / std::log(kGrowth));
+  return std::min(i, kNumBuckets - 1);
+}
+
+double LatencyStats::upperBound(size_t bucket) {
+  return kMinSeconds * std::pow(kGrowth, (double)bucket);
+}
+
+double LatencyStats::percentile(const Histogram& histogram, double p) {
+  size_t rank = (size_t)std::ceil(p * histogram.count);
+  size_t seen = 0;
+  for(size_t i = 0; i < histogram.buckets.size(); ++i) {
+    seen += histogram.buckets[i];
+    if(seen >= rank && seen > 0)
+      return std::min(upperBound(i), histogram.max);
+  }
+  return histogram.max;
+}
+
+void LatencyStats::add(LatencyPhase phase, double seconds) {
+  size_t i = bucket(seconds);
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto& histogram = phases_[(size_t)phase];
+  histogram.buckets[i]++;
+  histogram.count++;
+  histogram.sum += seconds;
+  histogram.max = std::max(histogram.max, seconds);
+}
+
+std::string LatencyStats::toJson() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::stringstream json;
+  json.precision(3);
+  json << std::fixed << "{";
+  bool first = true;
+  for(size_t i = 0; i < phases_.size(); ++i) {
+    const auto& histogram = phases_[i];
+    if(histogram.count == 0)
+      continue;
+    if(!first)
+      json << ",";
+    first = false;
+    json << "\"" << phaseName((LatencyPhase)i) << "\":{"
+         << "\"count\":" << histogram.count << ","
+         << "\"mean\":" << 1000 * histogram.sum / histogram.count << ","
+         << "\"p50\":" << 1000 * percentile(histogram, 0.50) << ","
+         << "\"p95\":" << 1000 * percentile(histogram, 0.95) << ","
+         << "\"p99\":" << 1000 * percentile(histogram, 0.99) << ","
+         << "\"max\":" << 1000 * histogram.max << "}";
+  }
+  json << "}";
+  return json.str();
+}
+
+}  // namespace marian
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "common/definitions.h"
+#include "common/timer.h"
+#include "data/shortlist.h"
+
+#include <array>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace marian {
+
+// Phases of translation whose latencies are collected with --latency-stats
+enum class LatencyPhase : size_t {
+  batching,    // reading, tokenization and batch creation
+  queue,       // time a sentence waited in the shared batching queue of the server
+  shortlist,   // lexical shortlist generation for a batch
+  encoder,     // encoder forward pass of a batch
+  decoderStep, // decoder forward pass of a single output time step
+  topK,        // n-best selection of a single output time step, i.e. getNBestList()
+  toHyps,      // conversion of the n-best lists of a single output time step into hypotheses
+  output,      // printing and collecting of translations, per batch in the decoder and per sentence in the server
+  batch,       // total time of a batch from the start of search to collected output
+  request,     // total time of a server request from arrival to completion
+  count
+};
+
+// Thread-safe collection of latencies per phase. Samples are counted in histograms with
+// logarithmically spaced buckets, so memory does not grow with the number of samples and the
+// reported percentiles are accurate to within the bucket width of 2%.
+class LatencyStats {
+private:
+  struct Histogram {
+    std::vector<size_t> buckets;
+    size_t count{0};
+    double sum{0};
+    double max{0};
+  };
+
+  std::array<Histogram, (size_t)LatencyPhase::count> phases_;
+  mutable std::mutex mutex_;
+
+  static size_t bucket(double seconds);
+  static double upperBound(size_t bucket);
+  static double percentile(const Histogram& histogram, double p);
+
+public:
+  LatencyStats();
+
+  static const char* phaseName(LatencyPhase phase);
+
+  void add(LatencyPhase phase, double seconds);
+
+  // Single-line JSON object with count, mean, p50, p95, p99 and max in milliseconds for every
+  // phase that has samples, e.g. {"encoder":{"count":10,"mean":1.52,"p50":1.41,...},...}
+  std::string toJson() const;
+};
+
+// Adds the time from construction to destruction to the given phase, does nothing without stats
+class ScopedLatency {
+private:
+  Ptr<LatencyStats> stats_;
+  LatencyPhase phase_;
+  timer::Timer timer_;
+  double excluded_{0}; // seconds of nested phases that are measured separately
+
+public:
+  ScopedLatency(Ptr<LatencyStats> stats, LatencyPhase phase) : stats_(stats), phase_(phase) {}
+  ~ScopedLatency() { stop(); }
+
+  // Does not count the given time, which has been added to another phase
+  void exclude(double seconds) { excluded_ += seconds; }
+
+  // Adds the time elapsed so far, later calls and the destructor do nothing
+  void stop() {
+    if(stats_)
+      stats_->add(phase_, timer_.elapsed() - excluded_);
+    stats_ = nullptr;
+  }
+};
+
+// Measures the time spent in shortlist generation of the wrapped generator
+class TimedShortlistGenerator : public data::ShortlistGenerator {
+private:
+  Ptr<const data::ShortlistGenerator> generator_;
+  Ptr<LatencyStats> stats_;
+
+public:
+  TimedShortlistGenerator(Ptr<const data::ShortlistGenerator> generator, Ptr<LatencyStats> stats)
+      : generator_(generator), stats_(stats) {}
+
+  virtual Ptr<data::Shortlist> generate(Ptr<data::CorpusBatch> batch) const override {
+    ScopedLatency latency(stats_, LatencyPhase::shortlist);
+    return generator_->generate(batch);
+  }
+
+  virtual void dump(const std::string& prefix) const override { generator_->dump(prefix); }
+};
+
+}  // namespace marian
@@ -0,0 +1,209 @@
+#pragma once
+
+#include "common/cli_helper.h"
+#include "common/config.h"
+#include "common/file_stream.h"
+#include "common/filesystem.h"
+#include "common/options.h"
+
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace marian {
+
+// Translation services for several models served by one marian-server process, e.g. one per
+// language pair. Each model is registered under a name with a decoder config file (--model-configs
+// name=config.yml) whose options override the server options. Models are loaded lazily on their
+// first request and the least recently used ones are unloaded if the estimated memory of all loaded
+// models exceeds the budget (--models-memory-budget). A model can be reloaded from its config file
+// while it is serving; requests that already obtained the old service finish on it and the old
+// graphs are released after the last of them. Service is usually TranslateService<BeamSearch> and
+// is constructed from the options of its model.
+template <class Service>
+class ModelRegistry {
+  struct Entry {
+    std::string configPath;
+    Ptr<Service> service; // nullptr if not loaded
+    size_t memoryMB{0};   // estimated memory of the loaded service
+    size_t lastUsed{0};   // for least-recently-used eviction
+    std::mutex loading;   // serializes loading and reloading of this model
+  };
+
+  Ptr<Options> options_; // server options, shared by all models unless overridden
+  std::map<std::string, UPtr<Entry>> entries_;
+  std::string defaultName_;
+  size_t budgetMB_;
+  size_t clock_{0};
+  std::mutex mutex_;
+
+  Ptr<Options> loadOptions(const std::string& configPath) {
+    io::InputFileStream strm(configPath);
+    YAML::Node config = YAML::Load(strm);
+    if(config["relative-paths"] && config["relative-paths"].as<bool>()) {
+      cli::makeAbsolutePaths(config, configPath, {"models", "vocabs", "shortlist"});
+      config.remove("relative-paths");
+    }
+
+    auto options = New<Options>(options_->clone());
+    options->merge(config, /*overwrite=*/true);
+    ABORT_IF(!options->hasAndNotEmpty("models"), "No models given in model config {}", configPath);
+    ABORT_IF(!options->hasAndNotEmpty("vocabs"), "No vocabularies given in model config {}", configPath);
+
+    // check the files before anything is loaded
+    auto vocabs = options->get<std::vector<std::string>>("vocabs");
+    ABORT_IF(vocabs.size() < 2, "Source and target vocabularies are required in model config {}", configPath);
+    auto files = options->get<std::vector<std::string>>("models");
+    files.insert(files.end(), vocabs.begin(), vocabs.end());
+    if(options->hasAndNotEmpty("shortlist"))
+      files.push_back(options->get<std::vector<std::string>>("shortlist")[0]);
+    for(auto file : files)
+      ABORT_IF(!filesystem::exists(file), "File {} of model config {} does not exist", file, configPath);
+    return options;
+  }
+
+  // Model files plus workspace on every device; an upper bound with --model-mmap where model pages
+  // are shared with the page cache.
+  static size_t estimateMemoryMB(Ptr<Options> options) {
+    size_t bytes = 0;
+    for(auto model : options->get<std::vector<std::string>>("models"))
+      bytes += filesystem::fileSize(filesystem::Path(model));
+    size_t workspaceMB = options->get<size_t>("workspace") * Config::getDevices(options).size();
+    return bytes / (1024 * 1024) + workspaceMB;
+  }
+
+  Entry& entry(const std::string& name) {
+    auto it = entries_.find(name.empty() ? defaultName_ : name);
+    ABORT_IF(it == entries_.end(), "Unknown model '{}'", name);
+    return *it->second;
+  }
+
+  // Unloads least recently used models other than the given one until the loaded models fit into
+  // the budget. Requires mutex_ to be held. Returns the unloaded services, which should be released
+  // after mutex_, since destroying a service waits for its queued requests.
+  std::vector<Ptr<Service>> evict(const Entry& keep) {
+    std::vector<Ptr<Service>> unloaded;
+    if(budgetMB_ == 0)
+      return unloaded;
+
+    for(;;) {
+      size_t totalMB = 0;
+      Entry* oldest = nullptr;
+      for(auto& kv : entries_) {
+        auto& e = *kv.second;
+        if(!e.service)
+          continue;
+        totalMB += e.memoryMB;
+        if(&e != &keep && (!oldest || e.lastUsed < oldest->lastUsed))
+          oldest = &e;
+      }
+      if(totalMB <= budgetMB_ || !oldest)
+        return unloaded;
+
+      LOG(info, "[server] Unloading model {} ({} MB) to stay within memory budget of {} MB",
+          oldest->configPath, oldest->memoryMB, budgetMB_);
+      unloaded.push_back(oldest->service); // in-flight requests keep the service alive until they are done
+      oldest->service.reset();
+      oldest->memoryMB = 0;
+    }
+  }
+
+  // Creates the service outside of mutex_, so other models keep serving while this one loads. Errors
+  // while loading, including aborts, are thrown and leave the entry unchanged, so a broken config
+  // fails its request instead of terminating the server with all other models.
+  Ptr<Service> load(Entry& e) {
+    size_t memoryMB;
+    Ptr<Service> service;
+    {
+      ScopedThrowExceptionOnAbort throwOnAbort;
+      auto options = loadOptions(e.configPath);
+      memoryMB = estimateMemoryMB(options);
+
+      LOG(info, "[server] Loading model {} (~{} MB)", e.configPath, memoryMB);
+      service = New<Service>(options);
+    }
+
+    std::vector<Ptr<Service>> unloaded;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if(e.service)
+        unloaded.push_back(e.service); // replaced by reload()
+      e.service = service;
+      e.memoryMB = memoryMB;
+      e.lastUsed = ++clock_;
+      auto evicted = evict(e);
+      unloaded.insert(unloaded.end(), evicted.begin(), evicted.end());
+    }
+    return service;
+  }
+
+public:
+  ModelRegistry(Ptr<Options> options)
+      : options_(options), budgetMB_(options->get<size_t>("models-memory-budget", 0)) {
+    for(auto spec : options_->get<std::vector<std::string>>("model-configs")) {
+      auto pos = spec.find('=');
+      ABORT_IF(pos == std::string::npos || pos == 0 || pos + 1 == spec.size(),
+               "Model config '{}' is not of the form name=path", spec);
+
+      auto name = spec.substr(0, pos);
+      ABORT_IF(entries_.count(name), "Model '{}' is registered more than once", name);
+
+      auto e = UPtr<Entry>(new Entry());
+      e->configPath = spec.substr(pos + 1);
+      ABORT_IF(!filesystem::exists(e->configPath), "Model config file does not exist: {}", e->configPath);
+      entries_[name] = std::move(e);
+
+      if(defaultName_.empty())
+        defaultName_ = name;
+    }
+    ABORT_IF(entries_.empty(), "No models registered");
+  }
+
+  bool has(const std::string& name) const { return name.empty() || entries_.count(name) > 0; }
+
+  std::vector<std::string> names() const {
+    std::vector<std::string> names;
+    for(const auto& kv : entries_)
+      names.push_back(kv.first);
+    return names;
+  }
+
+  // Returns the service for the named model, or for the first registered model if the name is
+  // empty, if it is loaded and nullptr otherwise. Never blocks on loading.
+  Ptr<Service> getIfLoaded(const std::string& name) {
+    auto& e = entry(name);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(e.service)
+      e.lastUsed = ++clock_;
+    return e.service;
+  }
+
+  // Like getIfLoaded(), but loads the model if necessary, which can take a while. Keep the returned
+  // pointer only for the duration of a request.
+  Ptr<Service> get(const std::string& name) {
+    auto& e = entry(name);
+    if(auto service = getIfLoaded(name))
+      return service;
+
+    std::lock_guard<std::mutex> loading(e.loading);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if(e.service) { // loaded by a concurrent request in the meantime
+        e.lastUsed = ++clock_;
+        return e.service;
+      }
+    }
+    return load(e);
+  }
+
+  // Loads the model again from its config file and atomically replaces the current service. The
+  // model keeps serving on the old service until the new one is ready, and afterwards if loading
+  // the new one fails with an exception.
+  void reload(const std::string& name) {
+    auto& e = entry(name);
+    std::lock_guard<std::mutex> loading(e.loading);
+    load(e);
+  }
+};
+
+}  // namespace marian
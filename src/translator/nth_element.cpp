@@ -4,7 +4,9 @@
  */
 
 #include "translator/nth_element.h"
+#include "functional/functional.h"
 #include <algorithm>
+#include <cmath>
 #include <iterator>
 #include <limits>
 #include <numeric>
@@ -83,6 +85,147 @@ private:
   //}
 };
 
+// Computes log-softmax, path scores and the n-best list in a single pass over the logits instead of
+// materializing the normalized and expanded [dimBeam, dimBatch, dimVocab] scores first. Since the
+// log-normalizer and the previous path score are constant per row, the order within a row is the
+// order of the logits, so each row only needs to keep its best N logits (plus the number of
+// suppressed columns, which are dropped afterwards). The N best of a batch entry are then selected
+// from the at most dimBeam * N candidates of its rows.
+class NthElementFusedCPU {
+  typedef std::pair<float, unsigned> Candidate; // score, column or key
+
+  std::vector<Candidate> heap_;       // min-heap of the best logits of the current row
+  std::vector<Candidate> candidates_; // best path scores of all rows of the current batch entry
+
+  static const int kBlock = 64; // floats per block for which the running maxima are updated once
+
+  // Pushes the logit if it is among the k best of the row so far
+  void push(float logit, unsigned col, size_t k) {
+    if(heap_.size() < k) {
+      heap_.emplace_back(logit, col);
+      std::push_heap(heap_.begin(), heap_.end(), std::greater<Candidate>());
+    } else if(logit > heap_.front().first) {
+      std::pop_heap(heap_.begin(), heap_.end(), std::greater<Candidate>());
+      heap_.back() = Candidate(logit, col);
+      std::push_heap(heap_.begin(), heap_.end(), std::greater<Candidate>());
+    }
+  }
+
+  float threshold(size_t k) const {
+    return heap_.size() < k ? -std::numeric_limits<float>::infinity() : heap_.front().first;
+  }
+
+  // Single pass over a row: returns log(sum(exp(row))) and leaves the k best logits in heap_
+  float scanRow(const float* row, int cols, size_t k) {
+    heap_.clear();
+    float maxVal = -std::numeric_limits<float>::infinity();
+    float sum = 0.f;
+    int col = 0;
+
+#ifdef __AVX__
+    // per-lane running maxima and sums of exp(x - max), rescaled once per block
+    int vecCols = cols - cols % 8;
+    __m256 vmax = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+    __m256 vsum = _mm256_setzero_ps();
+    for(; col < vecCols; col += kBlock) {
+      int end = std::min(col + kBlock, vecCols);
+
+      __m256 bmax = _mm256_loadu_ps(row + col);
+      for(int i = col + 8; i < end; i += 8)
+        bmax = _mm256_max_ps(bmax, _mm256_loadu_ps(row + i));
+      __m256 newMax = _mm256_max_ps(vmax, bmax);
+      vsum = _mm256_mul_ps(vsum, exp256_ps(_mm256_sub_ps(vmax, newMax)));
+      vmax = newMax;
+
+      __m256 thr = _mm256_set1_ps(threshold(k));
+      for(int i = col; i < end; i += 8) {
+        __m256 x = _mm256_loadu_ps(row + i);
+        vsum = _mm256_add_ps(vsum, exp256_ps(_mm256_sub_ps(x, vmax)));
+        int mask = _mm256_movemask_ps(_mm256_cmp_ps(x, thr, _CMP_GT_OQ));
+        if(mask) { // rare after the first few blocks
+          for(int j = 0; j < 8; ++j)
+            if(mask & (1 << j))
+              push(row[i + j], (unsigned)(i + j), k);
+          thr = _mm256_set1_ps(threshold(k));
+        }
+      }
+    }
+
+    col = vecCols;
+    if(vecCols > 0) {
+      alignas(32) float lanesMax[8], lanesSum[8];
+      _mm256_store_ps(lanesMax, vmax);
+      _mm256_store_ps(lanesSum, vsum);
+      maxVal = *std::max_element(lanesMax, lanesMax + 8);
+      for(int j = 0; j < 8; ++j)
+        sum += lanesSum[j] * std::exp(lanesMax[j] - maxVal);
+    }
+#endif
+
+    // remainder, or the whole row without AVX
+    for(; col < cols; ++col) {
+      float x = row[col];
+      if(x > maxVal) {
+        sum = sum * std::exp(maxVal - x) + 1.f;
+        maxVal = x;
+      } else {
+        sum += std::exp(x - maxVal);
+      }
+      if(x > threshold(k))
+        push(x, (unsigned)col, k);
+    }
+
+    return maxVal + std::log(sum);
+  }
+
+public:
+  NthElementFusedCPU() {}
+  NthElementFusedCPU(const NthElementFusedCPU& copy) = delete;
+
+  void getNBestList(Tensor logits, // [dimBeam, 1, dimBatch, dimVocab or dimShortlist]
+                    const std::vector<float>& prevPathScores, // [dimBeam, 1, dimBatch, 1] or empty
+                    float weight,
+                    const std::vector<WordIndex>& suppressed,
+                    size_t N,
+                    std::vector<float>& outPathScores,
+                    std::vector<unsigned>& outKeys) {
+    const int dimVocab  = logits->shape()[-1];
+    const int dimBatch  = logits->shape()[-2];
+    const int dimBeam   = logits->shape()[-4];
+    ABORT_IF(logits->shape()[-3] != 1, "Unexpected shape of logits {}", logits->shape());
+    ABORT_IF(!prevPathScores.empty() && prevPathScores.size() != (size_t)dimBeam * dimBatch,
+             "Number of path scores {} does not match logits {}", prevPathScores.size(), logits->shape());
+    ABORT_IF(weight <= 0, "Fused n-best search requires a positive scorer weight, not {}", weight);
+    const float* data = logits->data();
+
+    // per row only the best N logits that are not suppressed can be among the N best of a batch entry
+    size_t k = std::min(N + suppressed.size(), (size_t)dimVocab);
+    auto isSuppressed = [&](unsigned col) {
+      return std::find(suppressed.begin(), suppressed.end(), (WordIndex)col) != suppressed.end();
+    };
+
+    for(int batchIdx = 0; batchIdx < dimBatch; ++batchIdx) {
+      candidates_.clear();
+      for(int beamIdx = 0; beamIdx < dimBeam; ++beamIdx) {
+        size_t rowIdx = (size_t)beamIdx * dimBatch + batchIdx;
+        float logNorm = scanRow(data + rowIdx * dimVocab, dimVocab, k);
+        float prevPathScore = prevPathScores.empty() ? 0.f : prevPathScores[rowIdx];
+        unsigned keyOffset = (unsigned)(((size_t)batchIdx * dimBeam + beamIdx) * dimVocab);
+        for(const auto& logit : heap_)
+          if(suppressed.empty() || !isSuppressed(logit.second))
+            candidates_.emplace_back(prevPathScore + weight * (logit.first - logNorm), keyOffset + logit.second);
+      }
+      ABORT_IF(candidates_.size() < N, "Fewer than {} candidates for the n-best list, vocabulary too small?", N);
+
+      std::partial_sort(candidates_.begin(), candidates_.begin() + N, candidates_.end(), std::greater<Candidate>());
+      for(size_t i = 0; i < N; ++i) {
+        outPathScores.push_back(candidates_[i].first);
+        outKeys.push_back(candidates_[i].second);
+      }
+    }
+  }
+};
+
 #ifdef CUDA_FOUND
 GetNBestListFn createGetNBestListGPUFn(size_t beamSize, size_t dimBatch, DeviceId deviceId); // in .cu file
 #endif
@@ -102,4 +245,12 @@ GetNBestListFn createGetNBestListFn(size_t beamSize, size_t dimBatch, DeviceId d
   };
 }
 
+GetNBestListFusedFn createGetNBestListFusedFn() {
+  auto nth = New<NthElementFusedCPU>();
+  return [nth](Tensor logits, const std::vector<float>& prevPathScores, float weight, const std::vector<WordIndex>& suppressed,
+               size_t N, std::vector<float>& outCosts, std::vector<unsigned>& outKeys) {
+    return nth->getNBestList(logits, prevPathScores, weight, suppressed, N, outCosts, outKeys);
+  };
+}
+
 }  // namespace marian
@@ -5,6 +5,7 @@
 
 #pragma once
 
+#include "data/types.h"
 #include "tensors/tensor.h"
 #include <vector>
 
@@ -17,4 +18,20 @@ typedef std::function<void(Tensor logProbs,
                            const bool isFirst)> GetNBestListFn;
 
 GetNBestListFn createGetNBestListFn(size_t beamSize, size_t dimBatch, DeviceId deviceId);
+
+typedef std::function<void(Tensor logits,
+                           const std::vector<float>& prevPathScores,
+                           float weight,
+                           const std::vector<WordIndex>& suppressed,
+                           size_t N,
+                           std::vector<float>& outCosts,
+                           std::vector<unsigned>& outKeys)> GetNBestListFusedFn;
+
+// Fused log-softmax, path score expansion and n-best selection for decoding with a single model on
+// the CPU. Takes the raw logits [dimBeam, 1, dimBatch, dimVocab or dimShortlist] and the previous
+// path scores [dimBeam, 1, dimBatch, 1] (flattened, or empty if all zero) and returns for every
+// batch entry the N best path scores prevPathScore + weight * logsoftmax(logits), skipping the
+// suppressed columns. Keys are (batchIdx * dimBeam + beamIdx) * dimVocab + wordIdx, as returned by
+// the GetNBestListFn on the swapped [dimBatch, 1, dimBeam, dimVocab] path scores.
+GetNBestListFusedFn createGetNBestListFusedFn();
 }  // namespace marian
@@ -0,0 +1,112 @@
+#include "translator/request_scheduler.h"
+
+#include "common/utils.h"
+
+namespace marian {
+
+void ServiceRequest::add(long lineNum, const std::string& best1, const std::string& bestn) {
+  if(finished_)
+    return;
+  collector_.add(lineNum, best1, bestn);
+  if(onSentence_)
+    onSentence_(lineNum, nbest_ ? bestn : best1);
+  if(--pending_ == 0 && !finished_.exchange(true))
+    onDone_(utils::join(collector_.collect(nbest_), "\n"));
+}
+
+void ServiceRequest::fail(std::exception_ptr error) {
+  if(finished_.exchange(true))
+    return;
+  if(onError_) {
+    onError_(error);
+    return;
+  }
+  try {
+    std::rethrow_exception(error);
+  } catch(const std::exception& e) {
+    LOG(error, "[server] Request failed: {}", e.what());
+  } catch(...) {
+    LOG(error, "[server] Request failed with an unknown error");
+  }
+}
+
+RequestScheduler::RequestScheduler(size_t maxSentences, size_t maxTokens, double maxLatencyMs)
+    : maxSentences_(std::max<size_t>(maxSentences, 1)),
+      maxTokens_(maxTokens),
+      maxLatency_((long long)(maxLatencyMs * 1000)) {}
+
+void RequestScheduler::push(std::vector<PendingSentence>&& sentences) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ABORT_IF(shutdown_, "Cannot add requests to a scheduler that has been shut down");
+    for(auto& sentence : sentences) {
+      queuedTokens_ += numTokens(sentence);
+      queue_.emplace_back(std::move(sentence));
+    }
+  }
+  cv_.notify_all();
+}
+
+std::vector<PendingSentence> RequestScheduler::pop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for(;;) {
+    if(queue_.empty()) {
+      if(shutdown_)
+        return {};
+      cv_.wait(lock);
+      continue;
+    }
+    if(shutdown_ || batchIsFull())
+      break;
+    // wait for more sentences, but no longer than the oldest sentence is allowed to wait
+    auto deadline = queue_.front().arrival + maxLatency_;
+    if(clock::now() >= deadline)
+      break;
+    cv_.wait_until(lock, deadline);
+  }
+
+  std::vector<PendingSentence> batch;
+  size_t batchTokens = 0;
+  while(!queue_.empty() && batch.size() < maxSentences_) {
+    size_t tokens = numTokens(queue_.front());
+    // always take at least one sentence, even if it exceeds the token budget on its own
+    if(maxTokens_ > 0 && !batch.empty() && batchTokens + tokens > maxTokens_)
+      break;
+    batchTokens += tokens;
+    queuedTokens_ -= tokens;
+    batch.emplace_back(std::move(queue_.front()));
+    queue_.pop_front();
+  }
+
+  // other consumers may be able to form a batch from the remainder right away
+  if(!queue_.empty())
+    cv_.notify_one();
+  return batch;
+}
+
+void RequestScheduler::shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutdown_ = true;
+  }
+  cv_.notify_all();
+}
+
+bool translateBatch(const std::vector<PendingSentence>& batch, const std::function<void()>& translate) {
+  std::exception_ptr error;
+  try {
+    translate();
+    return true;
+  } catch(const std::exception& e) {
+    LOG(error, "[server] Translating a batch of {} sentences failed: {}", batch.size(), e.what());
+    error = std::current_exception();
+  } catch(...) {
+    LOG(error, "[server] Translating a batch of {} sentences failed with an unknown error", batch.size());
+    error = std::current_exception();
+  }
+  for(const auto& sentence : batch)
+    sentence.request->fail(error);
+  return false;
+}
+
+}  // namespace marian
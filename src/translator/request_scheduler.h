@@ -0,0 +1,113 @@
+#pragma once
+
+#include "common/definitions.h"
+#include "data/corpus_base.h"
+#include "translator/output_collector.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace marian {
+
+// A single request submitted to a translation service, e.g. one websocket message. It keeps track
+// of how many of its sentences are still in flight and calls the completion callback with the
+// joined translations once the last sentence has been collected.
+class ServiceRequest {
+public:
+  typedef std::function<void(const std::string&)> Callback;
+  typedef std::function<void(long, const std::string&)> SentenceCallback;
+  typedef std::function<void(std::exception_ptr)> ErrorCallback;
+
+  ServiceRequest(size_t numSentences,
+                 bool quiet,
+                 bool nbest,
+                 Callback onDone,
+                 SentenceCallback onSentence = nullptr,
+                 ErrorCallback onError = nullptr)
+      : collector_(quiet),
+        pending_(numSentences),
+        nbest_(nbest),
+        onDone_(onDone),
+        onSentence_(onSentence),
+        onError_(onError) {}
+
+  // Records the translation of the sentence with the given line number and passes it on to the
+  // sentence callback if there is one; the thread that adds the last outstanding sentence runs the
+  // completion callback. Ignored once the request has failed.
+  void add(long lineNum, const std::string& best1, const std::string& bestn);
+
+  // Completes the request with the given error instead of its translations, e.g. if a batch with
+  // one of its sentences could not be translated. Only the first error is passed to the error
+  // callback, or logged if there is none; the completion callback is not called anymore.
+  void fail(std::exception_ptr error);
+
+private:
+  StringCollector collector_;
+  std::atomic<size_t> pending_;
+  std::atomic<bool> finished_{false}; // set by whichever runs first of the completion and error callbacks
+  bool nbest_;
+  Callback onDone_;
+  SentenceCallback onSentence_;
+  ErrorCallback onError_;
+};
+
+// A source sentence waiting in the scheduler queue together with the request it came from.
+// The sentence id of the tuple is the line number within the originating request.
+struct PendingSentence {
+  data::SentenceTuple tuple;
+  Ptr<ServiceRequest> request;
+  std::chrono::steady_clock::time_point arrival;
+};
+
+// Persistent queue that merges sentences from many concurrent requests into shared batches.
+// Consumers block in pop() until either enough sentences or source tokens have accumulated to fill
+// a batch, or until the oldest queued sentence has waited for the maximum latency. Sentences are
+// served first-come first-served, so a request is never starved by later traffic.
+class RequestScheduler {
+private:
+  typedef std::chrono::steady_clock clock;
+
+  std::deque<PendingSentence> queue_;
+  size_t queuedTokens_{0};
+  bool shutdown_{false};
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+
+  size_t maxSentences_;              // maximum number of sentences per batch
+  size_t maxTokens_;                 // maximum number of source tokens per batch, 0 means no limit
+  std::chrono::microseconds maxLatency_; // maximum waiting time for a batch to fill up
+
+  static size_t numTokens(const PendingSentence& sentence) { return sentence.tuple[0].size(); }
+
+  bool batchIsFull() const {
+    return queue_.size() >= maxSentences_ || (maxTokens_ > 0 && queuedTokens_ >= maxTokens_);
+  }
+
+public:
+  RequestScheduler(size_t maxSentences, size_t maxTokens, double maxLatencyMs);
+
+  // Adds all sentences of a request to the end of the queue
+  void push(std::vector<PendingSentence>&& sentences);
+
+  // Blocks until a batch is ready and returns it. Returns an empty vector after shutdown() once
+  // the queue has been drained.
+  std::vector<PendingSentence> pop();
+
+  // Wakes up all consumers; remaining sentences are still handed out without waiting
+  void shutdown();
+};
+
+// Translates a batch popped from a RequestScheduler with the given function. If that throws, every
+// request with a sentence in the batch fails with the exception and false is returned, so that the
+// calling worker can go on with the next batch instead of leaving these requests pending forever.
+bool translateBatch(const std::vector<PendingSentence>& batch, const std::function<void()>& translate);
+
+}  // namespace marian
@@ -16,7 +16,8 @@ Ptr<Scorer> scorerByType(const std::string& fname,
     options->set("index", index);
   }
 
-  bool skipCost = options->get<bool>("skip-cost");
+  // with --fused-top-k the log-softmax is computed by the n-best search instead of the model
+  bool skipCost = options->get<bool>("skip-cost") || options->get<bool>("fused-top-k", false);
   auto encdec = models::createModelFromOptions(
       options, skipCost ? models::usage::raw : models::usage::translation);
 
@@ -38,7 +39,8 @@ Ptr<Scorer> scorerByType(const std::string& fname,
     options->set("index", index);
   }
 
-  bool skipCost = options->get<bool>("skip-cost");
+  // with --fused-top-k the log-softmax is computed by the n-best search instead of the model
+  bool skipCost = options->get<bool>("skip-cost") || options->get<bool>("fused-top-k", false);
   auto encdec = models::createModelFromOptions(
       options, skipCost ? models::usage::raw : models::usage::translation);
 
@@ -131,4 +133,18 @@ std::vector<Ptr<Scorer>> createScorers(Ptr<Options> options, const std::vector<m
   return createScorers(options, ptrs);
 }
 
+std::vector<mio::mmap_source> mmapModels(Ptr<Options> options) {
+  for(auto device : Config::getDevices(options))
+    ABORT_IF(device.type != DeviceType::cpu, "Memory-mapping models is only supported for decoding on CPU");
+
+  std::vector<mio::mmap_source> mmaps;
+  for(auto model : options->get<std::vector<std::string>>("models")) {
+    ABORT_IF(filesystem::Path(model).extension() != filesystem::Path(".bin"),
+             "Non-binarized models cannot be mmapped, convert {} with marian-conv first", model);
+    LOG(info, "Memory-mapping model file {}", model);
+    mmaps.emplace_back(model);
+  }
+  return mmaps;
+}
+
 }  // namespace marian
@@ -157,4 +157,8 @@ Ptr<Scorer> scorerByType(const std::string& fname,
 std::vector<Ptr<Scorer>> createScorers(Ptr<Options> options, const std::vector<const void*>& ptrs);
 std::vector<Ptr<Scorer>> createScorers(Ptr<Options> options, const std::vector<mio::mmap_source>& mmaps);
 
+// Memory-maps all models given by --models for use with createScorers(options, mmaps). Models
+// have to be in the binary *.bin format and can only be mapped for decoding on CPU.
+std::vector<mio::mmap_source> mmapModels(Ptr<Options> options);
+
 }  // namespace marian
@@ -1,6 +1,10 @@
 #pragma once
 
+#include <atomic>
+#include <future>
+#include <mutex>
 #include <string>
+#include <thread>
 
 #include "data/batch_generator.h"
 #include "data/corpus.h"
@@ -11,41 +15,36 @@
 #include "common/timer.h"
 
 #include "3rd_party/threadpool.h"
+#include "tensors/cpu/integer_common.h"
+#include "tensors/cpu/parallel.h"
 
+#include "translator/batch_fit.h"
 #include "translator/history.h"
+#include "translator/latency_stats.h"
 #include "translator/output_collector.h"
 #include "translator/output_printer.h"
+#include "translator/request_scheduler.h"
 
 #include "models/model_task.h"
 #include "translator/scorers.h"
 
-// currently for diagnostics only, will try to mmap files ending in *.bin suffix when enabled.
-// @TODO: add this as an actual feature.
-#define MMAP 0
-
-#if MMAP
-#include "3rd_party/mio/mio.hpp"
-#endif
-
 namespace marian {
 
 template <class Search>
 class Translate : public ModelTask {
 private:
   Ptr<Options> options_;
+  std::vector<mio::mmap_source> mmaps_; // mapped model files with --model-mmap, need to outlive the graphs
   std::vector<Ptr<ExpressionGraph>> graphs_;
   std::vector<std::vector<Ptr<Scorer>>> scorers_;
 
   Ptr<data::Corpus> corpus_;
   Ptr<Vocab> trgVocab_;
   Ptr<const data::ShortlistGenerator> shortlistGenerator_;
+  Ptr<LatencyStats> latencyStats_; // only with --latency-stats
 
   size_t numDevices_;
 
-#if MMAP
-  std::vector<mio::mmap_source> mmaps_;
-#endif
-
 public:
   Translate(Ptr<Options> options)
     : options_(New<Options>(options->clone())) { // @TODO: clone should return Ptr<Options> same as "with"?
@@ -62,25 +61,25 @@ public:
     trgVocab_->load(vocabs.back());
     auto srcVocab = corpus_->getVocabs()[0];
 
+    if(options_->get<bool>("latency-stats", false))
+      latencyStats_ = New<LatencyStats>();
+
     if(options_->hasAndNotEmpty("shortlist"))
       shortlistGenerator_ = data::createShortlistGenerator(options_, srcVocab, trgVocab_, 0, 1, vocabs.front() == vocabs.back());
+    if(shortlistGenerator_ && latencyStats_)
+      shortlistGenerator_ = New<TimedShortlistGenerator>(shortlistGenerator_, latencyStats_);
 
     auto devices = Config::getDevices(options_);
     numDevices_ = devices.size();
+    cpu::IntraOpThreadPool::global().resize(options_->get<size_t>("cpu-intra-threads", 1));
 
     ThreadPool threadPool(numDevices_, numDevices_);
     scorers_.resize(numDevices_);
     graphs_.resize(numDevices_);
 
-#if MMAP
-    auto models = options->get<std::vector<std::string>>("models");
-    for(auto model : models) {
-      marian::filesystem::Path modelPath(model);
-      ABORT_IF(modelPath.extension() != marian::filesystem::Path(".bin"),
-              "Non-binarized models cannot be mmapped");
-      mmaps_.push_back(std::move(mio::mmap_source(model)));
-    }
-#endif
+    // all devices share the same mapped pages
+    if(options_->get<bool>("model-mmap", false))
+      mmaps_ = mmapModels(options_);
 
     size_t id = 0;
     for(auto device : devices) {
@@ -89,6 +88,7 @@ public:
         auto prec = options_->get<std::vector<std::string>>("precision", {"float32"});
         graph->setDefaultElementType(typeFromString(prec[0]));
         graph->setDevice(device);
+        graph->setMemoryPlanning(options_->get<bool>("plan-memory", false));
         if (device.type == DeviceType::cpu) {
           graph->getBackend()->setOptimized(options_->get<bool>("optimize"));
           graph->getBackend()->setGemmType(options_->get<std::string>("gemm-type"));
@@ -97,11 +97,7 @@ public:
         graph->reserveWorkspaceMB(options_->get<size_t>("workspace"));
         graphs_[id] = graph;
 
-#if MMAP
-        auto scorers = createScorers(options_, mmaps_);
-#else
-        auto scorers = createScorers(options_);
-#endif
+        auto scorers = mmaps_.empty() ? createScorers(options_) : createScorers(options_, mmaps_);
         for(auto scorer : scorers) {
           scorer->init(graph);
           if(shortlistGenerator_)
@@ -128,7 +124,16 @@ public:
   }
 
   void run() override {
-    data::BatchGenerator<data::Corpus> bg(corpus_, options_);
+    // with --mini-batch-fit, batch sizes per source length are fitted into the workspace of the first graph
+    Ptr<data::BatchStats> stats;
+    if(options_->get<bool>("mini-batch-fit", false))
+      stats = BatchFitter<Search>(options_, graphs_[0], scorers_[0], corpus_->getVocabs(), trgVocab_).getStats();
+
+    // record activation ranges of the actual input only, not of the batches decoded for fitting
+    if(options_->hasAndNotEmpty("intgemm-calibrate"))
+      cpu::integer::ActivationCalibrator::global().enable();
+
+    data::BatchGenerator<data::Corpus> bg(corpus_, options_, stats);
 
     ThreadPool threadPool(numDevices_, numDevices_);
 
@@ -170,7 +175,11 @@ public:
     bool doNbest = options_->get<bool>("n-best");
 
     bg.prepare();
+    timer::Timer batchingTimer; // time spent waiting for the next batch
     for(auto batch : bg) {
+      if(latencyStats_)
+        latencyStats_->add(LatencyPhase::batching, batchingTimer.elapsed());
+
       auto task = [=, &syncCounts,
                       &totBatches, &totLines, &totSourceTokens, &totTimer, 
                       &curBatches, &curLines, &curSourceTokens, &curTimer](size_t id) {
@@ -182,9 +191,12 @@ public:
           scorers = scorers_[id % numDevices_];
         }
 
+        ScopedLatency batchLatency(latencyStats_, LatencyPhase::batch);
         auto search = New<Search>(options_, scorers, trgVocab_);
+        search->setLatencyStats(latencyStats_);
         auto histories = search->search(graph, batch);
 
+        ScopedLatency outputLatency(latencyStats_, LatencyPhase::output);
         for(auto history : histories) {
           std::stringstream best1;
           std::stringstream bestn;
@@ -194,6 +206,8 @@ public:
                            bestn.str(),
                            doNbest);
         }
+        outputLatency.stop();
+        batchLatency.stop();
 
         // if we asked for speed information display this
         if(statFreq.n > 0) { 
@@ -213,6 +227,8 @@ public:
             LOG(info, 
                 "Processed {} batches, {} lines, {} source tokens in {:.2f}s - Speed (since last): {:.2f} batches/s - {:.2f} lines/s - {:.2f} tokens/s", 
                 totBatches, totLines, totSourceTokens, totTime, curBatches / curTime, curLines / curTime, curSourceTokens / curTime);
+            if(latencyStats_)
+              LOG(info, "[latency] {}", latencyStats_->toJson());
             
             // reset stats between updates
             curBatches = curLines = curSourceTokens = 0;
@@ -222,6 +238,7 @@ public:
       };
 
       threadPool.enqueue(task, batchId++);
+      batchingTimer.start();
     }
 
     // make sure threads are joined before other local variables get de-allocated
@@ -234,6 +251,13 @@ public:
           "Processed {} batches, {} lines, {} source tokens in {:.2f}s - Speed (total): {:.2f} batches/s - {:.2f} lines/s - {:.2f} tokens/s", 
           totBatches, totLines, totSourceTokens, totTime, totBatches / totTime, totLines / totTime, totSourceTokens / totTime);
     }
+
+    // latency percentiles per phase over the whole translation in milliseconds
+    if(latencyStats_)
+      LOG(info, "[latency] {}", latencyStats_->toJson());
+
+    if(options_->hasAndNotEmpty("intgemm-calibrate"))
+      cpu::integer::ActivationCalibrator::global().save(options_->get<std::string>("intgemm-calibrate"));
   }
 };
 
@@ -241,6 +265,7 @@ template <class Search>
 class TranslateService : public ModelServiceTask {
 private:
   Ptr<Options> options_;
+  std::vector<mio::mmap_source> mmaps_; // mapped model files with --model-mmap, need to outlive the graphs
   std::vector<Ptr<ExpressionGraph>> graphs_;
   std::vector<std::vector<Ptr<Scorer>>> scorers_;
 
@@ -250,8 +275,31 @@ private:
 
   size_t numDevices_;
 
+  // per-phase latencies, only with --latency-stats
+  Ptr<LatencyStats> latencyStats_;
+  size_t statFreq_{0}; // log latencies every statFreq_ requests if larger than 0
+  std::atomic<size_t> numRequests_{0};
+
+  // shared batching across concurrent requests, only used with --shared-batching
+  UPtr<RequestScheduler> scheduler_;
+  Ptr<data::TextInput> batcher_; // only used for converting pending sentences into batches
+  std::vector<std::thread> workers_;
+
+  // translates streamed requests one at a time without --shared-batching, created on first use
+  UPtr<ThreadPool> requestThread_;
+  std::once_flag requestThreadCreated_;
+
 public:
-  virtual ~TranslateService() {}
+  virtual ~TranslateService() {
+    requestThread_.reset(); // finishes the queued requests
+    if(scheduler_) {
+      scheduler_->shutdown();
+      for(auto& worker : workers_)
+        worker.join();
+    }
+    if(latencyStats_)
+      LOG(info, "[latency] {}", latencyStats_->toJson());
+  }
 
   TranslateService(Ptr<Options> options)
     : options_(New<Options>(options->clone())) {
@@ -271,14 +319,28 @@ public:
     trgVocab_ = New<Vocab>(options_, vocabPaths.size() - 1);
     trgVocab_->load(vocabPaths.back());
 
+    if(options_->get<bool>("latency-stats", false)) {
+      latencyStats_ = New<LatencyStats>();
+      auto statFreq = SchedulingParameter::parse(options_->get<std::string>("stat-freq", "0u"));
+      ABORT_IF(statFreq.unit != SchedulingUnit::updates, "Units other than 'u' are not supported for --stat-freq value {}", statFreq);
+      statFreq_ = statFreq.n;
+    }
+
     // load lexical shortlist
     if(options_->hasAndNotEmpty("shortlist"))
-      shortlistGenerator_ = New<data::LexicalShortlistGenerator>(
+      shortlistGenerator_ = data::createShortlistGenerator(
           options_, srcVocabs_.front(), trgVocab_, 0, 1, vocabPaths.front() == vocabPaths.back());
+    if(shortlistGenerator_ && latencyStats_)
+      shortlistGenerator_ = New<TimedShortlistGenerator>(shortlistGenerator_, latencyStats_);
 
     // get device IDs
     auto devices = Config::getDevices(options_);
     numDevices_ = devices.size();
+    cpu::IntraOpThreadPool::global().resize(options_->get<size_t>("cpu-intra-threads", 1));
+
+    // all devices share the same mapped pages
+    if(options_->get<bool>("model-mmap", false))
+      mmaps_ = mmapModels(options_);
 
     // initialize scorers
     for(auto device : devices) {
@@ -287,6 +349,7 @@ public:
       auto precison = options_->get<std::vector<std::string>>("precision", {"float32"});
       graph->setDefaultElementType(typeFromString(precison[0])); // only use first type, used for parameter type in graph
       graph->setDevice(device);
+      graph->setMemoryPlanning(options_->get<bool>("plan-memory", false));
       if (device.type == DeviceType::cpu) {
         graph->getBackend()->setOptimized(options_->get<bool>("optimize"));
         graph->getBackend()->setGemmType(options_->get<std::string>("gemm-type"));
@@ -295,7 +358,7 @@ public:
       graph->reserveWorkspaceMB(options_->get<size_t>("workspace"));
       graphs_.push_back(graph);
 
-      auto scorers = createScorers(options_);
+      auto scorers = mmaps_.empty() ? createScorers(options_) : createScorers(options_, mmaps_);
       for(auto scorer : scorers) {
         scorer->init(graph);
         if(shortlistGenerator_)
@@ -303,16 +366,117 @@ public:
       }
       scorers_.push_back(scorers);
     }
+
+    // start one persistent worker per device that consumes batches merged from all requests
+    if(options_->get<bool>("shared-batching", false)) {
+      scheduler_.reset(new RequestScheduler(options_->get<int>("mini-batch"),
+                                            options_->get<size_t>("max-batch-tokens", 0),
+                                            options_->get<float>("max-batch-latency", 10.f)));
+      batcher_ = New<data::TextInput>(std::vector<std::string>(srcVocabs_.size()), srcVocabs_, options_);
+      for(size_t id = 0; id < numDevices_; ++id)
+        workers_.emplace_back([this, id]() { runWorker(id); });
+    }
   }
 
   std::string run(const std::string& input) override {
-    // split tab-separated input into fields if necessary
-    auto inputs = options_->get<bool>("tsv", false)
-                      ? convertTsvToLists(input, options_->get<size_t>("tsv-fields", 1))
-                      : std::vector<std::string>({input});
-    auto corpus_ = New<data::TextInput>(inputs, srcVocabs_, options_);
+    if(scheduler_) { // block until the shared workers have translated all sentences of this request
+      std::promise<std::string> output;
+      run(input,
+          [&output](const std::string& translation) { output.set_value(translation); },
+          /*onSentence=*/nullptr,
+          [&output](std::exception_ptr error) { output.set_exception(error); });
+      return output.get_future().get();
+    }
+    timer::Timer timer;
+    auto output = translate(input, nullptr);
+    requestDone(timer);
+    return output;
+  }
+
+  // Translates the input and calls onDone with the output. If given, onSentence is called with the
+  // line number and translation of every sentence as soon as it is final, and onError instead of
+  // onDone if the translation fails. With --shared-batching the sentences are queued for the shared
+  // workers and this returns immediately; the callbacks are then called from a worker thread.
+  // Otherwise requests with onSentence are queued for a request thread that translates them one at
+  // a time, so the caller, e.g. the io thread of the server, can deliver the sentences meanwhile.
+  // Other requests are translated synchronously and errors are thrown if there is no onError.
+  void run(const std::string& input,
+           const ServiceRequest::Callback& onDone,
+           const ServiceRequest::SentenceCallback& onSentence = nullptr,
+           const ServiceRequest::ErrorCallback& onError = nullptr) {
+    auto timer = New<timer::Timer>();
+    if(!scheduler_) {
+      auto translateRequest = [this, input, onDone, onSentence, onError, timer](bool rethrow) {
+        std::string output;
+        try {
+          output = translate(input, onSentence);
+        } catch(...) {
+          if(onError)
+            onError(std::current_exception());
+          else if(rethrow)
+            throw;
+          else
+            LOG(error, "[server] Translation of a request failed");
+          return;
+        }
+        requestDone(*timer);
+        onDone(output);
+      };
+      if(!onSentence) {
+        translateRequest(/*rethrow=*/true);
+        return;
+      }
+      // not created in the constructor, which may run with aborts that throw, see ModelRegistry
+      std::call_once(requestThreadCreated_, [this]() { requestThread_.reset(new ThreadPool(1)); });
+      requestThread_->enqueue(translateRequest, /*rethrow=*/false);
+      return;
+    }
+
+    ScopedLatency batchingLatency(latencyStats_, LatencyPhase::batching);
+    auto corpus = New<data::TextInput>(splitInput(input), srcVocabs_, options_);
+    std::vector<data::SentenceTuple> tuples;
+    for(auto tuple : *corpus)
+      tuples.push_back(tuple);
+    batchingLatency.stop();
+
+    if(tuples.empty()) {
+      onDone("");
+      return;
+    }
+
+    auto request = New<ServiceRequest>(tuples.size(),
+                                       options_->get<bool>("quiet-translation", false),
+                                       options_->get<bool>("n-best"),
+                                       [this, timer, onDone](const std::string& output) {
+                                         requestDone(*timer);
+                                         onDone(output);
+                                       },
+                                       onSentence,
+                                       onError);
+    auto arrival = std::chrono::steady_clock::now();
+    std::vector<PendingSentence> sentences;
+    for(auto& tuple : tuples)
+      sentences.push_back({std::move(tuple), request, arrival});
+    scheduler_->push(std::move(sentences));
+  }
+
+private:
+  // Records the latency of a completed request and logs the latency statistics every statFreq_ requests
+  void requestDone(const timer::Timer& timer) {
+    if(!latencyStats_)
+      return;
+    latencyStats_->add(LatencyPhase::request, timer.elapsed());
+    if(statFreq_ > 0 && ++numRequests_ % statFreq_ == 0)
+      LOG(info, "[latency] {}", latencyStats_->toJson());
+  }
+
+  // Translates the input on a temporary thread pool over all devices and returns the joined output
+  std::string translate(const std::string& input, const ServiceRequest::SentenceCallback& onSentence) {
+    timer::Timer batchingTimer; // time spent on tokenization and waiting for the next batch
+    auto corpus_ = New<data::TextInput>(splitInput(input), srcVocabs_, options_);
     data::BatchGenerator<data::TextInput> batchGenerator(corpus_, options_);
 
+    bool nbest = options_->get<bool>("n-best");
     auto collector = New<StringCollector>(options_->get<bool>("quiet-translation", false));
     auto printer = New<OutputPrinter>(options_, trgVocab_);
     size_t batchId = 0;
@@ -323,6 +487,9 @@ public:
       ThreadPool threadPool_(numDevices_, numDevices_);
 
       for(auto batch : batchGenerator) {
+        if(latencyStats_)
+          latencyStats_->add(LatencyPhase::batching, batchingTimer.elapsed());
+
         auto task = [=](size_t id) {
           thread_local Ptr<ExpressionGraph> graph;
           thread_local std::vector<Ptr<Scorer>> scorers;
@@ -332,27 +499,84 @@ public:
             scorers = scorers_[id % numDevices_];
           }
 
+          ScopedLatency batchLatency(latencyStats_, LatencyPhase::batch);
           auto search = New<Search>(options_, scorers, trgVocab_);
-          auto histories = search->search(graph, batch);
-
-          for(auto history : histories) {
+          search->setLatencyStats(latencyStats_);
+          search->setFinishedCallback([&](size_t /*batchIdx*/, Ptr<History> history) {
+            ScopedLatency outputLatency(latencyStats_, LatencyPhase::output);
             std::stringstream best1;
             std::stringstream bestn;
             printer->print(history, best1, bestn);
             collector->add((long)history->getLineNum(), best1.str(), bestn.str());
-          }
+            if(onSentence)
+              onSentence((long)history->getLineNum(), nbest ? bestn.str() : best1.str());
+          });
+          search->search(graph, batch);
         };
 
         threadPool_.enqueue(task, batchId);
         batchId++;
+        batchingTimer.start();
       }
     }
 
-    auto translations = collector->collect(options_->get<bool>("n-best"));
+    auto translations = collector->collect(nbest);
     return utils::join(translations, "\n");
   }
 
-private:
+  // split tab-separated input into fields if necessary
+  std::vector<std::string> splitInput(const std::string& input) {
+    return options_->get<bool>("tsv", false)
+               ? convertTsvToLists(input, options_->get<size_t>("tsv-fields", 1))
+               : std::vector<std::string>({input});
+  }
+
+  // Worker loop for --shared-batching: translates batches of sentences from the shared queue on
+  // the given device and hands the translations back to their requests.
+  void runWorker(size_t id) {
+    auto graph = graphs_[id];
+    auto scorers = scorers_[id];
+    auto printer = New<OutputPrinter>(options_, trgVocab_);
+
+    for(;;) {
+      auto sentences = scheduler_->pop();
+      if(sentences.empty()) // scheduler has been shut down
+        break;
+
+      if(latencyStats_) {
+        auto now = std::chrono::steady_clock::now();
+        for(const auto& sentence : sentences)
+          latencyStats_->add(LatencyPhase::queue, std::chrono::duration<double>(now - sentence.arrival).count());
+      }
+
+      // histories are in batch order; their line numbers are the line numbers within each request.
+      // Requests complete as soon as their last sentence is final, even if others in the batch are not.
+      // If the batch fails, its requests fail and the worker continues with the next batch.
+      bool translated = translateBatch(sentences, [&]() {
+        ScopedLatency batchingLatency(latencyStats_, LatencyPhase::batching);
+        std::vector<data::SentenceTuple> tuples;
+        for(const auto& sentence : sentences)
+          tuples.push_back(sentence.tuple);
+        auto batch = batcher_->toBatch(tuples);
+        batchingLatency.stop();
+
+        ScopedLatency batchLatency(latencyStats_, LatencyPhase::batch);
+        auto search = New<Search>(options_, scorers, trgVocab_);
+        search->setLatencyStats(latencyStats_);
+        search->setFinishedCallback([&](size_t batchIdx, Ptr<History> history) {
+          ScopedLatency outputLatency(latencyStats_, LatencyPhase::output);
+          std::stringstream best1;
+          std::stringstream bestn;
+          printer->print(history, best1, bestn);
+          sentences[batchIdx].request->add((long)history->getLineNum(), best1.str(), bestn.str());
+        });
+        search->search(graph, batch);
+      });
+      if(!translated)
+        graph->clear(); // drop what is left of the failed search
+    }
+  }
+
   // Converts a multi-line input with tab-separated source(s) and target sentences into separate lists
   // of sentences from source(s) and target sides, e.g.
   // "src1 \t trg1 \n src2 \t trg2" -> ["src1 \n src2", "trg1 \n trg2"]